@@ -0,0 +1,226 @@
+#include <common/types.h>
+#include <buddyallocator.h>
+#include <paging.h>
+
+using namespace myos;
+using namespace myos::common;
+
+void printf(char* str);
+void printInteger(int num);
+
+/*
+ * Host side test of the buddy allocator.
+ *
+ * Builds the allocator from a made-up multiboot memory map over host memory mapped at fixed addresses: a region with
+ * an unaligned start and the multiboot structures inside it, a hole, two neighbouring regions whose border is not
+ * aligned to 4 MiB, a region which crosses the stack area and one above it. Checks the frames which become usable,
+ * that blocks of neighbouring ranges are merged, and that random allocations never touch reserved memory and merge
+ * back into the same blocks when they are freed. The exit status is the number of failed checks.
+ */
+
+const uint32_t MiB = 1024*1024;
+const uint32_t BASE = 0x40000000; // Below the stack area, mapped with 64 MiB
+const uint32_t HIGH_BASE = STACK_AREA_BASE - 4*MiB; // Mapped with 4 MiB, the memory map claims 8 MiB from here
+const uint32_t KERNEL_END = BASE + 0x3000;
+const uint32_t INFO_ADDRESS = BASE + 8*MiB + 100;
+const uint32_t MAP_ADDRESS = BASE + 12*MiB + 4000; // Crosses a frame border
+const uint32_t MULTIBOOT_INFO_SIZE = 88;
+const uint32_t FRAME_STATES_SIZE = STACK_AREA_BASE / PAGE_SIZE; // One byte per frame up to the stack area
+
+const int NUM_OPERATIONS = 200000;
+const int NUM_SLOTS = 4000;
+
+struct MemoryMapEntry
+{
+    uint32_t size;
+    uint64_t baseAddress;
+    uint64_t length;
+    uint32_t type;
+} __attribute__((packed));
+
+// Usable frames: the first region without the kernel, the frame states and the frames of the multiboot structures,
+// the two neighbouring regions, and the part of the crossing region below the stack area
+const uint32_t EXPECTED_FRAMES = (20*MiB - 0x3000) / PAGE_SIZE - FRAME_STATES_SIZE / PAGE_SIZE - 1 - 2
+                               + 40*MiB / PAGE_SIZE
+                               + 4*MiB / PAGE_SIZE;
+
+// 4 MiB blocks: 4-8 and 16-20 MiB of the first region, the ten from 24 to 64 MiB, and the one below the stack area
+const uint32_t EXPECTED_LARGEST_BLOCKS = 13;
+
+// Ranges that must never be handed out, [start, end)
+const uint32_t reserved[][2] = {
+    {0, KERNEL_END},
+    {KERNEL_END, KERNEL_END + FRAME_STATES_SIZE},
+    {INFO_ADDRESS, INFO_ADDRESS + MULTIBOOT_INFO_SIZE},
+    {MAP_ADDRESS, MAP_ADDRESS + 6 * sizeof(MemoryMapEntry)},
+    {BASE + 20*MiB, BASE + 24*MiB},
+    {BASE + 64*MiB, HIGH_BASE},
+    {STACK_AREA_BASE, 0xFFFFFFFF}
+};
+const int NUM_RESERVED = sizeof(reserved) / sizeof(reserved[0]);
+
+uint32_t addresses[16*1024];
+uint32_t orders[NUM_SLOTS];
+int failedChecks = 0;
+
+uint32_t seed = 7;
+uint32_t Random()
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+void Check(bool ok, char* what)
+{
+    if (ok)
+        return;
+    ++failedChecks;
+    printf("FAILED: ");
+    printf(what);
+    printf("\n");
+}
+
+bool MapFixed(uint32_t address, uint32_t length)
+{
+    // mmap2(address, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0)
+    uint32_t result;
+    asm volatile("int $0x80" : "=a" (result) : "a" (192), "b" (address), "c" (length), "d" (0x3), "S" (0x32), "D" (-1) : "memory");
+    return result == address;
+}
+
+void SetEntry(MemoryMapEntry* entry, uint64_t baseAddress, uint64_t length, uint32_t type)
+{
+    entry->size = sizeof(MemoryMapEntry) - sizeof(entry->size);
+    entry->baseAddress = baseAddress;
+    entry->length = length;
+    entry->type = type;
+}
+
+bool Reserved(uint32_t address, uint32_t order)
+{
+    uint32_t end = address + (PAGE_SIZE << order);
+    for (int i = 0; i < NUM_RESERVED; ++i) {
+        if (reserved[i][0] < end && address < reserved[i][1])
+            return true;
+    }
+    return false;
+}
+
+// Takes every 4 MiB block and gives them back, returns how many there were
+uint32_t CountLargestBlocks(BuddyAllocator* buddyAllocator, bool* found40MiB)
+{
+    uint32_t count = 0;
+    uint32_t address;
+    while ((address = buddyAllocator->Allocate(BUDDY_MAX_ORDER)) != 0) {
+        if (address == BASE + 40*MiB)
+            *found40MiB = true;
+        addresses[count++] = address;
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        buddyAllocator->Free(addresses[i], BUDDY_MAX_ORDER);
+    }
+    return count;
+}
+
+void CheckMerged(BuddyAllocator* buddyAllocator, char* what)
+{
+    bool found40MiB = false;
+    Check(buddyAllocator->FreeFrames() == EXPECTED_FRAMES, what);
+    Check(CountLargestBlocks(buddyAllocator, &found40MiB) == EXPECTED_LARGEST_BLOCKS, what);
+    Check(found40MiB, "the block across the border of two ranges is merged");
+}
+
+void Stress(BuddyAllocator* buddyAllocator)
+{
+    uint32_t usedFrames = 0;
+    for (int i = 0; i < NUM_SLOTS; ++i) {
+        addresses[i] = 0;
+    }
+
+    for (int i = 0; i < NUM_OPERATIONS; ++i) {
+        int slot = Random() % NUM_SLOTS;
+        if (addresses[slot] != 0) {
+            uint32_t last = addresses[slot] + (PAGE_SIZE << orders[slot]) - 4;
+            Check(*(uint32_t*) addresses[slot] == slot && *(uint32_t*) last == slot, "a block keeps its data until it is freed");
+            buddyAllocator->Free(addresses[slot], orders[slot]);
+            usedFrames -= 1 << orders[slot];
+            addresses[slot] = 0;
+            continue;
+        }
+
+        // Mostly single frames, sometimes up to 4 MiB
+        uint32_t order = Random() % 4 == 0 ? Random() % (BUDDY_MAX_ORDER + 1) : Random() % 3;
+        uint32_t address = buddyAllocator->Allocate(order);
+        if (address == 0)
+            continue;
+        Check((address & ((PAGE_SIZE << order) - 1)) == 0, "a block is aligned to its size");
+        Check(!Reserved(address, order), "a block is not in reserved memory");
+
+        *(uint32_t*) address = slot;
+        *(uint32_t*)(address + (PAGE_SIZE << order) - 4) = slot;
+        addresses[slot] = address;
+        orders[slot] = order;
+        usedFrames += 1 << order;
+
+        if (i % 1000 == 0)
+            Check(buddyAllocator->FreeFrames() == EXPECTED_FRAMES - usedFrames, "free frames are counted");
+    }
+
+    for (int i = 0; i < NUM_SLOTS; ++i) {
+        if (addresses[i] != 0)
+            buddyAllocator->Free(addresses[i], orders[i]);
+    }
+}
+
+extern "C" int benchMain()
+{
+    if (!MapFixed(BASE, 64*MiB) || !MapFixed(HIGH_BASE, 4*MiB)) {
+        printf("buddy allocator: cannot map the test memory\n");
+        return 1;
+    }
+
+    MemoryMapEntry* map = (MemoryMapEntry*) MAP_ADDRESS;
+    SetEntry(&map[0], BASE + 0x1000 + 123, 20*MiB - 0x1000 - 123, 1);
+    SetEntry(&map[1], BASE + 20*MiB, 4*MiB, 2);
+    SetEntry(&map[2], BASE + 24*MiB, 18*MiB + 0x2000, 1);
+    SetEntry(&map[3], BASE + 42*MiB + 0x2000, 22*MiB - 0x2000, 1);
+    SetEntry(&map[4], HIGH_BASE, 8*MiB, 1);
+    SetEntry(&map[5], 0xFFFC0000, 0x40000, 1);
+
+    uint32_t* info = (uint32_t*) INFO_ADDRESS;
+    info[0] = 0x041; // mmap_length and mmap_addr are valid, and mem_lower and mem_upper
+    info[2] = 0;
+    info[11] = 6 * sizeof(MemoryMapEntry);
+    info[12] = MAP_ADDRESS;
+
+    BuddyAllocator buddyAllocator(info, KERNEL_END);
+    Check(buddyAllocator.UsableFrames() == EXPECTED_FRAMES, "the usable frames leave out the reserved ranges");
+    Check(buddyAllocator.MemoryEnd() == STACK_AREA_BASE, "the memory ends at the stack area");
+    CheckMerged(&buddyAllocator, "every usable frame is free after the start");
+
+    Check(BuddyAllocator::Order(1) == 0 && BuddyAllocator::Order(PAGE_SIZE) == 0, "a frame is order 0");
+    Check(BuddyAllocator::Order(PAGE_SIZE + 1) == 1, "a byte more is order 1");
+    Check(BuddyAllocator::Order(4*MiB) == BUDDY_MAX_ORDER && BuddyAllocator::Order(4*MiB + 1) == BUDDY_MAX_ORDER + 1, "4 MiB is the largest order");
+    Check(buddyAllocator.Allocate(BUDDY_MAX_ORDER + 1) == 0, "a block above 4 MiB fails");
+
+    Stress(&buddyAllocator);
+    CheckMerged(&buddyAllocator, "freed blocks are merged with their buddies");
+
+    // Every usable frame can be taken one by one, and they merge back completely
+    uint32_t frames = 0;
+    uint32_t address;
+    while (frames < sizeof(addresses) / sizeof(addresses[0]) && (address = buddyAllocator.Allocate(0)) != 0) {
+        Check(!Reserved(address, 0), "a frame is not in reserved memory");
+        addresses[frames++] = address;
+    }
+    Check(frames == EXPECTED_FRAMES && buddyAllocator.FreeFrames() == 0, "every usable frame can be allocated");
+    for (uint32_t i = 0; i < frames; ++i) {
+        buddyAllocator.Free(addresses[frames - 1 - i], 0);
+    }
+    CheckMerged(&buddyAllocator, "single frames are merged back");
+
+    printf("buddy allocator:");
+    printInteger(failedChecks);
+    printf(" failed checks\n");
+    return failedChecks;
+}
@@ -0,0 +1,191 @@
+#include <common/types.h>
+#include <memorymanagement.h>
+
+using namespace myos;
+using namespace myos::common;
+
+
+/*
+ * Host side stress test of the kernel heap.
+ *
+ * Runs random mallocs and frees of mixed sizes on a heap of two regions and checks that every block lies inside a
+ * region, keeps its data until it is freed, and that the statistics of the heap agree with the allocations the test
+ * holds. Built once for the TLSF heap and once with FIRSTFIT_HEAP. The exit status is the number of failed checks.
+ */
+
+const int NUM_OPERATIONS = 400000;
+const int NUM_SLOTS = 2000;
+const uint32_t REGION_SIZE = 4*1024*1024;
+const uint32_t ALIGNMENT = 8; // Both heaps hand out multiples of it
+
+uint8_t regions[2][REGION_SIZE] __attribute__((aligned(16)));
+
+struct Allocation
+{
+    uint8_t* data;
+    uint32_t size;
+    uint8_t pattern;
+};
+
+Allocation allocations[NUM_SLOTS];
+int failedChecks = 0;
+
+// memorymanagement.o brings its own placement new, so the test writes to the host without hoststubs
+void Print(const char* str)
+{
+    uint32_t len = 0;
+    while (str[len] != '\0') ++len;
+    int32_t result;
+    asm volatile("int $0x80" : "=a" (result) : "a" (4), "b" (2), "c" (str), "d" (len) : "memory");
+}
+
+void PrintNumber(uint32_t num)
+{
+    char str[11];
+    int i = 10;
+    str[i] = '\0';
+    do {
+        str[--i] = '0' + num % 10;
+        num /= 10;
+    } while (num != 0);
+    Print(str + i);
+}
+
+uint32_t seed = 12345;
+uint32_t Random()
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+void Check(bool ok, const char* what)
+{
+    if (ok)
+        return;
+    ++failedChecks;
+    Print("FAILED: ");
+    Print(what);
+    Print("\n");
+}
+
+bool InRegion(uint8_t* data, uint32_t size)
+{
+    for (int i = 0; i < 2; ++i) {
+        if (data >= regions[i] && data + size <= regions[i] + REGION_SIZE)
+            return true;
+    }
+    return false;
+}
+
+void CheckStatistics(MemoryManager* heap, uint32_t live, uint32_t requestedBytes)
+{
+    HeapStatistics statistics;
+    heap->GetStatistics(&statistics);
+
+    uint32_t liveBySize = 0;
+    for (uint32_t i = 0; i < HEAP_NUM_SIZE_CLASSES; ++i) {
+        liveBySize += statistics.liveAllocationsBySize[i];
+    }
+    Check(statistics.corruptBlocks == 0, "the walk finds no corrupt block");
+    Check(statistics.liveAllocations == live && liveBySize == live, "live allocations are counted");
+    Check(statistics.mallocs - statistics.frees == live, "mallocs minus frees are the live allocations");
+    Check(statistics.bytesInUse >= requestedBytes, "bytes in use cover the requested bytes");
+    Check(statistics.peakBytesInUse >= statistics.bytesInUse, "the peak is not below the bytes in use");
+    Check(statistics.largestFreeBlock <= statistics.freeBytes && statistics.fragmentation <= 100, "free bytes add up");
+    Check(statistics.bytesInUse + statistics.freeBytes <= statistics.heapBytes, "the blocks fit in the regions");
+}
+
+void Stress(MemoryManager* heap)
+{
+    uint32_t live = 0;
+    uint32_t requestedBytes = 0;
+
+    for (int i = 0; i < NUM_OPERATIONS; ++i) {
+        Allocation* allocation = &allocations[Random() % NUM_SLOTS];
+
+        if (allocation->data != 0) {
+            bool intact = true;
+            for (uint32_t j = 0; j < allocation->size; ++j) {
+                intact = intact && allocation->data[j] == allocation->pattern;
+            }
+            Check(intact, "a block keeps its data until it is freed");
+
+            heap->free(allocation->data);
+            allocation->data = 0;
+            --live;
+            requestedBytes -= allocation->size;
+        }
+        else {
+            // Mostly small objects, some large buffers
+            allocation->size = Random() % 8 == 0 ? Random() % 20000 : Random() % 200;
+            allocation->data = (uint8_t*) heap->malloc(allocation->size);
+            if (allocation->data == 0)
+                continue;
+
+            Check(InRegion(allocation->data, allocation->size), "a block lies inside a region");
+#ifndef FIRSTFIT_HEAP
+            Check(((uint32_t) allocation->data & (ALIGNMENT - 1)) == 0, "the data is aligned");
+#endif
+            allocation->pattern = Random();
+            for (uint32_t j = 0; j < allocation->size; ++j) {
+                allocation->data[j] = allocation->pattern;
+            }
+            ++live;
+            requestedBytes += allocation->size;
+        }
+
+        if (i % 20000 == 0)
+            CheckStatistics(heap, live, requestedBytes);
+    }
+
+    for (int i = 0; i < NUM_SLOTS; ++i) {
+        heap->free(allocations[i].data);
+        allocations[i].data = 0;
+    }
+    CheckStatistics(heap, 0, 0);
+}
+
+extern "C" int benchMain()
+{
+    // The first region starts unaligned, the heap has to align it itself
+    MemoryManager heap((size_t) regions[0] + 3, REGION_SIZE - 3);
+    heap.AddRegion((size_t) regions[1], REGION_SIZE);
+
+    HeapStatistics statistics;
+    heap.GetStatistics(&statistics);
+    Check(statistics.regions == 2 && statistics.freeBlocks == 2, "an empty heap has one free block per region");
+
+    Stress(&heap);
+
+    // Freed neighbours have been merged, so every region is a single free block again
+    heap.GetStatistics(&statistics);
+    Check(statistics.freeBlocks == 2, "freed blocks are merged");
+
+    // A block just big enough is only in the free list of its own size, which FindFreeBlock of TLSF takes as the last resort
+    uint32_t largest = statistics.largestFreeBlock;
+    uint32_t failures = statistics.failures;
+    void* block = heap.malloc(largest - ALIGNMENT);
+    Check(block != 0, "the largest free block can be allocated almost whole");
+    heap.free(block);
+#ifndef FIRSTFIT_HEAP
+    block = heap.malloc(largest);
+    Check(block != 0, "the largest free block can be allocated whole");
+    heap.free(block);
+#endif
+    Check(heap.malloc(largest + ALIGNMENT) == 0, "a block bigger than every region fails");
+    Check(heap.malloc(0x90000000) == 0, "a huge block fails");
+    heap.free(0);
+
+    heap.GetStatistics(&statistics);
+    Check(statistics.failures == failures + 2, "failed mallocs are counted");
+    Check(statistics.freeBlocks == 2 && statistics.liveAllocations == 0, "the heap is empty at the end");
+
+#ifdef FIRSTFIT_HEAP
+    Print("first-fit heap: ");
+#else
+    Print("TLSF heap: ");
+#endif
+    PrintNumber(failedChecks);
+    Print(" failed checks\n");
+    return failedChecks;
+}
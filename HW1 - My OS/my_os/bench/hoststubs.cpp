@@ -0,0 +1,116 @@
+
+#include <common/types.h>
+#include <gdt.h>
+#include <paging.h>
+#include <smp.h>
+
+using namespace myos;
+using namespace myos::common;
+
+// Stubs for the kernel parts that multitasking.cpp links against, so it can run as a plain host (i386 Linux) process.
+
+void hostWrite(int fd, const char* str, uint32_t len)
+{
+    asm volatile("int $0x80" : : "a" (4), "b" (fd), "c" (str), "d" (len) : "memory");
+}
+
+// Kernel console output goes to stderr so that stdout only contains the report
+void printf(char* str)
+{
+    uint32_t len = 0;
+    while (str[len] != '\0') ++len;
+    hostWrite(2, str, len);
+}
+
+void printfHex(uint8_t key)
+{
+    char* foo = "00";
+    char* hex = "0123456789ABCDEF";
+    foo[0] = hex[(key >> 4) & 0xF];
+    foo[1] = hex[key & 0xF];
+    printf(foo);
+}
+
+void printfHex32(uint32_t key)
+{
+    printfHex((key >> 24) & 0xFF);
+    printfHex((key >> 16) & 0xFF);
+    printfHex((key >> 8) & 0xFF);
+    printfHex( key & 0xFF);
+}
+
+void printInteger(int num)
+{
+    char str[16];
+    int i = 15;
+    bool is_negative = num < 0;
+    uint32_t n = is_negative ? -num : num;
+    
+    str[i] = '\0';
+    do {
+        str[--i] = '0' + n % 10;
+        n /= 10;
+    } while (n != 0);
+    str[--i] = is_negative ? '-' : ' ';
+    
+    printf(str + i);
+}
+
+// The host does not own the descriptor tables, so nothing is loaded here.
+GlobalDescriptorTable::SegmentDescriptor::SegmentDescriptor() { }
+GlobalDescriptorTable::GlobalDescriptorTable() { }
+GlobalDescriptorTable::~GlobalDescriptorTable() { }
+uint16_t GlobalDescriptorTable::CodeSegmentSelector() { return 0x10; }
+uint16_t GlobalDescriptorTable::DataSegmentSelector() { return 0x18; }
+
+// The benchmark runs on one CPU
+uint32_t MultiprocessorManager::NumCpus() { return 1; }
+uint32_t MultiprocessorManager::CurrentCpuIndex() { return 0; }
+
+// placement new
+void* operator new(unsigned size, void* ptr)
+{
+    return ptr;
+}
+
+// The stack area is ordinary host memory without page faults, so stacks are copied eagerly from the private page up to the top.
+PagingManager* PagingManager::activePagingManager = 0;
+
+PagingManager::PagingManager(GlobalDescriptorTable* gdt, PageFrameAllocator* frameAllocator)
+{
+    this->gdt = gdt;
+    this->frameAllocator = frameAllocator;
+    
+    // old_mmap(addr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0)
+    uint32_t args[6] = {STACK_AREA_BASE, STACK_AREA_SIZE, 0x3, 0x32, (uint32_t) -1, 0};
+    asm volatile("int $0x80" : : "a" (90), "b" (args) : "memory");
+    
+    activePagingManager = this;
+}
+
+PagingManager::~PagingManager()
+{
+    if (activePagingManager == this)
+        activePagingManager = 0;
+}
+
+bool PagingManager::PrepareStack(uint32_t base, uint32_t size)
+{
+    return true;
+}
+
+bool PagingManager::CloneStack(uint32_t base, uint32_t parentBase, uint32_t size, uint32_t privateFrom)
+{
+    for (uint32_t offset = (privateFrom & ~(PAGE_SIZE - 1)) - parentBase; offset < size; offset += 4) {
+        *(uint32_t*)(base + offset) = *(uint32_t*)(parentBase + offset);
+    }
+    return true;
+}
+
+void PagingManager::ReleaseStack(uint32_t base, uint32_t size)
+{
+}
+
+void PagingManager::TrimStack(uint32_t base, uint32_t size)
+{
+}
@@ -0,0 +1,347 @@
+
+#include <common/types.h>
+#include <gdt.h>
+#include <paging.h>
+#include <multitasking.h>
+
+using namespace myos;
+using namespace myos::common;
+
+void hostWrite(int fd, const char* str, uint32_t len);
+void* operator new(unsigned size, void* ptr);
+void printf(char* str);
+
+/*
+ * Host side microbenchmark of the TaskManager.
+ * 
+ * Times Schedule(CPUState*), AddTask, Fork, Waitpid, Sleep and pipe transfers in cycles per operation for all schedulers
+ * and prints one CSV row per (scheduler, operation, number of tasks) to stdout.
+ * "tasks" is the number of tasks in the TaskManager when the measured operation starts.
+ */
+
+const int NUM_REPETITIONS = 32; // Fresh TaskManagers built for every AddTask, Fork and Waitpid sample
+const int NUM_SCHEDULE_CALLS = 2048; // Consecutive Schedule calls timed on the same TaskManager
+const int NUM_CHURN_CYCLES = 4 * MAX_NUM_TASKS; // More fork/exit/waitpid cycles than task slots
+const int NUM_PIPE_TRANSFERS = 256;
+
+const int taskCounts[] = {1, 2, 4, 8, 16, 32, 64, 128, 255, 256};
+
+GlobalDescriptorTable gdt;
+uint8_t taskManagerMemory[sizeof(TaskManager)] __attribute__((aligned(16)));
+uint8_t pipeData[4 * PIPE_BUFFER_SIZE];
+uint8_t pipeBuffer[PIPE_BUFFER_SIZE];
+
+void benchEntry()
+{
+}
+
+static inline uint64_t ReadTimeStampCounter()
+{
+    uint64_t clockCounter;
+    asm volatile("rdtsc" : "=A"(clockCounter));
+    return clockCounter;
+}
+
+// Divides without the 64-bit helpers of libgcc, the quotient has to fit in 32 bits
+static uint32_t Divide(uint64_t dividend, uint32_t divisor)
+{
+    uint32_t quotient, remainder;
+    asm("divl %4" : "=a"(quotient), "=d"(remainder) : "a"((uint32_t) dividend), "d"((uint32_t) (dividend >> 32)), "rm"(divisor));
+    return quotient;
+}
+
+const char* SchedulerName(SchedulerType schedulerType);
+
+class Report
+{
+private:
+    char line[128];
+    int len;
+    
+    void Append(const char* str)
+    {
+        for (int i = 0; str[i] != '\0'; ++i) line[len++] = str[i];
+    }
+    
+    void Append(uint32_t num)
+    {
+        char str[11];
+        int i = 10;
+        str[i] = '\0';
+        do {
+            str[--i] = '0' + num % 10;
+            num /= 10;
+        } while (num != 0);
+        Append(str + i);
+    }
+    
+public:
+    void Header()
+    {
+        len = 0;
+        Append("scheduler,operation,tasks,samples,cycles_per_op_min,cycles_per_op_avg\n");
+        hostWrite(1, line, len);
+    }
+    
+    void Row(SchedulerType schedulerType, const char* operation, int tasks, uint32_t samples, uint64_t minCycles, uint64_t totalCycles)
+    {
+        len = 0;
+        Append(SchedulerName(schedulerType));
+        Append(",");
+        Append(operation);
+        Append(",");
+        Append((uint32_t) tasks);
+        Append(",");
+        Append(samples);
+        Append(",");
+        Append((uint32_t) minCycles);
+        Append(",");
+        Append(Divide(totalCycles, samples));
+        Append("\n");
+        hostWrite(1, line, len);
+    }
+};
+
+const char* SchedulerName(SchedulerType schedulerType)
+{
+    switch (schedulerType) {
+        case RoundRobin:
+            return "RoundRobin";
+        case PreemptivePriority:
+            return "PreemptivePriority";
+        case MultilevelFeedbackQueue:
+            return "MultilevelFeedbackQueue";
+        case Stride:
+            return "Stride";
+    }
+    return "Unknown";
+}
+
+Report report;
+
+TaskManager* NewTaskManager(SchedulerType schedulerType)
+{
+    return new (taskManagerMemory) TaskManager(&gdt, schedulerType, LifeCycleType::LifeCycleA, ProcessTablePrintType::DoNotPrint, false);
+}
+
+// Adds count independent tasks with mixed priorities
+void AddTasks(TaskManager* taskManager, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        taskManager->AddTask(benchEntry, (Priority) (i % 3), -1);
+    }
+}
+
+// Adds an init task, makes it the running task and forks it until the TaskManager has count tasks
+CPUState* StartInitWithChildren(TaskManager* taskManager, int count)
+{
+    taskManager->AddTask(benchEntry, Priority::High, -1);
+    CPUState* cpustate = taskManager->Schedule();
+    
+    for (int i = 1; i < count; ++i) {
+        taskManager->Fork(cpustate);
+    }
+    return cpustate;
+}
+
+void BenchmarkAddTask(SchedulerType schedulerType, int tasks)
+{
+    if (tasks >= MAX_NUM_TASKS)
+        return;
+    
+    uint64_t total = 0, minCycles = ~0ull;
+    for (int r = 0; r < NUM_REPETITIONS; ++r) {
+        TaskManager* taskManager = NewTaskManager(schedulerType);
+        AddTasks(taskManager, tasks);
+        
+        uint64_t start = ReadTimeStampCounter();
+        taskManager->AddTask(benchEntry, Priority::Low, -1);
+        uint64_t cycles = ReadTimeStampCounter() - start;
+        
+        total += cycles;
+        if (cycles < minCycles) minCycles = cycles;
+    }
+    report.Row(schedulerType, "add_task", tasks, NUM_REPETITIONS, minCycles, total);
+}
+
+void BenchmarkSchedule(SchedulerType schedulerType, int tasks)
+{
+    uint64_t total = 0, minCycles = ~0ull;
+    TaskManager* taskManager = NewTaskManager(schedulerType);
+    AddTasks(taskManager, tasks);
+    
+    CPUState* cpustate = taskManager->Schedule();
+    for (int i = 0; i < NUM_SCHEDULE_CALLS; ++i) {
+        uint64_t start = ReadTimeStampCounter();
+        cpustate = taskManager->Schedule(cpustate);
+        uint64_t cycles = ReadTimeStampCounter() - start;
+        
+        total += cycles;
+        if (cycles < minCycles) minCycles = cycles;
+    }
+    report.Row(schedulerType, "schedule", tasks, NUM_SCHEDULE_CALLS, minCycles, total);
+}
+
+void BenchmarkFork(SchedulerType schedulerType, int tasks)
+{
+    if (tasks >= MAX_NUM_TASKS)
+        return;
+    
+    uint64_t total = 0, minCycles = ~0ull;
+    for (int r = 0; r < NUM_REPETITIONS; ++r) {
+        TaskManager* taskManager = NewTaskManager(schedulerType);
+        CPUState* cpustate = StartInitWithChildren(taskManager, tasks);
+        
+        uint64_t start = ReadTimeStampCounter();
+        taskManager->Fork(cpustate);
+        uint64_t cycles = ReadTimeStampCounter() - start;
+        
+        total += cycles;
+        if (cycles < minCycles) minCycles = cycles;
+    }
+    report.Row(schedulerType, "fork", tasks, NUM_REPETITIONS, minCycles, total);
+}
+
+// Waitpid(-1) of an init process whose children are all still alive, so it has to block
+void BenchmarkWaitpid(SchedulerType schedulerType, int tasks)
+{
+    uint64_t total = 0, minCycles = ~0ull;
+    for (int r = 0; r < NUM_REPETITIONS; ++r) {
+        TaskManager* taskManager = NewTaskManager(schedulerType);
+        CPUState* cpustate = StartInitWithChildren(taskManager, tasks);
+        
+        uint64_t start = ReadTimeStampCounter();
+        taskManager->Waitpid(-1, cpustate);
+        uint64_t cycles = ReadTimeStampCounter() - start;
+        
+        total += cycles;
+        if (cycles < minCycles) minCycles = cycles;
+    }
+    report.Row(schedulerType, "waitpid", tasks, NUM_REPETITIONS, minCycles, total);
+}
+
+// Timer ticks while every task sleeps for a different time, so the timer wheel moves tasks down its levels and wakes them
+void BenchmarkSleepTick(SchedulerType schedulerType, int tasks)
+{
+    uint64_t total = 0, minCycles = ~0ull;
+    TaskManager* taskManager = NewTaskManager(schedulerType);
+    taskManager->SetTimerFrequency(1000);
+    AddTasks(taskManager, tasks);
+    
+    CPUState* cpustate = taskManager->Schedule();
+    for (int i = 0; i < tasks; ++i) {
+        cpustate = (CPUState*) taskManager->Sleep(1 + (i * 37) % NUM_SCHEDULE_CALLS, cpustate);
+    }
+    
+    for (int i = 0; i < NUM_SCHEDULE_CALLS; ++i) {
+        uint64_t start = ReadTimeStampCounter();
+        cpustate = taskManager->Schedule(cpustate);
+        uint64_t cycles = ReadTimeStampCounter() - start;
+        
+        total += cycles;
+        if (cycles < minCycles) minCycles = cycles;
+    }
+    report.Row(schedulerType, "sleep_tick", tasks, NUM_SCHEDULE_CALLS, minCycles, total);
+}
+
+// Fork, exit of the child and waitpid of the parent in a loop, which needs the task slots to be reused
+void BenchmarkChurn(SchedulerType schedulerType)
+{
+    uint64_t total = 0, minCycles = ~0ull;
+    TaskManager* taskManager = NewTaskManager(schedulerType);
+    CPUState* cpustate = StartInitWithChildren(taskManager, 1);
+    Task* init = taskManager->GetCurrentTask();
+    
+    for (int i = 0; i < NUM_CHURN_CYCLES; ++i) {
+        uint64_t start = ReadTimeStampCounter();
+        taskManager->Fork(cpustate);
+        if (init->forkPid == -1) {
+            printf("schedbench: fork failed, task slots are not reused\n");
+            return;
+        }
+        taskManager->Waitpid(-1, cpustate); // Blocks init and runs the child
+        cpustate = (CPUState*) taskManager->Exit(); // Wakes init up
+        uint64_t cycles = ReadTimeStampCounter() - start;
+        
+        total += cycles;
+        if (cycles < minCycles) minCycles = cycles;
+    }
+    report.Row(schedulerType, "fork_exit_waitpid", 1, NUM_CHURN_CYCLES, minCycles, total);
+}
+
+// The same loop with spawn, which starts the child on a fresh stack instead of copying the one of the parent
+void BenchmarkSpawnChurn(SchedulerType schedulerType)
+{
+    uint64_t total = 0, minCycles = ~0ull;
+    TaskManager* taskManager = NewTaskManager(schedulerType);
+    CPUState* cpustate = StartInitWithChildren(taskManager, 1);
+    Task* init = taskManager->GetCurrentTask();
+    
+    for (int i = 0; i < NUM_CHURN_CYCLES; ++i) {
+        uint64_t start = ReadTimeStampCounter();
+        if (taskManager->Spawn(benchEntry, init->GetPriority()) == -1) {
+            printf("schedbench: spawn failed, task slots are not reused\n");
+            return;
+        }
+        taskManager->Waitpid(-1, cpustate); // Blocks init and runs the child
+        cpustate = (CPUState*) taskManager->Exit(); // Wakes init up
+        uint64_t cycles = ReadTimeStampCounter() - start;
+        
+        total += cycles;
+        if (cycles < minCycles) minCycles = cycles;
+    }
+    report.Row(schedulerType, "spawn_exit_waitpid", 1, NUM_CHURN_CYCLES, minCycles, total);
+}
+
+// A write four times the size of the pipe buffer which the child reads in buffer sized chunks, so the writer blocks and its data is copied in chunks
+void BenchmarkPipe(SchedulerType schedulerType)
+{
+    uint64_t total = 0, minCycles = ~0ull;
+    TaskManager* taskManager = NewTaskManager(schedulerType);
+    taskManager->AddTask(benchEntry, Priority::High, -1);
+    CPUState* cpustate = taskManager->Schedule();
+    Task* writer = taskManager->GetCurrentTask();
+    
+    int32_t descriptors[2];
+    taskManager->CreatePipe(descriptors);
+    taskManager->Fork(cpustate);
+    
+    for (int i = 0; i < NUM_PIPE_TRANSFERS; ++i) {
+        uint64_t start = ReadTimeStampCounter();
+        cpustate = (CPUState*) taskManager->Write(descriptors[1], pipeData, sizeof(pipeData), cpustate); // Blocks and runs the reader
+        while (taskManager->GetCurrentTask() != writer) {
+            cpustate = (CPUState*) taskManager->Read(descriptors[0], pipeBuffer, sizeof(pipeBuffer), cpustate); // Blocks when the pipe is empty
+        }
+        uint64_t cycles = ReadTimeStampCounter() - start;
+        
+        if (cpustate->eax != sizeof(pipeData)) {
+            printf("schedbench: pipe write did not complete\n");
+            return;
+        }
+        total += cycles;
+        if (cycles < minCycles) minCycles = cycles;
+    }
+    report.Row(schedulerType, "pipe_transfer", 2, NUM_PIPE_TRANSFERS, minCycles, total);
+}
+
+extern "C" int benchMain()
+{
+    PagingManager paging(&gdt, 0);
+    
+    SchedulerType schedulerTypes[] = {SchedulerType::RoundRobin, SchedulerType::PreemptivePriority, SchedulerType::MultilevelFeedbackQueue, SchedulerType::Stride};
+    
+    report.Header();
+    for (int s = 0; s < sizeof(schedulerTypes) / sizeof(SchedulerType); ++s) {
+        for (int i = 0; i < sizeof(taskCounts) / sizeof(int); ++i) {
+            BenchmarkAddTask(schedulerTypes[s], taskCounts[i]);
+            BenchmarkSchedule(schedulerTypes[s], taskCounts[i]);
+            BenchmarkFork(schedulerTypes[s], taskCounts[i]);
+            BenchmarkWaitpid(schedulerTypes[s], taskCounts[i]);
+            BenchmarkSleepTick(schedulerTypes[s], taskCounts[i]);
+        }
+        BenchmarkChurn(schedulerTypes[s]);
+        BenchmarkSpawnChurn(schedulerTypes[s]);
+        BenchmarkPipe(schedulerTypes[s]);
+    }
+    return 0;
+}
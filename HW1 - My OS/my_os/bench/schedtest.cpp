@@ -0,0 +1,188 @@
+#include <common/types.h>
+#include <gdt.h>
+#include <paging.h>
+#include <multitasking.h>
+
+using namespace myos;
+using namespace myos::common;
+
+void* operator new(unsigned size, void* ptr);
+void printf(char* str);
+void printInteger(int num);
+
+/*
+ * Host side test of the schedulers.
+ *
+ * Drives a TaskManager with Schedule(CPUState*) as the timer interrupt would and checks what the tasks get: the CPU time
+ * of CPU-bound stride tasks is shared by their tickets, real-time tasks are admitted only within
+ * REALTIME_UTILIZATION_LIMIT, an admitted earliest deadline first task preempts normal tasks as soon as its job is
+ * released, and a job which uses up its budget counts as a deadline miss. The exit status is the number of failed checks.
+ */
+
+const uint32_t NUM_STRIDE_TICKS = 10000;
+const uint32_t STRIDE_TOLERANCE = NUM_STRIDE_TICKS / 100; // Ticks a share may be off
+const uint32_t strideTickets[] = {70, 20, 10};
+const int NUM_STRIDE_TASKS = sizeof(strideTickets) / sizeof(strideTickets[0]);
+
+// Real-time times are in milliseconds, which are ticks at 1000 Hz
+const uint32_t TIMER_FREQUENCY = 1000;
+const uint32_t NUM_REALTIME_TICKS = 1000;
+const uint32_t REALTIME_PERIOD = 10;
+const uint32_t REALTIME_BUDGET = 2;
+const uint32_t NORMAL_QUANTUM = 1000; // Normal tasks would keep the CPU for the whole test
+
+GlobalDescriptorTable gdt;
+uint8_t taskManagerMemory[sizeof(TaskManager)] __attribute__((aligned(16)));
+int failedChecks = 0;
+
+void testEntry()
+{
+}
+
+void Check(bool ok, char* what)
+{
+    if (ok)
+        return;
+    ++failedChecks;
+    printf("FAILED: ");
+    printf(what);
+    printf("\n");
+}
+
+TaskManager* NewTaskManager(SchedulerType schedulerType)
+{
+    return new (taskManagerMemory) TaskManager(&gdt, schedulerType, LifeCycleType::LifeCycleA, ProcessTablePrintType::DoNotPrint, false);
+}
+
+// Runs the task manager for the given number of timer interrupts, the tasks never block
+CPUState* RunTicks(TaskManager* taskManager, CPUState* cpustate, uint32_t ticks)
+{
+    for (uint32_t i = 0; i < ticks; ++i) {
+        cpustate = taskManager->Schedule(cpustate);
+    }
+    return cpustate;
+}
+
+uint32_t CpuTicks(TaskManager* taskManager, int32_t pid)
+{
+    TaskStatistics statistics;
+    if (!taskManager->GetStatistics(pid, &statistics))
+        return 0;
+    return statistics.cpuTicks;
+}
+
+// A round robin task manager at 1000 Hz whose two normal tasks have long time slices, and a third task which is running
+TaskManager* NewRealTimeTaskManager(CPUState** cpustate)
+{
+    TaskManager* taskManager = NewTaskManager(SchedulerType::RoundRobin);
+    taskManager->SetTimerFrequency(TIMER_FREQUENCY);
+    taskManager->SetQuantum(Priority::Medium, NORMAL_QUANTUM);
+    taskManager->AddTask(testEntry, Priority::Medium, -1);
+    taskManager->AddTask(testEntry, Priority::Medium, -1);
+    taskManager->AddTask(testEntry, Priority::Medium, -1);
+    *cpustate = taskManager->Schedule();
+    return taskManager;
+}
+
+// Three CPU-bound tasks with 70, 20 and 10 tickets get 70, 20 and 10 percent of the ticks
+void TestStrideShares()
+{
+    TaskManager* taskManager = NewTaskManager(SchedulerType::Stride);
+    int32_t pids[NUM_STRIDE_TASKS];
+    uint32_t totalTickets = 0;
+    for (int i = 0; i < NUM_STRIDE_TASKS; ++i) {
+        pids[i] = taskManager->AddTask(testEntry, Priority::Medium, -1)->GetPid();
+        Check(taskManager->SetTaskTickets(pids[i], strideTickets[i]), "stride: tickets can be set");
+        totalTickets += strideTickets[i];
+    }
+
+    CPUState* cpustate = taskManager->Schedule();
+    RunTicks(taskManager, cpustate, NUM_STRIDE_TICKS);
+
+    uint32_t ticks = 0;
+    for (int i = 0; i < NUM_STRIDE_TASKS; ++i) {
+        uint32_t cpuTicks = CpuTicks(taskManager, pids[i]);
+        uint32_t share = NUM_STRIDE_TICKS * strideTickets[i] / totalTickets;
+        Check(cpuTicks + STRIDE_TOLERANCE >= share && cpuTicks <= share + STRIDE_TOLERANCE, "stride: the CPU time follows the tickets");
+        ticks += cpuTicks;
+    }
+    Check(ticks == NUM_STRIDE_TICKS, "stride: every tick is charged to a task");
+}
+
+// Real-time tasks whose utilization adds up to more than REALTIME_UTILIZATION_LIMIT are rejected
+void TestRealTimeAdmission()
+{
+    CPUState* cpustate;
+    TaskManager* taskManager = NewRealTimeTaskManager(&cpustate);
+    Task* first = taskManager->GetCurrentTask();
+    Check(taskManager->SetRealTime(REALTIME_PERIOD, REALTIME_PERIOD / 2, REALTIME_PERIOD) == 0, "realtime: half of the CPU is admitted");
+    Check(taskManager->SetRealTime(REALTIME_PERIOD, REALTIME_PERIOD / 2, REALTIME_PERIOD) == 0, "realtime: a task can change its parameters");
+
+    // The job ends at once, so the next task runs until the next period
+    cpustate = (CPUState*) taskManager->Yield(cpustate);
+    Task* second = taskManager->GetCurrentTask();
+    Check(second != first, "realtime: a normal task runs while the job sleeps");
+    Check(taskManager->SetRealTime(REALTIME_PERIOD, REALTIME_PERIOD / 2, REALTIME_PERIOD) == -1, "realtime: a task set over the limit is rejected");
+
+    uint32_t budget = REALTIME_PERIOD * REALTIME_UTILIZATION_LIMIT / 100 - REALTIME_PERIOD / 2;
+    Check(taskManager->SetRealTime(REALTIME_PERIOD, budget, REALTIME_PERIOD) == 0, "realtime: a rejected task takes no utilization, the rest up to the limit is admitted");
+    Check(taskManager->SetRealTime(REALTIME_PERIOD, REALTIME_PERIOD + 1, REALTIME_PERIOD) == -1, "realtime: a budget above the deadline is rejected");
+    Check(taskManager->SetRealTime(REALTIME_PERIOD, budget, REALTIME_PERIOD) == 0, "realtime: the utilization of a rejected change is given back");
+}
+
+// A real-time task whose jobs end at once preempts the normal tasks in the tick its job is released and misses no deadline
+void TestRealTimePreemption()
+{
+    CPUState* cpustate;
+    TaskManager* taskManager = NewRealTimeTaskManager(&cpustate);
+    Task* task = taskManager->GetCurrentTask();
+    Check(taskManager->SetRealTime(REALTIME_PERIOD, REALTIME_BUDGET, REALTIME_PERIOD) == 0, "realtime: the task is admitted");
+
+    uint32_t jobs = 0;
+    for (uint32_t i = 0; i < NUM_REALTIME_TICKS; ++i) {
+        if (taskManager->GetCurrentTask() == task) {
+            Check(taskManager->GetTicks() % REALTIME_PERIOD == 0, "realtime: a job runs in the tick it is released");
+            cpustate = (CPUState*) taskManager->Yield(cpustate);
+            ++jobs;
+        }
+        cpustate = taskManager->Schedule(cpustate);
+    }
+
+    TaskStatistics statistics;
+    taskManager->GetStatistics(task->GetPid(), &statistics);
+    Check(jobs == NUM_REALTIME_TICKS / REALTIME_PERIOD, "realtime: every period runs a job");
+    Check(statistics.completedJobs == jobs && statistics.deadlineMisses == 0, "realtime: jobs which end in time are no misses");
+    Check(statistics.waitTicks == 0, "realtime: the task never waits behind normal tasks");
+}
+
+// A real-time task which never ends its jobs gets its budget in every period, and each job counts as a deadline miss
+void TestRealTimeOverrun()
+{
+    CPUState* cpustate;
+    TaskManager* taskManager = NewRealTimeTaskManager(&cpustate);
+    Task* task = taskManager->GetCurrentTask();
+    Check(taskManager->SetRealTime(REALTIME_PERIOD, REALTIME_BUDGET, REALTIME_PERIOD) == 0, "realtime: the task is admitted");
+    RunTicks(taskManager, cpustate, NUM_REALTIME_TICKS);
+
+    TaskStatistics statistics;
+    taskManager->GetStatistics(task->GetPid(), &statistics);
+    uint32_t periods = NUM_REALTIME_TICKS / REALTIME_PERIOD;
+    Check(statistics.deadlineMisses == periods, "realtime: a job without budget is a deadline miss");
+    Check(statistics.cpuTicks == periods * REALTIME_BUDGET, "realtime: the task runs only for its budget");
+    Check(statistics.completedJobs == 0, "realtime: an overrun job is not completed");
+}
+
+extern "C" int benchMain()
+{
+    PagingManager paging(&gdt, 0);
+
+    TestStrideShares();
+    TestRealTimeAdmission();
+    TestRealTimePreemption();
+    TestRealTimeOverrun();
+
+    printf("scheduler:");
+    printInteger(failedChecks);
+    printf(" failed checks\n");
+    return failedChecks;
+}
@@ -0,0 +1,234 @@
+#include <common/types.h>
+#include <memorymanagement.h>
+#include <slab.h>
+
+using namespace myos;
+using namespace myos::common;
+
+
+/*
+ * Host side test of the object caches.
+ *
+ * Runs caches of odd sized objects with different alignments on a heap in host memory and checks that objects are
+ * aligned and keep their data, that constructors and destructors run once per object and slab, that a cache keeps one
+ * empty slab and gives the others back to the heap, and that the statistics count all of it. The exit status is the
+ * number of failed checks.
+ */
+
+const uint32_t REGION_SIZE = 4*1024*1024;
+const uint32_t NUM_SLABS = 3; // Objects are allocated to fill this many slabs
+const uint32_t MAX_OBJECTS = 1024;
+const uint32_t OBJECT_MAGIC = 0xC0FFEE;
+
+uint8_t region[REGION_SIZE] __attribute__((aligned(16)));
+void* objects[MAX_OBJECTS];
+int failedChecks = 0;
+
+uint32_t constructed = 0;
+uint32_t destructed = 0;
+
+// memorymanagement.o brings its own placement new, so the test writes to the host without hoststubs
+void Print(const char* str)
+{
+    uint32_t len = 0;
+    while (str[len] != '\0') ++len;
+    int32_t result;
+    asm volatile("int $0x80" : "=a" (result) : "a" (4), "b" (2), "c" (str), "d" (len) : "memory");
+}
+
+void PrintNumber(uint32_t num)
+{
+    char str[11];
+    int i = 10;
+    str[i] = '\0';
+    do {
+        str[--i] = '0' + num % 10;
+        num /= 10;
+    } while (num != 0);
+    Print(str + i);
+}
+
+void Check(bool ok, const char* what)
+{
+    if (ok)
+        return;
+    ++failedChecks;
+    Print("FAILED: ");
+    Print(what);
+    Print("\n");
+}
+
+struct TestObject
+{
+    uint32_t magic;
+    uint32_t data[23]; // 100 bytes in all, not a multiple of any alignment
+};
+
+void Construct(void* object)
+{
+    ++constructed;
+    ((TestObject*) object)->magic = OBJECT_MAGIC;
+}
+
+void Destruct(void* object)
+{
+    ++destructed;
+    Check(((TestObject*) object)->magic == OBJECT_MAGIC, "a free object keeps its constructed state");
+    ((TestObject*) object)->magic = 0;
+}
+
+bool Listed(ObjectCache* cache)
+{
+    for (ObjectCache* listed = ObjectCache::First(); listed != 0; listed = listed->Next()) {
+        if (listed == cache)
+            return true;
+    }
+    return false;
+}
+
+// Fills a few slabs with objects of the given size, checks where they are, and frees them again
+void TestAlignment(uint32_t size, uint32_t alignment)
+{
+    ObjectCache cache("alignment", size, alignment);
+    ObjectCacheStatistics statistics;
+    cache.GetStatistics(&statistics);
+    Check(statistics.objectSize >= size + sizeof(void*) && statistics.objectSize % alignment == 0, "alignment: the object size covers the object and its link");
+    Check(statistics.objectsPerSlab >= MIN_OBJECTS_PER_SLAB, "alignment: a slab holds at least MIN_OBJECTS_PER_SLAB objects");
+
+    uint32_t count = NUM_SLABS * statistics.objectsPerSlab;
+    if (count > MAX_OBJECTS) count = MAX_OBJECTS;
+    for (uint32_t i = 0; i < count; ++i) {
+        uint8_t* object = (uint8_t*) cache.Allocate();
+        objects[i] = object;
+        Check(object >= region && object + size <= region + REGION_SIZE, "alignment: an object lies in the heap");
+        Check(((uint32_t) object & (alignment - 1)) == 0, "alignment: an object is aligned");
+        for (uint32_t j = 0; j < size; ++j) {
+            object[j] = i;
+        }
+    }
+
+    for (uint32_t i = 0; i < count; ++i) {
+        bool intact = true;
+        for (uint32_t j = 0; j < size; ++j) {
+            intact = intact && ((uint8_t*) objects[i])[j] == (uint8_t) i;
+        }
+        Check(intact, "alignment: objects do not overlap");
+        cache.Free(objects[i]);
+    }
+}
+
+// The constructor runs for every object of a new slab, the destructor for every object of a slab given back
+void TestConstructors()
+{
+    constructed = 0;
+    destructed = 0;
+    ObjectCache cache("constructors", sizeof(TestObject), CACHE_LINE_SIZE, Construct, Destruct);
+    ObjectCacheStatistics statistics;
+    cache.GetStatistics(&statistics);
+    uint32_t perSlab = statistics.objectsPerSlab;
+    Check(constructed == 0, "constructors: nothing is constructed before the first allocation");
+
+    TestObject* object = (TestObject*) cache.Allocate();
+    Check(constructed == perSlab && destructed == 0, "constructors: a new slab constructs all of its objects");
+    Check(object->magic == OBJECT_MAGIC, "constructors: an allocated object is constructed");
+    cache.Free(object);
+    object = (TestObject*) cache.Allocate();
+    Check(constructed == perSlab && object->magic == OBJECT_MAGIC, "constructors: a reused object is not constructed again");
+
+    for (uint32_t i = 0; i < perSlab; ++i) {
+        objects[i] = cache.Allocate();
+    }
+    Check(constructed == 2 * perSlab, "constructors: the second slab constructs its objects");
+
+    cache.Free(object);
+    for (uint32_t i = 0; i < perSlab; ++i) {
+        cache.Free(objects[i]);
+    }
+    Check(destructed == perSlab, "constructors: the slab given back destructs its objects");
+    cache.Reap();
+    Check(destructed == constructed, "constructors: every constructed object is destructed");
+}
+
+// Freeing keeps one empty slab for the next allocations and gives the other empty slabs back to the heap
+void TestSpareSlab()
+{
+    ObjectCache cache("spare", sizeof(TestObject));
+    ObjectCacheStatistics statistics;
+    cache.GetStatistics(&statistics);
+    uint32_t count = NUM_SLABS * statistics.objectsPerSlab;
+
+    for (uint32_t i = 0; i < count; ++i) {
+        objects[i] = cache.Allocate();
+    }
+    cache.GetStatistics(&statistics);
+    Check(statistics.slabs == NUM_SLABS && statistics.grows == NUM_SLABS, "spare: full slabs are all in use");
+
+    for (uint32_t i = 0; i < count; ++i) {
+        cache.Free(objects[i]);
+    }
+    cache.GetStatistics(&statistics);
+    Check(statistics.slabs == 1 && statistics.reaps == NUM_SLABS - 1, "spare: one empty slab stays");
+
+    // The spare slab is taken again without going to the heap
+    cache.Free(cache.Allocate());
+    cache.GetStatistics(&statistics);
+    Check(statistics.slabs == 1 && statistics.grows == NUM_SLABS, "spare: the spare slab is reused");
+
+    cache.Reap();
+    cache.GetStatistics(&statistics);
+    Check(statistics.slabs == 0 && statistics.reaps == NUM_SLABS, "spare: reap gives back the spare slab");
+}
+
+// The counters follow the allocations, and a cache whose slab does not fit in the heap fails
+void TestStatistics(MemoryManager* heap)
+{
+    ObjectCache cache("statistics", 24, 8);
+    ObjectCacheStatistics statistics;
+    Check(Listed(&cache), "statistics: a cache is listed");
+
+    for (uint32_t i = 0; i < 100; ++i) {
+        objects[i] = cache.Allocate();
+    }
+    for (uint32_t i = 0; i < 100; i += 2) {
+        cache.Free(objects[i]);
+    }
+    cache.Free(0);
+    cache.GetStatistics(&statistics);
+    Check(statistics.objectSize == 32, "statistics: 24 bytes and the link take 32 bytes");
+    Check(statistics.allocations == 100 && statistics.frees == 50 && statistics.objectsInUse == 50, "statistics: allocations and frees are counted");
+    Check(statistics.slabs * statistics.objectsPerSlab >= 100 && statistics.grows == statistics.slabs, "statistics: slabs are counted");
+    Check(statistics.failures == 0, "statistics: no failure while the heap has room");
+
+    for (uint32_t i = 1; i < 100; i += 2) {
+        cache.Free(objects[i]);
+    }
+    cache.Reap();
+
+    ObjectCache huge("huge", REGION_SIZE / 2);
+    Check(huge.Allocate() == 0, "statistics: a slab bigger than the heap fails");
+    huge.GetStatistics(&statistics);
+    Check(statistics.failures == 1 && statistics.slabs == 0 && statistics.allocations == 0, "statistics: the failure is counted");
+
+    HeapStatistics heapStatistics;
+    heap->GetStatistics(&heapStatistics);
+    Check(heapStatistics.liveAllocations == 0, "statistics: every slab is back in the heap");
+}
+
+extern "C" int benchMain()
+{
+    MemoryManager heap((size_t) region, REGION_SIZE);
+
+    TestAlignment(13, 8);
+    TestAlignment(100, CACHE_LINE_SIZE);
+    TestAlignment(700, 256);
+    TestAlignment(5000, 16);
+    TestConstructors();
+    TestSpareSlab();
+    TestStatistics(&heap);
+    Check(ObjectCache::First() == 0, "a destroyed cache is not listed");
+
+    Print("object caches: ");
+    PrintNumber(failedChecks);
+    Print(" failed checks\n");
+    return failedChecks;
+}
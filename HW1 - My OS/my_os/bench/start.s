@@ -0,0 +1,13 @@
+# Entry point of the host side scheduler benchmark (linked without libc, like the kernel)
+
+.section .text
+.extern benchMain
+.global _start
+
+_start:
+    call benchMain
+
+    # exit(eax) syscall of the host (i386 Linux)
+    mov %eax, %ebx
+    mov $1, %eax
+    int $0x80
@@ -0,0 +1,54 @@
+#ifndef __MYOS__BUDDYALLOCATOR_H
+#define __MYOS__BUDDYALLOCATOR_H
+
+#include <common/types.h>
+
+namespace myos
+{
+
+    const common::uint32_t BUDDY_MAX_ORDER = 10; // Blocks are 4 KiB << order, up to 4 MiB
+
+    // Hands out physically contiguous blocks of 4 KiB to 4 MiB, aligned to their size, from the usable RAM in the
+    // multiboot memory map. A freed block is merged with its buddy, the other half of the block of the next order,
+    // as long as the buddy is free too. Only RAM below the stack area is used, since the rest is not identity mapped.
+    class BuddyAllocator
+    {
+    private:
+        struct FreeBlock
+        {
+            FreeBlock* next;
+            FreeBlock* prev;
+        };
+
+        FreeBlock* freeLists[BUDDY_MAX_ORDER + 1];
+        common::uint8_t* frameStates; // For every frame: FREE_BLOCK | order if a free block starts there, 0 otherwise
+        common::uint32_t numFrames; // Frames from address 0 which frameStates covers
+        common::uint32_t numUsableFrames;
+        common::uint32_t numFreeFrames;
+
+        static bool UsableRegion(const void* multibootStructure, common::uint32_t index, common::uint32_t* start, common::uint32_t* end);
+        void AddRange(common::uint32_t start, common::uint32_t end, const common::uint32_t (*reserved)[2], common::uint32_t numReserved);
+        void Push(common::uint32_t address, common::uint32_t order);
+        void Remove(common::uint32_t address, common::uint32_t order);
+
+    public:
+        static BuddyAllocator* activeBuddyAllocator;
+
+        // The memory below kernelEnd holds the kernel and is never handed out
+        BuddyAllocator(const void* multibootStructure, common::uint32_t kernelEnd);
+        ~BuddyAllocator();
+
+        // The smallest order whose blocks hold size bytes, BUDDY_MAX_ORDER + 1 if size is larger than 4 MiB
+        static common::uint32_t Order(common::uint32_t size);
+
+        common::uint32_t Allocate(common::uint32_t order); // Physical address of the block, 0 if there is no free block
+        void Free(common::uint32_t address, common::uint32_t order);
+
+        common::uint32_t UsableFrames();
+        common::uint32_t FreeFrames();
+        common::uint32_t MemoryEnd(); // Above the highest usable frame
+    };
+
+}
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef __MYOS__FPU_H
+#define __MYOS__FPU_H
+
+#include <common/types.h>
+#include <hardwarecommunication/interrupts.h>
+#include <multitasking.h>
+
+namespace myos
+{
+    
+    // The x87 and SSE registers of the CPUs. They are switched lazily: a CPU sets CR0.TS when it dispatches a task whose
+    // registers it does not hold, and the first x87 or SSE instruction of the task raises device not available (0x07),
+    // which saves the registers of the previous owner and loads the task's. Tasks which never use them cost nothing.
+    class FloatingPointUnit : public hardwarecommunication::InterruptHandler
+    {
+    private:
+        TaskManager* taskManager;
+        
+    public:
+        FloatingPointUnit(hardwarecommunication::InterruptManager* interruptManager, TaskManager* taskManager);
+        ~FloatingPointUnit();
+        
+        // Turns on x87 and SSE with FXSAVE on the CPU which calls it, false if the CPU has no SSE
+        static bool EnableProcessor();
+        
+        virtual common::uint32_t HandleInterrupt(common::uint32_t esp);
+        
+        // The state areas are FPU_STATE_SIZE bytes and 16 byte aligned
+        static inline void Save(common::uint8_t* state)
+        {
+            asm volatile("fxsave (%0)" : : "r" (state) : "memory");
+        }
+        
+        static inline void Restore(common::uint8_t* state)
+        {
+            asm volatile("fxrstor (%0)" : : "r" (state) : "memory");
+        }
+        
+        // Initial state of a task which uses the registers for the first time
+        static inline void Initialize()
+        {
+            common::uint32_t mxcsr = 0x1F80; // All SSE exceptions masked
+            asm volatile("fninit\n ldmxcsr %0" : : "m" (mxcsr));
+        }
+        
+        // With CR0.TS set, the next x87 or SSE instruction raises device not available
+        static inline void SetTaskSwitched()
+        {
+            common::uint32_t cr0;
+            asm volatile("mov %%cr0, %0" : "=r" (cr0));
+            asm volatile("mov %0, %%cr0" : : "r" (cr0 | 0x8));
+        }
+        
+        static inline void ClearTaskSwitched()
+        {
+            asm volatile("clts");
+        }
+    };
+    
+}
+
+#endif
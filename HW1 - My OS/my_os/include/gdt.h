@@ -6,6 +6,35 @@
 namespace myos
 {
     
+    const int MAX_TASK_STATE_SEGMENTS = 2;
+    
+    // 32-bit task state segment. The CPU saves the outgoing task into the current one on a hardware task switch
+    // and loads the registers of the incoming one, e.g. when an interrupt goes through a task gate.
+    struct TaskStateSegment
+    {
+        myos::common::uint16_t previousTaskLink, reserved0;
+        myos::common::uint32_t esp0;
+        myos::common::uint16_t ss0, reserved1;
+        myos::common::uint32_t esp1;
+        myos::common::uint16_t ss1, reserved2;
+        myos::common::uint32_t esp2;
+        myos::common::uint16_t ss2, reserved3;
+        myos::common::uint32_t cr3;
+        myos::common::uint32_t eip;
+        myos::common::uint32_t eflags;
+        myos::common::uint32_t eax, ecx, edx, ebx;
+        myos::common::uint32_t esp, ebp, esi, edi;
+        myos::common::uint16_t es, reserved4;
+        myos::common::uint16_t cs, reserved5;
+        myos::common::uint16_t ss, reserved6;
+        myos::common::uint16_t ds, reserved7;
+        myos::common::uint16_t fs, reserved8;
+        myos::common::uint16_t gs, reserved9;
+        myos::common::uint16_t ldt, reserved10;
+        myos::common::uint16_t trap;
+        myos::common::uint16_t ioMapBase;
+    } __attribute__((packed));
+    
     class GlobalDescriptorTable
     {
         public:
@@ -32,6 +61,7 @@ namespace myos
             SegmentDescriptor unusedSegmentSelector;
             SegmentDescriptor codeSegmentSelector;
             SegmentDescriptor dataSegmentSelector;
+            SegmentDescriptor taskStateSegmentSelectors[MAX_TASK_STATE_SEGMENTS];
             
             
         public:
@@ -49,6 +79,9 @@ namespace myos
             myos::common::uint16_t CodeSegmentSelector();
             myos::common::uint16_t DataSegmentSelector();
             
+            // Puts the descriptor of the given task state segment to the index'th slot and returns its selector
+            myos::common::uint16_t SetTaskStateSegment(int index, TaskStateSegment* taskStateSegment);
+            
             /*
             ///////////////////////////////////////////////// TODO: YENI EKLENDI
             myos::common::uint16_t GetProcessCodeSegmentSelector(int processId);
@@ -0,0 +1,43 @@
+#ifndef __MYOS__HARDWARECOMMUNICATION__APIC_H
+#define __MYOS__HARDWARECOMMUNICATION__APIC_H
+
+#include <common/types.h>
+
+namespace myos
+{
+    namespace hardwarecommunication
+    {
+
+        // The local APIC of the CPU which accesses it. Every CPU sees its own local APIC at the same (identity mapped) address.
+        class LocalApic
+        {
+        protected:
+            static volatile myos::common::uint32_t* registers;
+            
+            static myos::common::uint32_t Read(myos::common::uint32_t offset);
+            static void Write(myos::common::uint32_t offset, myos::common::uint32_t value);
+            static void SendInterProcessorInterrupt(myos::common::uint8_t apicId, myos::common::uint32_t command);
+
+        public:
+            static const myos::common::uint32_t DEFAULT_BASE = 0xFEE00000;
+            
+            static void SetBase(myos::common::uint32_t base);
+            
+            static myos::common::uint8_t Id();
+            
+            // Enables the local APIC of this CPU, spurious interrupts are delivered to the given vector
+            static void Enable(myos::common::uint8_t spuriousVector);
+            static void EndOfInterrupt();
+            
+            static void SendInit(myos::common::uint8_t apicId);
+            static void SendStartup(myos::common::uint8_t apicId, myos::common::uint8_t vector); // Starts at vector * 4 KiB in real mode
+            
+            // Counts of the timer (divided by 16) in the given time, measured with the programmable interval timer
+            static myos::common::uint32_t MeasureTimer(myos::common::uint32_t microseconds);
+            static void StartPeriodicTimer(myos::common::uint8_t vector, myos::common::uint32_t initialCount);
+        };
+
+    }
+}
+
+#endif
@@ -81,6 +81,7 @@ namespace myos
                 static void HandleInterruptRequest0x0D();
                 static void HandleInterruptRequest0x0E();
                 static void HandleInterruptRequest0x0F();
+                static void HandleInterruptRequest0x10();
                 static void HandleInterruptRequest0x31();
 
                 static void HandleInterruptRequest0x80();
@@ -120,8 +121,14 @@ namespace myos
                 InterruptManager(myos::common::uint16_t hardwareInterruptOffset, myos::GlobalDescriptorTable* globalDescriptorTable, myos::TaskManager* taskManager);
                 ~InterruptManager();
                 myos::common::uint16_t HardwareInterruptOffset();
+                void SetTaskGate(myos::common::uint8_t interrupt, myos::common::uint16_t taskStateSegmentSelector);
                 void Activate();
                 void Deactivate();
+                
+                // For the application processors, which share the interrupt descriptor table of the bootstrap processor
+                static void LoadInterruptDescriptorTable();
+                static bool IsActive();
+                static myos::common::uint16_t ActiveHardwareInterruptOffset();
         };
         
     }
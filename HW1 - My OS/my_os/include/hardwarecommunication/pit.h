@@ -0,0 +1,41 @@
+#ifndef __MYOS__HARDWARECOMMUNICATION__PIT_H
+#define __MYOS__HARDWARECOMMUNICATION__PIT_H
+
+#include <common/types.h>
+#include <hardwarecommunication/port.h>
+
+namespace myos
+{
+    namespace hardwarecommunication
+    {
+
+        // Channel 0 of the 8253/8254 programmable interval timer, which raises IRQ0.
+        // The BIOS leaves it at the slowest rate (about 18.2 Hz) if it is never programmed.
+        // Channel 2 is used for short busy waits without interrupts.
+        class ProgrammableIntervalTimer
+        {
+        protected:
+            Port8Bit channel0DataPort;
+            Port8Bit channel2DataPort;
+            Port8Bit commandPort;
+            Port8Bit channel2GatePort; // Bit 0 gates channel 2, bit 1 enables the speaker, bit 5 is the output of channel 2
+            myos::common::uint32_t frequency;
+
+        public:
+            static const myos::common::uint32_t BASE_FREQUENCY = 1193182; // Input clock of the timer in Hz
+
+            ProgrammableIntervalTimer();
+            ~ProgrammableIntervalTimer();
+
+            // Makes IRQ0 fire at the closest rate the divisor can give, and returns that rate in Hz
+            myos::common::uint32_t SetFrequency(myos::common::uint32_t hz);
+            myos::common::uint32_t GetFrequency();
+            
+            // Busy waits for at least the given time, channel 0 and IRQ0 are not affected
+            void Wait(myos::common::uint32_t microseconds);
+        };
+
+    }
+}
+
+#endif
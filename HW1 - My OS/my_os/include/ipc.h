@@ -0,0 +1,76 @@
+#ifndef __MYOS__IPC_H
+#define __MYOS__IPC_H
+
+#include <common/types.h>
+#include <synchronization.h>
+
+namespace myos
+{
+    
+    const common::uint32_t MAX_NUM_PIPES = 16;
+    const common::uint32_t PIPE_BUFFER_SIZE = 4096;
+    const common::uint32_t MAX_NUM_DESCRIPTORS = 16; // Open pipe ends of one task
+    
+    const common::uint32_t MAX_NUM_MESSAGE_QUEUES = 16;
+    const common::uint32_t MESSAGE_QUEUE_BUFFER_SIZE = 4096;
+    const common::uint32_t MAX_MESSAGE_SIZE = 256;
+    
+    // Fixed size byte FIFO. Reads and writes copy as much as fits and return the number of bytes copied.
+    class RingBuffer
+    {
+    private:
+        common::uint8_t* data;
+        common::uint32_t size;
+        common::uint32_t head; // Next byte to read
+        common::uint32_t used;
+        
+    public:
+        RingBuffer(common::uint8_t* data, common::uint32_t size);
+        
+        void Clear();
+        common::uint32_t Write(const common::uint8_t* source, common::uint32_t length);
+        common::uint32_t Read(common::uint8_t* destination, common::uint32_t length);
+        common::uint32_t Peek(common::uint8_t* destination, common::uint32_t length); // Read without removing
+        
+        common::uint32_t Used();
+        common::uint32_t Free();
+    };
+    
+    
+    // One way byte stream between tasks. A descriptor of a task refers to the read or the write end of a pipe,
+    // and the pipe counts the descriptors of each end to detect the end of the stream.
+    class Pipe
+    {
+    friend class TaskManager;
+    private:
+        common::uint8_t data[PIPE_BUFFER_SIZE];
+        RingBuffer buffer;
+        common::uint32_t numReaders; // Open read descriptors
+        common::uint32_t numWriters;
+        WaitQueue readers; // Blocked in read until there is data
+        WaitQueue writers; // Blocked in write until the rest of their data fits
+        
+    public:
+        Pipe();
+    };
+    
+    
+    // Messages keep their boundaries, each one is stored with its length in front
+    class MessageQueue
+    {
+    friend class TaskManager;
+    private:
+        bool used;
+        common::uint8_t data[MESSAGE_QUEUE_BUFFER_SIZE];
+        RingBuffer buffer;
+        common::uint32_t numMessages;
+        WaitQueue receivers;
+        WaitQueue senders;
+        
+    public:
+        MessageQueue();
+    };
+    
+}
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef __MYOS__KERNELDATA_H
+#define __MYOS__KERNELDATA_H
+
+#include <common/types.h>
+#include <paging.h>
+#include <smp.h>
+
+namespace myos
+{
+    
+    // A page the kernel keeps up to date and tasks read without a system call, like the vDSO data page of linux.
+    // It is mapped read-only at KERNEL_DATA_ADDRESS, right above the stack area, and the kernel writes it through
+    // the identity mapped address of its frame.
+    const common::uint32_t KERNEL_DATA_ADDRESS = STACK_AREA_BASE + STACK_AREA_SIZE;
+    
+    // The running task of one CPU. switches is odd while the kernel changes the entry and grows on every change,
+    // so a reader which sees the same even value before and after has read one task.
+    struct KernelDataProcessor
+    {
+        volatile common::uint32_t switches;
+        volatile common::int32_t pid;
+        volatile common::int32_t forkPid;
+        common::uint32_t reserved;
+    };
+    
+    struct KernelData
+    {
+        volatile common::uint32_t ticks;
+        volatile common::uint32_t milliseconds; // Since the timer was programmed
+        volatile common::uint32_t timerFrequency;
+        common::uint32_t reserved;
+        KernelDataProcessor processors[MAX_NUM_CPUS];
+    };
+    
+}
+
+#endif
@@ -3,25 +3,129 @@
 #define __MYOS__MEMORYMANAGEMENT_H
 
 #include <common/types.h>
+#include <buddyallocator.h>
+
+
+// Uncomment to use the old first-fit chunk list as the kernel heap instead of TLSF, for comparison
+// #define FIRSTFIT_HEAP
+
+// Uncomment to record the caller of every allocation in its header, so the heap statistics show who holds the memory
+// #define HEAP_CALL_SITES
 
 
 namespace myos
 {
     
+    const common::uint32_t HEAP_NUM_SIZE_CLASSES = 16; // Class i counts blocks of up to 16 << i bytes, the last one all bigger blocks
+    const common::uint32_t HEAP_MAX_CALL_SITES = 8;
+    
+    struct HeapCallSite
+    {
+        common::uint32_t address; // Return address of the call to malloc or new
+        common::uint32_t allocations;
+        common::uint32_t bytes;
+    };
+    
+    struct HeapStatistics
+    {
+        // Counted by malloc and free
+        common::uint32_t regions;
+        common::uint32_t heapBytes; // Of all regions together
+        common::uint32_t mallocs;
+        common::uint32_t frees;
+        common::uint32_t failures; // Mallocs which returned 0
+        common::uint32_t liveAllocations;
+        common::uint32_t bytesInUse; // Data bytes of the allocated blocks, without their headers
+        common::uint32_t peakBytesInUse;
+        common::uint32_t liveAllocationsBySize[HEAP_NUM_SIZE_CLASSES];
+        
+        // Found by walking over all blocks
+        common::uint32_t freeBlocks;
+        common::uint32_t freeBytes;
+        common::uint32_t largestFreeBlock;
+        common::uint32_t fragmentation; // Percent of the free bytes which are not in the largest free block
+        common::uint32_t corruptBlocks; // Headers which do not match their neighbours, the walk stops at the first one of a region
+        common::uint32_t numCallSites; // With HEAP_CALL_SITES, the callers with the most live bytes first
+        HeapCallSite callSites[HEAP_MAX_CALL_SITES];
+    };
+    
+#ifdef FIRSTFIT_HEAP
+    
     struct MemoryChunk
     {
         MemoryChunk *next;
         MemoryChunk *prev;
         bool allocated;
         common::size_t size;
+#ifdef HEAP_CALL_SITES
+        common::uint32_t callSite;
+#endif
+    };
+    
+#else
+    
+    // Header of a block of the TLSF heap, the data follows the fields before nextFree.
+    // The sizes are multiples of 8, so the lowest bit of size marks a free block.
+    struct MemoryBlock
+    {
+        common::size_t size; // Bytes of data after the header, 0 for the empty used block at the end of a region
+        MemoryBlock* prevPhysical; // The block right before it in memory, 0 for the first one
+#ifdef HEAP_CALL_SITES
+        common::uint32_t callSite;
+        common::uint32_t reserved; // Keeps the data 8 byte aligned
+#endif
+        
+        // Only in free blocks, in the place of the data. The block at the end of a region keeps the first block of the
+        // next region in nextFree.
+        MemoryBlock* nextFree;
+        MemoryBlock* prevFree;
     };
     
+#ifdef HEAP_CALL_SITES
+    const common::size_t HEAP_BLOCK_HEADER_SIZE = 16;
+#else
+    const common::size_t HEAP_BLOCK_HEADER_SIZE = 8;
+#endif
+    const common::size_t HEAP_ALIGNMENT = 8;
+    const common::size_t HEAP_MIN_BLOCK_SIZE = 8; // Room for the free list links
+    const common::size_t HEAP_MAX_ALLOCATION = 0x80000000;
+    
+    // The first level of the free lists is the power of two of the block size, and the second level splits it into
+    // 16 equal ranges. Blocks below 128 bytes are all in the first level 0, in steps of 8 bytes.
+    const common::uint32_t HEAP_SECOND_LEVEL_LOG2 = 4;
+    const common::uint32_t HEAP_NUM_SECOND_LEVELS = 1 << HEAP_SECOND_LEVEL_LOG2;
+    const common::uint32_t HEAP_FIRST_LEVEL_SHIFT = 7;
+    const common::uint32_t HEAP_NUM_FIRST_LEVELS = 32 - HEAP_FIRST_LEVEL_SHIFT + 1;
+    
+#endif
+    
     
+    // The kernel heap. By default it is a two-level segregated fit (TLSF) allocator, which finds a free block with
+    // two bitmap scans and merges freed blocks with their neighbours right away, so malloc and free take constant time.
     class MemoryManager
     {
         
     protected:
+        BuddyAllocator* buddyAllocator;
+        HeapStatistics statistics;
+        bool Grow(common::size_t size);
+        void CountMalloc(common::size_t size);
+        void CountFree(common::size_t size);
+        static void CountCallSite(HeapCallSite* callSites, common::uint32_t* numCallSites, common::uint32_t maxCallSites, common::uint32_t address, common::size_t size);
+        
+#ifdef FIRSTFIT_HEAP
         MemoryChunk* first;
+#else
+        MemoryBlock* firstRegion;
+
+        common::uint32_t firstLevelBitmap;
+        common::uint32_t secondLevelBitmaps[HEAP_NUM_FIRST_LEVELS];
+        MemoryBlock* freeLists[HEAP_NUM_FIRST_LEVELS][HEAP_NUM_SECOND_LEVELS];
+        
+        void InsertFreeBlock(MemoryBlock* block);
+        void RemoveFreeBlock(MemoryBlock* block);
+        MemoryBlock* FindFreeBlock(common::size_t size);
+#endif
     public:
         
         static MemoryManager *activeMemoryManager;
@@ -29,8 +133,18 @@ namespace myos
         MemoryManager(common::size_t first, common::size_t size);
         ~MemoryManager();
         
-        void* malloc(common::size_t size);
+        // Adds memory anywhere to the heap, blocks are never merged across the ends of a region
+        void AddRegion(common::size_t start, common::size_t size);
+        
+        // When the heap is full, it takes a block of up to 4 MiB from the buddy allocator as a new region
+        void SetBuddyAllocator(BuddyAllocator* buddyAllocator);
+        
+        // callSite is recorded with HEAP_CALL_SITES, 0 takes the caller of malloc
+        void* malloc(common::size_t size, common::uint32_t callSite = 0);
         void free(void* ptr);
+        
+        // Copies the counters and walks the heap for the rest, which takes time linear in the number of blocks
+        void GetStatistics(HeapStatistics* statistics);
     };
 }
 
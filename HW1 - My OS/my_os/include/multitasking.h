@@ -4,17 +4,50 @@
 
 #include <common/types.h>
 #include <gdt.h>
+#include <paging.h>
+#include <smp.h>
+#include <synchronization.h>
+#include <ipc.h>
+#include <stackpool.h>
+#include <kerneldata.h>
 
 namespace myos
 {
-    const common::uint32_t MAX_STACK_SIZE = 4096;
     const common::uint32_t MAX_NUM_TASKS = 256;
+    const common::uint32_t NUM_READY_LEVELS = 32; // One bit per level in the ready bitmap, level 0 is dispatched first
+    
+    const common::uint32_t IDLE_STACK_SIZE = 1024;
+    
+    // Sleeping tasks wait in a timer wheel of TIMER_WHEEL_LEVELS levels with 2^TIMER_WHEEL_SLOT_BITS slots each.
+    // A slot of level i covers 2^(i * TIMER_WHEEL_SLOT_BITS) ticks, so 4 levels of 64 slots cover 2^24 ticks.
+    const common::uint32_t TIMER_WHEEL_LEVELS = 4;
+    const common::uint32_t TIMER_WHEEL_SLOT_BITS = 6;
+    const common::uint32_t TIMER_WHEEL_SLOTS = 1 << TIMER_WHEEL_SLOT_BITS;
+    
+    const common::uint32_t MLFQ_NUM_LEVELS = 4;
+    const common::uint32_t MLFQ_QUANTA[MLFQ_NUM_LEVELS] = {1, 2, 4, 8}; // Time slice of each level in quanta of the task
+    const common::uint32_t MLFQ_BOOST_PERIOD = 50; // Every task is moved back to the top level after this many time slices
+    
+    // A stride task's pass grows by STRIDE_ONE / tickets every tick it runs, and the lowest pass runs next,
+    // so the CPU time of the tasks is proportional to their tickets
+    const common::uint32_t STRIDE_ONE = 1 << 20;
+    const common::uint32_t STRIDE_DEFAULT_TICKETS = 100;
+    const common::uint32_t STRIDE_MAX_TICKETS = 1 << 16;
+    
+    // Real-time tasks run earliest deadline first before all other tasks. A CPU admits a real-time task only while the
+    // sum of budget / period of its real-time tasks stays within REALTIME_UTILIZATION_LIMIT percent.
+    const common::uint32_t REALTIME_UTILIZATION_LIMIT = 95;
+    const common::uint32_t REALTIME_UTILIZATION_ONE = 1 << 16; // Utilization 1.0 in fixed point
+    const common::uint32_t REALTIME_MAX_PERIOD = 0xFFFF; // In ticks
+    
+    const common::uint32_t FPU_STATE_SIZE = 512; // FXSAVE area of the x87 and SSE registers
     
     typedef enum { High, Medium, Low } Priority; // The highest priority has the minimum value
     typedef enum { Ready, Running, Blocked, Terminated } State;
     
-    typedef enum { RoundRobin, PreemptivePriority } SchedulerType;
+    typedef enum { RoundRobin, PreemptivePriority, MultilevelFeedbackQueue, Stride } SchedulerType;
     typedef enum { LifeCycleA, LifeCycleB1, LifeCycleB2, LifeCycleB3, LifeCycleB4 } LifeCycleType;
+    typedef enum { OrderByLevel, OrderByPass, OrderByDeadline } ReadyQueueOrder;
     typedef enum { PrintEverySwitch, PrintEveryTimeInterrupt, PrintOnlyTermination, DoNotPrint } ProcessTablePrintType;
     
     class Helper {
@@ -27,6 +60,42 @@ namespace myos
     
     class Task;
     
+    // Scheduling metrics of a task. Times are time stamp counter cycles, ticks are timer interrupts.
+    // Response time is firstRun - created, turnaround time is exit - created.
+    struct TaskStatistics
+    {
+        common::uint64_t createdTime;
+        common::uint64_t firstRunTime; // 0 if the task has not run yet
+        common::uint64_t exitTime; // 0 if the task has not terminated yet
+        common::uint64_t waitTime; // Time spent ready in the ready queue
+        common::uint64_t cpuTime; // Time spent running
+        
+        common::uint32_t createdTick;
+        common::uint32_t firstRunTick;
+        common::uint32_t exitTick;
+        common::uint32_t waitTicks;
+        common::uint32_t cpuTicks; // Timer interrupts which found the task running
+        
+        common::uint32_t voluntarySwitches; // Left the CPU by blocking, sleeping or exiting
+        common::uint32_t involuntarySwitches; // Preempted by the scheduler
+        
+        common::uint32_t completedJobs; // Periods of a real-time task ended with sysyield
+        common::uint32_t deadlineMisses; // Jobs which completed after their deadline or used up their budget
+    } __attribute__((packed));
+    
+    // Special pid arguments of TaskManager::GetStatistics
+    const common::int32_t TASK_STATISTICS_SELF = -1;
+    const common::int32_t TASK_STATISTICS_LAST_CHILD = -2; // The child the task has taken in waitpid last
+    
+    // One child of TaskManager::SpawnBatch, pid is filled in with the pid of the child or -1
+    struct SpawnRequest
+    {
+        void (*entrypoint)();
+        common::uint32_t priority;
+        common::uint32_t stackSize; // 0 for the stack size of the parent
+        common::int32_t pid;
+    };
+    
     struct CPUState
     {
         /* Pushed by interruptstubs.s */
@@ -62,14 +131,19 @@ namespace myos
     class Task
     {
     friend class TaskManager;
+    friend class ReadyQueue;
+    friend class TimerWheel;
+    friend class WaitQueue;
     private:
-        common::uint8_t stack[MAX_STACK_SIZE]; // 4 KiB
+        common::uint8_t* stack; // Demand paged, only the pages the task touches use memory. Null while the slot is free.
+        common::uint32_t stackSize;
         CPUState* cpustate;
         
         common::int32_t pid;
         common::int32_t ppid;
         
-        Priority priority;
+        Priority priority; // Raised above basePriority while a higher priority task waits for a mutex the task holds
+        Priority basePriority;
         State state;
         
         bool waitingChild; // Indicates if this task is waiting any child 
@@ -80,14 +154,89 @@ namespace myos
         //common::int32_t forkPid;
         common::int32_t arrivalOrder;
         
+        // Intrusive links of the ready queue level this task is waiting in
+        Task* nextReady;
+        Task* prevReady;
+        common::uint32_t readyLevel;
+        bool inReadyQueue;
+        common::uint32_t levelSinceTick; // When the task entered its ready queue level, for aging
+        
+        common::uint32_t mlfqLevel; // Current level in multilevel feedback queue
+        
+        // Share of the task in stride scheduling, and its index in the pass ordered ready queue
+        common::uint32_t tickets;
+        common::uint32_t stride;
+        common::uint64_t pass;
+        common::uint32_t heapIndex;
+        
+        // Real-time parameters in ticks and the current job, which runs from releaseTick until absoluteDeadline
+        bool realTime;
+        common::uint32_t period;
+        common::uint32_t budget;
+        common::uint32_t relativeDeadline;
+        common::uint32_t utilization; // budget / period in fixed point
+        common::uint32_t releaseTick;
+        common::uint32_t absoluteDeadline;
+        common::uint32_t budgetLeft;
+        
+        // Link of the timer wheel slot this task sleeps in
+        Task* nextTimer;
+        common::uint32_t wakeTick;
+        
+        TaskStatistics statistics;
+        TaskStatistics lastChildStatistics;
+        common::uint64_t readySince; // When the task was put into the ready queue
+        common::uint64_t runningSince; // When the task was dispatched
+        common::uint32_t readySinceTick;
+        bool onCpu;
+        
+        common::uint32_t quantum; // Time slice in timer ticks, 0 to use the quantum of the priority
+        common::uint32_t sliceTicks; // Timer ticks used from the current time slice
+        
+        common::uint32_t cpu; // Index of the CPU which runs the task or whose ready queue it waits in
+        
+        // Link of the wait queue of the mutex, semaphore or condition variable the task is blocked on
+        Task* nextWaiting;
+        Task* prevWaiting;
+        WaitQueue* waitQueue;
+        common::uint32_t waitLevel;
+        Mutex* waitingMutex; // The mutex the task waits for, or has to take again after a condition variable wait
+        Mutex* heldMutexes;
+        
+        // Saved x87 and SSE registers, 16 bytes into the area are aligned for FXSAVE. Only valid if the task has used them
+        // and no CPU holds them in its registers.
+        common::uint8_t fpuArea[FPU_STATE_SIZE + 15];
+        bool usesFpu;
+        
+        // Open pipe ends, pipe index * 2 + 0 for the read end and + 1 for the write end, -1 if the descriptor is free
+        common::int32_t descriptors[MAX_NUM_DESCRIPTORS];
+        
+        // Transfer of a task blocked in a pipe or message queue
+        common::uint8_t* ipcBuffer;
+        common::uint32_t ipcLength; // Bytes left to write or send, or the space left to read into
+        common::uint32_t ipcDone; // Bytes written before blocking
+        
+        // Children which are not reaped yet, and the terminated ones among them in termination order
+        Task* parent;
+        Task* firstChild;
+        Task* nextSibling;
+        Task* prevSibling;
+        Task* zombieHead;
+        Task* zombieTail;
+        Task* nextZombie;
+        Task* prevZombie;
+        int numChildren;
+        
+        bool slotUsed; // False if the task slot is in the free list of TaskManager
+        common::uint32_t slotGeneration; // Incremented on every reuse of the slot to generate a new pid
+        Task* nextFree;
+        
     public:
          common::int32_t forkPid;
         
         Task();
-        Task(GlobalDescriptorTable *gdt, void entrypoint());
-        Task(const Task& task);
         ~Task();
-        void Copy(const Task* oth);
+        bool Copy(const Task* oth);
         void CopyCpuState(CPUState* cpustate);
         void Reset(GlobalDescriptorTable* gdt, void entrypoint());
         
@@ -115,6 +264,99 @@ namespace myos
     };
     
     
+    // Per-level FIFO run queues indexed by a bitmap of non-empty levels.
+    // Enqueue, dequeue and removal are all constant time regardless of the number of tasks.
+    // Ordered by pass for stride scheduling or by deadline for real-time tasks, the queue is a binary heap instead
+    // and the levels are ignored, so the operations take logarithmic time.
+    class ReadyQueue
+    {
+    private:
+        Task* heads[NUM_READY_LEVELS];
+        Task* tails[NUM_READY_LEVELS];
+        common::uint32_t bitmap; // Bit i is set if level i is not empty
+        int length;
+        
+        ReadyQueueOrder order;
+        Task* heap[MAX_NUM_TASKS];
+        bool Before(Task* task, Task* other);
+        void PushHeap(Task* task);
+        void RemoveHeap(Task* task);
+        void SiftUp(common::uint32_t index);
+        void SiftDown(common::uint32_t index);
+        
+    public:
+        ReadyQueue();
+        
+        void SetOrder(ReadyQueueOrder order); // Only while the queue is empty
+        
+        void PushBack(Task* task, common::uint32_t level);
+        void PushFront(Task* task, common::uint32_t level);
+        Task* PopFront();
+        void Remove(Task* task);
+        
+        bool IsEmpty();
+        common::uint32_t HighestLevel(); // NUM_READY_LEVELS if empty
+        int Length();
+        
+        // For iterating the queue in dispatch order
+        Task* First();
+        Task* Next(Task* task);
+        Task* Head(common::uint32_t level); // Longest waiting task of one level, only when ordered by level
+    };
+    
+    
+    // Hierarchical timer wheel of sleeping tasks. Inserting is constant time, and advancing one tick is constant
+    // time apart from moving the tasks of a higher level slot down when the lower level wraps around.
+    class TimerWheel
+    {
+    private:
+        Task* heads[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+        Task* tails[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+        common::uint32_t currentTick; // Tasks which wake before this tick have been returned by Advance already
+        int length;
+        
+        void Place(Task* task);
+        
+    public:
+        TimerWheel();
+        
+        void Insert(Task* task, common::uint32_t wakeTick);
+        
+        // Moves to the next tick and returns the tasks which wake at the passed tick, linked with nextTimer
+        Task* Advance();
+        
+        int Length();
+    };
+    
+    
+    // Scheduling state of one CPU. A CPU runs the tasks of its own ready queue, and takes tasks from the longest
+    // ready queue of the other CPUs when its own one is empty.
+    class Processor
+    {
+    friend class TaskManager;
+    private:
+        Task* currentTask;
+        ReadyQueue readyQueue;
+        ReadyQueue realTimeQueue; // Ordered by deadline, its tasks run before the ones in readyQueue
+        common::uint32_t realTimeUtilization; // Of the real-time tasks admitted to this CPU
+        
+        // Runs when there is nothing to run, it is never in a ready queue or in the task slots
+        Task idleTask;
+        
+        common::uint32_t ticks; // Timer interrupts of this CPU
+        common::uint32_t idleTicks; // Timer interrupts which found the idle task running
+        common::uint64_t pass; // Pass of the stride task dispatched last, tasks which become ready start from here
+        bool online;
+        
+        // The task whose x87 and SSE registers this CPU holds, and if CR0.TS is set so that other tasks trap on their use
+        Task* fpuOwner;
+        bool fpuTrapArmed;
+        
+    public:
+        Processor();
+    };
+    
+    
     class TaskManager
     {
     private:      
@@ -123,16 +365,91 @@ namespace myos
         ProcessTablePrintType processTablePrintType;
         
         Task tasks[MAX_NUM_TASKS];
-        int currentTask;
-        int numTasks;
+        int numTasks; // Number of used slots (alive and not reaped terminated tasks)
+        int numSlots; // Slots below this index have been used at least once
         int nextArrivalOrder;
         
+        // Reaped slots waiting for reuse in the order they are freed
+        Task* freeSlotsHead;
+        Task* freeSlotsTail;
+        Task* lastAddedTask;
+        
+        common::uint32_t quanta[3]; // Time slice of each priority in timer ticks
+        common::uint32_t ticks; // Timer interrupts of the bootstrap processor since the scheduler started
+        common::uint32_t timerFrequency; // Timer interrupts per second
+        
+        // The page tasks read the time and their pids from, 0 if there is none
+        KernelData* kernelData;
+        common::uint32_t millisecondRemainder; // Of ticks * 1000 / timerFrequency
+        void PublishRunningTask(Processor* processor, Task* task);
+        
+        TimerWheel sleepingTasks;
+        void WakeSleepingTasks();
+        
+        Processor processors[MAX_NUM_CPUS];
+        common::uint32_t numProcessors; // Processors below this index are started
+        Processor* CurrentProcessor();
+        Processor* LeastLoadedProcessor();
+        Processor* BusiestProcessor(Processor* except);
+        bool HasReadyTask(Processor* processor);
+        Task* StealTask(Processor* thief);
+        
+        // The stack of the task which exited last is trimmed only once the next task exits, since it runs on it until the switch
+        StackPool stackPool;
+        common::uint8_t* exitedStack;
+        common::uint32_t exitedStackSize;
+        bool AllocateStack(Task* task, common::uint32_t size);
+        void FreeStack(Task* task);
+        
+        static common::uint8_t idleStacks[MAX_NUM_CPUS][IDLE_STACK_SIZE];
+        static void Idle();
+        void InitializeProcessor(common::uint32_t cpu);
+        bool IsIdleTask(Task* task);
+        
+        void StartRunning(Task* task);
+        void StopRunning(Task* task);
+        
+        int slicesSinceBoost;
+        
+        // In preemptive priority, a ready task moves one level up for every agingTicks ticks it waits
+        common::uint32_t agingTicks;
+        void AgeReadyTasks(Processor* processor);
+        
+        // Lazy switching of the x87 and SSE registers, a task whose registers a CPU holds stays on that CPU
+        bool lazyFpu;
+        static common::uint8_t* FpuState(Task* task);
+        void SwitchFpu(Processor* processor, Task* oldTask, Task* task);
+        void ReleaseFpu(Task* task, bool save);
+        
         int interruptNumAfterCollatz;
         Task* collatzTask;
         Task* blockedTaskForCollatz;
         
-        Task* readyQueue[MAX_NUM_TASKS];
-        int queueLen;
+        Mutex mutexes[MAX_NUM_MUTEXES];
+        Semaphore semaphores[MAX_NUM_SEMAPHORES];
+        ConditionVariable conditionVariables[MAX_NUM_CONDITION_VARIABLES];
+        Mutex* FindMutex(common::int32_t id);
+        Semaphore* FindSemaphore(common::int32_t id);
+        ConditionVariable* FindConditionVariable(common::int32_t id);
+        
+        void Block(WaitQueue* waitQueue, CPUState* cpustate);
+        void WakeWaiter(Task* task, common::uint32_t result);
+        void GiveMutex(Mutex* mutex, Task* task);
+        void ReleaseMutex(Mutex* mutex);
+        void ReleaseMutexes(Task* task);
+        void RetakeMutex(Task* task);
+        Priority InheritedPriority(Task* task);
+        void UpdateInheritedPriority(Task* task);
+        
+        Pipe pipes[MAX_NUM_PIPES];
+        MessageQueue messageQueues[MAX_NUM_MESSAGE_QUEUES];
+        Pipe* FindPipe(common::int32_t descriptor, common::uint32_t end);
+        MessageQueue* FindMessageQueue(common::int32_t id);
+        void PumpPipe(Pipe* pipe);
+        void PumpMessageQueue(MessageQueue* messageQueue);
+        void CloseDescriptor(Task* task, common::int32_t descriptor);
+        void CloseDescriptors(Task* task);
+        void DuplicateDescriptors(Task* parent, Task* child);
         
         bool ignoreSchedule;
         bool useDelayInPrintingProcessTable;
@@ -142,27 +459,69 @@ namespace myos
         void PrintProcessInfo(Task* task);
         void PrintProcessTable();
         
+        Task* AllocateTaskSlot();
+        void ReleaseTask(Task* task);
+        void OrphanChildren(Task* parent);
+        void LinkChild(Task* parent, Task* child);
+        void UnlinkChild(Task* child);
+        void PushZombie(Task* child);
+        void RemoveZombie(Task* child);
+        void ReapChild(Task* child);
+        Task* FindTask(common::int32_t pid);
+        void InitializeTask(Task* task, Priority priority, common::int32_t ppid);
+        
         CPUState* RoundRobinSchedule();
         CPUState* PreemptivePrioritySchedule(); 
+        CPUState* MultilevelFeedbackQueueSchedule();
+        CPUState* StrideSchedule();
+        CPUState* DispatchNextTask();
+        
+        common::uint32_t TimeSlice(Task* task);
+        bool ContinueTimeSlice(Task* task);
+        void BoostMultilevelFeedbackQueue();
         
         void AddToReadyQueue(Task* task);
         void AddToReadyQueueRoundRobin(Task* task);
         void AddToReadyQueuePreemptivePriority(Task* task);
-        Task* PopFromReadyQueue();
+        void AddToReadyQueueMultilevelFeedbackQueue(Task* task);
+        void AddToReadyQueueStride(Task* task);
+        ReadyQueue* ReadyQueueOf(Task* task);
+        
+        common::uint32_t MillisecondsToTicks(common::uint32_t milliseconds);
+        Processor* AdmitRealTimeTask(Task* task, common::uint32_t utilization);
+        bool ReleaseNextJob(Task* task);
+        void ReturnToReadyQueue(Task* task);
+        Task* PopFromReadyQueue(Processor* processor);
         
     public:
         TaskManager(GlobalDescriptorTable* gdt, SchedulerType schedulerType, LifeCycleType lifeCycleType, ProcessTablePrintType processTablePrintType, bool useDelayInPrintingProcessTable);
         ~TaskManager();
         Task* AddTask(Task* newTask, Priority priority, common::int32_t ppid);
+        Task* AddTask(void entrypoint(), Priority priority, common::int32_t ppid, common::uint32_t stackSize = DEFAULT_STACK_SIZE);
         void CollatzAdded();
         CPUState* Schedule(CPUState* cpustate);
         CPUState* Schedule();
         
         void Fork(CPUState* cpustate);
         common::uint32_t Execve(void (*entrypoint)());
+        
+        // Fork followed by execve in one step: the child starts at entrypoint on a fresh stack with the given priority,
+        // the stack of the parent is not copied. The stack is rounded up to a size class of the StackPool, 0 takes the
+        // size of the parent's stack. Returns the pid of the child, or -1 also if stackSize is above MAX_STACK_SIZE.
+        common::int32_t Spawn(void (*entrypoint)(), common::uint32_t priority, common::uint32_t stackSize = 0);
+        // Spawns the children one after the other and stops at the first failure. Returns the number of children spawned.
+        common::uint32_t SpawnBatch(SpawnRequest* requests, common::uint32_t count);
         common::uint32_t Waitpid(common::uint32_t pid, CPUState* cpustate);
         common::uint32_t Exit();
         common::uint32_t BlockForCollatz(CPUState* cpustate);
+        common::uint32_t Sleep(common::uint32_t milliseconds, CPUState* cpustate);
+        
+        // Makes the running task a periodic real-time task, or a normal task again with period 0. Times are in milliseconds,
+        // with budget <= deadline <= period. Returns -1 if no CPU has enough utilization left for it.
+        common::int32_t SetRealTime(common::uint32_t period, common::uint32_t budget, common::uint32_t deadline);
+        
+        // Ends the current job of a real-time task and waits for the next period. Other tasks go to the end of the ready queue.
+        common::uint32_t Yield(CPUState* cpustate);
         void RemoveFromReadyQueue(int pid);
         
         Task* GetCurrentTask();
@@ -170,6 +529,59 @@ namespace myos
         void SetIgnoreSchedule(bool ignoreSchedule);
         
         void SetLastTaskPriority(common::uint32_t priority);
+        void SetLastTaskTickets(common::uint32_t tickets);
+        bool SetTaskTickets(common::int32_t pid, common::uint32_t tickets); // 1 to STRIDE_MAX_TICKETS
+        
+        void SetTimerFrequency(common::uint32_t hz);
+        void SetKernelData(KernelData* kernelData);
+        void SetQuantum(Priority priority, common::uint32_t ticks);
+        void SetAgingTicks(common::uint32_t ticks); // 0 turns aging off
+        
+        void EnableLazyFpu();
+        void HandleFpuTrap(); // Device not available, the running task uses the x87 or SSE registers
+        bool SetTaskQuantum(common::int32_t pid, common::uint32_t ticks);
+        common::uint32_t GetTicks();
+        common::uint32_t GetIdleTicks(); // Of all CPUs together
+        
+        // Called on an application processor once it is running, before it takes its first timer interrupt
+        void StartProcessor(common::uint32_t cpu);
+        common::uint32_t NumProcessors();
+        
+        bool GetStatistics(common::int32_t pid, TaskStatistics* statistics);
+        
+        // Mutexes, semaphores and condition variables are identified by their index in the tables of the task manager.
+        // The operations return 0 (or the new id) on success and -1 on failure. The blocking ones return the esp to switch to,
+        // and the result is put into eax of the task when it continues.
+        common::int32_t CreateMutex();
+        common::uint32_t LockMutex(common::int32_t id, CPUState* cpustate);
+        common::int32_t TryLockMutex(common::int32_t id);
+        common::int32_t UnlockMutex(common::int32_t id);
+        common::int32_t DestroyMutex(common::int32_t id);
+        
+        common::int32_t CreateSemaphore(common::int32_t count);
+        common::uint32_t WaitSemaphore(common::int32_t id, CPUState* cpustate);
+        common::int32_t TryWaitSemaphore(common::int32_t id);
+        common::int32_t PostSemaphore(common::int32_t id);
+        common::int32_t DestroySemaphore(common::int32_t id);
+        
+        common::int32_t CreateConditionVariable();
+        common::uint32_t WaitConditionVariable(common::int32_t id, common::int32_t mutexId, CPUState* cpustate);
+        common::int32_t SignalConditionVariable(common::int32_t id);
+        common::int32_t BroadcastConditionVariable(common::int32_t id);
+        common::int32_t DestroyConditionVariable(common::int32_t id);
+        
+        // Pipes are used through descriptors of the running task, which fork passes on to the child. Read returns
+        // what is in the pipe (0 when it is empty and has no writers), write blocks until all of its data is in the pipe.
+        common::int32_t CreatePipe(common::int32_t* descriptors);
+        common::uint32_t Read(common::int32_t descriptor, common::uint8_t* buffer, common::uint32_t length, CPUState* cpustate);
+        common::uint32_t Write(common::int32_t descriptor, const common::uint8_t* buffer, common::uint32_t length, CPUState* cpustate);
+        common::int32_t Close(common::int32_t descriptor);
+        
+        // Message queues are identified like mutexes. Receive returns the length of the message, or -1 without taking it if it does not fit.
+        common::int32_t CreateMessageQueue();
+        common::uint32_t SendMessage(common::int32_t id, const common::uint8_t* message, common::uint32_t length, CPUState* cpustate);
+        common::uint32_t ReceiveMessage(common::int32_t id, common::uint8_t* buffer, common::uint32_t size, CPUState* cpustate);
+        common::int32_t DestroyMessageQueue(common::int32_t id);
     };
     
 }
@@ -0,0 +1,103 @@
+#ifndef __MYOS__PAGING_H
+#define __MYOS__PAGING_H
+
+#include <common/types.h>
+#include <gdt.h>
+#include <smp.h>
+#include <buddyallocator.h>
+
+namespace myos
+{
+
+    const common::uint32_t PAGE_SIZE = 4096;
+
+    // Task stacks live in this virtual area which is mapped with 4 KiB pages. The rest of the address space is identity mapped with 4 MiB pages.
+    const common::uint32_t STACK_AREA_BASE = 0xD0000000;
+    const common::uint32_t STACK_AREA_SIZE = 64*1024*1024;
+
+
+    // Hands out physical 4 KiB frames of the buddy allocator and counts the references of shared (copy-on-write) frames
+    class PageFrameAllocator
+    {
+    private:
+        BuddyAllocator* buddyAllocator;
+        common::uint32_t numFrames; // Frames from address 0 which have a reference count
+        common::uint16_t* referenceCounts;
+
+    public:
+        PageFrameAllocator(BuddyAllocator* buddyAllocator);
+        ~PageFrameAllocator();
+
+        common::uint32_t AllocateFrame(); // 0 if there is no free frame
+        void Share(common::uint32_t frame);
+        void Release(common::uint32_t frame);
+        common::uint16_t ReferenceCount(common::uint32_t frame);
+        common::uint32_t FreeFrames();
+    };
+
+
+    class PagingManager
+    {
+    private:
+        GlobalDescriptorTable* gdt;
+        PageFrameAllocator* frameAllocator;
+
+        static common::uint32_t pageDirectory[1024];
+        static common::uint32_t stackPageTables[STACK_AREA_SIZE / (4*1024*1024)][1024];
+        static common::uint32_t sharedPageTable[1024]; // The 4 MiB right above the stack area, for pages shared read-only
+
+        // Page faults are handled in their own task with its own stack. The faulting stack may be a read-only
+        // copy-on-write page, and the CPU could not push an interrupt frame onto it.
+        // Every CPU has its own pair of task state segments in its own GDT, at the same selectors.
+        static TaskStateSegment kernelTaskStateSegments[MAX_NUM_CPUS];
+        static TaskStateSegment pageFaultTaskStateSegments[MAX_NUM_CPUS];
+        static common::uint8_t pageFaultStacks[MAX_NUM_CPUS][8192];
+        common::uint16_t pageFaultTaskSelector;
+
+        common::uint32_t* StackPageTableEntry(common::uint32_t address);
+        void SetStackPageTableEntry(common::uint32_t address, common::uint32_t entry);
+
+        // Implemented in interruptstubs.s, runs as the page fault task and calls HandlePageFault
+        static void PageFaultTask();
+        static void HandlePageFault(common::uint32_t error);
+        bool DoHandlePageFault(common::uint32_t address, common::uint32_t error);
+
+    public:
+        static PagingManager* activePagingManager;
+
+        PagingManager(GlobalDescriptorTable* gdt, PageFrameAllocator* frameAllocator);
+        ~PagingManager();
+
+        void Activate();
+        void ActivateProcessor(GlobalDescriptorTable* gdt, common::uint32_t cpu); // Turns on paging on an application processor
+        common::uint16_t PageFaultTaskSegmentSelector();
+        
+        // Invalidates every TLB entry of the CPU which calls it
+        static inline void FlushTlb()
+        {
+            common::uint32_t cr3;
+            asm volatile("mov %%cr3, %0\n mov %0, %%cr3" : "=r" (cr3) : : "memory");
+        }
+
+        // Makes [base, base + size) a demand paged stack and maps its top page. Pages mapped before in the range are released,
+        // apart from a private top page which is kept for the new stack.
+        bool PrepareStack(common::uint32_t base, common::uint32_t size);
+
+        // Makes [base, base + size) a copy of the stack at parentBase. The parent page containing privateFrom is copied
+        // right away, the pages above it are shared copy-on-write and the unused pages below it are not copied at all.
+        bool CloneStack(common::uint32_t base, common::uint32_t parentBase, common::uint32_t size, common::uint32_t privateFrom);
+
+        void ReleaseStack(common::uint32_t base, common::uint32_t size);
+        
+        // Maps a new zeroed frame read-only at address, which is in the 4 MiB above the stack area, and returns the frame
+        // for the kernel to write through, 0 if there is no free frame
+        common::uint32_t MapSharedPage(common::uint32_t address);
+        
+        // Releases the pages of a stack nobody runs on anymore except a private top page, which the next stack in its place can use
+        void TrimStack(common::uint32_t base, common::uint32_t size);
+    };
+
+}
+
+
+#endif
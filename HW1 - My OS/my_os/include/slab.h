@@ -0,0 +1,89 @@
+#ifndef __MYOS__SLAB_H
+#define __MYOS__SLAB_H
+
+#include <common/types.h>
+#include <memorymanagement.h>
+
+namespace myos
+{
+
+    const common::uint32_t CACHE_LINE_SIZE = 64;
+    const common::uint32_t MIN_SLAB_SIZE = 4096;
+    const common::uint32_t MIN_OBJECTS_PER_SLAB = 8; // Slabs of big objects are made bigger until this many fit
+
+    struct ObjectCacheStatistics
+    {
+        common::uint32_t objectSize; // Bytes an object takes in a slab, with its free list link and alignment
+        common::uint32_t objectsPerSlab;
+        common::uint32_t slabs;
+        common::uint32_t objectsInUse;
+        common::uint32_t allocations;
+        common::uint32_t frees;
+        common::uint32_t grows; // Slabs taken from the heap
+        common::uint32_t reaps; // Empty slabs given back to the heap
+        common::uint32_t failures; // Allocations which found the heap full
+    };
+
+    // Header at the start of every slab
+    struct Slab
+    {
+        class ObjectCache* cache;
+        Slab* next;
+        Slab* prev;
+        void* freeList;
+        common::uint32_t objectsInUse;
+    };
+
+    // Hands out objects of one type from slabs taken from the kernel heap, without a heap header per object.
+    // Free objects keep their constructed state: the constructor runs when a slab is taken and the destructor when it
+    // is given back, and allocating and freeing an object pops and pushes it on the free list of its slab.
+    // Like the heap, a cache is not locked, it is used under the kernel lock or while only one CPU runs.
+    class ObjectCache
+    {
+    public:
+        typedef void (*ObjectFunction)(void* object);
+
+    private:
+        const char* name;
+        common::uint32_t linkOffset; // Every object is followed by a link: its slab while it is in use, the next free object otherwise
+        common::uint32_t alignment;
+        common::uint32_t stride;
+        common::uint32_t slabSize;
+        ObjectFunction constructor;
+        ObjectFunction destructor;
+
+        Slab* partialSlabs; // Slabs with objects both in use and free, allocations take them first
+        Slab* fullSlabs;
+        Slab* emptySlabs;
+        ObjectCacheStatistics statistics;
+
+        ObjectCache* nextCache;
+        static ObjectCache* firstCache;
+
+        void*& Link(void* object);
+        void* FirstObject(Slab* slab);
+        Slab* Grow();
+        void Release(Slab* slab);
+        void Move(Slab* slab, Slab** from, Slab** to);
+
+    public:
+        // alignment is a power of two, constructor and destructor may be 0
+        ObjectCache(const char* name, common::uint32_t size, common::uint32_t alignment = CACHE_LINE_SIZE,
+                    ObjectFunction constructor = 0, ObjectFunction destructor = 0);
+        ~ObjectCache(); // The objects must have been freed
+
+        void* Allocate(); // 0 if the heap is full
+        void Free(void* object);
+        void Reap(); // Gives the empty slabs back to the heap
+
+        const char* GetName();
+        void GetStatistics(ObjectCacheStatistics* statistics);
+
+        // All caches, to report their statistics
+        static ObjectCache* First();
+        ObjectCache* Next();
+    };
+
+}
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef __MYOS__SMP_H
+#define __MYOS__SMP_H
+
+#include <common/types.h>
+#include <spinlock.h>
+
+namespace myos
+{
+    
+    const common::uint32_t MAX_NUM_CPUS = 8;
+    const common::uint32_t AP_STACK_SIZE = 16*1024; // Stack of an application processor until it runs its first task
+    
+    class PagingManager;
+    class TaskManager;
+    namespace hardwarecommunication
+    {
+        class ProgrammableIntervalTimer;
+    }
+    
+    
+    // Recursive lock held by a CPU while it runs kernel code (interrupt handlers, system calls and page faults), so the
+    // kernel data is only changed by one CPU at a time. Interrupt handlers run with interrupts disabled, so a CPU holding
+    // it is only interrupted by page faults, which take it again.
+    class KernelLock
+    {
+    private:
+        static Spinlock lock;
+        static volatile common::int32_t owner; // Index of the CPU holding the lock, -1 if it is free
+        static volatile common::int32_t lastOwner;
+        static common::uint32_t depth;
+        
+    public:
+        static void Acquire();
+        static void Release();
+    };
+    
+    
+    // Finds the processors in the MP configuration table of the BIOS and starts the application processors (APs)
+    // with the INIT-SIPI-SIPI sequence. The bootstrap processor (BSP) is CPU 0, the APs are numbered in table order.
+    class MultiprocessorManager
+    {
+    private:
+        static common::uint32_t numCpus; // Started CPUs
+        static common::uint8_t apicIds[MAX_NUM_CPUS];
+        static common::uint8_t cpuIndexOfApicId[256];
+        static volatile common::uint32_t bootingCpu;
+        static volatile bool bootingCpuOnline;
+        static common::uint8_t apStacks[MAX_NUM_CPUS][AP_STACK_SIZE];
+        
+        static PagingManager* paging;
+        static TaskManager* taskManager;
+        static common::uint32_t timerInitialCount; // Local APIC timer count of one timer tick
+        
+        common::uint32_t numFoundCpus;
+        
+        bool FindProcessors();
+        bool StartProcessor(common::uint32_t cpu, hardwarecommunication::ProgrammableIntervalTimer* timer);
+        static void ApplicationProcessorMain();
+        
+    public:
+        MultiprocessorManager(PagingManager* paging, TaskManager* taskManager);
+        ~MultiprocessorManager();
+        
+        // Starts at most maxNumCpus - 1 APs whose timers run at timerFrequency, and returns the number of running CPUs.
+        // The APs start scheduling when the interrupt manager is activated.
+        common::uint32_t StartApplicationProcessors(common::uint32_t maxNumCpus, common::uint32_t timerFrequency);
+        
+        static common::uint32_t NumCpus();
+        static common::uint32_t CurrentCpuIndex(); // 0 until the APs are started
+    };
+    
+}
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef __MYOS__SPINLOCK_H
+#define __MYOS__SPINLOCK_H
+
+#include <common/types.h>
+
+namespace myos
+{
+    
+    // Busy waiting lock for data shared between CPUs. It does not disable interrupts, so it must not be taken
+    // by code which can be interrupted by a handler taking the same lock.
+    class Spinlock
+    {
+    private:
+        volatile common::uint32_t locked;
+        
+    public:
+        Spinlock() { locked = 0; }
+        
+        void Acquire()
+        {
+            while (__sync_lock_test_and_set(&locked, 1)) {
+                // Wait on the cached value instead of locking the bus on every try
+                while (locked) {
+                    asm volatile("pause");
+                }
+            }
+        }
+        
+        bool TryAcquire()
+        {
+            return __sync_lock_test_and_set(&locked, 1) == 0;
+        }
+        
+        void Release()
+        {
+            __sync_lock_release(&locked);
+        }
+        
+        bool IsLocked()
+        {
+            return locked != 0;
+        }
+    };
+    
+}
+
+#endif
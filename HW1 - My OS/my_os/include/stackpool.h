@@ -0,0 +1,47 @@
+#ifndef __MYOS__STACKPOOL_H
+#define __MYOS__STACKPOOL_H
+
+#include <common/types.h>
+#include <paging.h>
+
+namespace myos
+{
+    
+    // A stack takes a region of the stack area whose lowest page is an unmapped guard page. Regions come in
+    // NUM_STACK_SIZE_CLASSES power of two sizes from 8 KiB to 512 KiB, so a stack is 4 KiB to 508 KiB.
+    const common::uint32_t NUM_STACK_SIZE_CLASSES = 7;
+    const common::uint32_t MIN_STACK_REGION_SIZE = 2 * PAGE_SIZE;
+    const common::uint32_t MAX_STACK_SIZE = (MIN_STACK_REGION_SIZE << (NUM_STACK_SIZE_CLASSES - 1)) - PAGE_SIZE;
+    const common::uint32_t DEFAULT_STACK_SIZE = 64*1024 - PAGE_SIZE;
+    
+    // Hands out stack regions from the stack area. Freed stacks are kept in a free list of their size class and
+    // handed out again first, so the area is only carved up further when no stack of the size has been freed.
+    class StackPool
+    {
+    private:
+        common::uint32_t next; // Start of the part of the stack area which has not been handed out yet
+        
+        // Free lists of every size class, linked by the page number of the stack in the area
+        static const common::uint16_t NO_STACK = 0xFFFF;
+        common::uint16_t freeHeads[NUM_STACK_SIZE_CLASSES];
+        common::uint16_t nextFree[STACK_AREA_SIZE / PAGE_SIZE];
+        common::uint32_t numFreeStacks;
+        
+        static common::uint32_t SizeClass(common::uint32_t size); // NUM_STACK_SIZE_CLASSES if it is too large
+        
+    public:
+        StackPool();
+        
+        // The size of the stack Allocate hands out for size, 0 if size is too large
+        static common::uint32_t StackSize(common::uint32_t size);
+        
+        // Lowest address of a stack of StackSize(size) bytes, null if the stack area is full
+        common::uint8_t* Allocate(common::uint32_t size);
+        void Free(common::uint8_t* stack, common::uint32_t size);
+        
+        common::uint32_t FreeStacks();
+    };
+    
+}
+
+#endif
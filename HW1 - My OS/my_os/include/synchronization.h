@@ -0,0 +1,84 @@
+#ifndef __MYOS__SYNCHRONIZATION_H
+#define __MYOS__SYNCHRONIZATION_H
+
+#include <common/types.h>
+
+namespace myos
+{
+    
+    const common::uint32_t NUM_PRIORITIES = 3;
+    const common::uint32_t MAX_NUM_MUTEXES = 64;
+    const common::uint32_t MAX_NUM_SEMAPHORES = 64;
+    const common::uint32_t MAX_NUM_CONDITION_VARIABLES = 64;
+    
+    class Task;
+    
+    // Blocked tasks of a mutex, semaphore or condition variable. The earliest waiter of the highest (effective)
+    // priority is woken first, and all operations are constant time.
+    class WaitQueue
+    {
+    private:
+        Task* heads[NUM_PRIORITIES];
+        Task* tails[NUM_PRIORITIES];
+        int length;
+        
+    public:
+        WaitQueue();
+        
+        void PushBack(Task* task);
+        Task* PopFront();
+        void Remove(Task* task);
+        Task* First(); // The task PopFront would return, or null
+        
+        bool IsEmpty();
+        int Length();
+        common::uint32_t HighestPriority(); // NUM_PRIORITIES if empty
+    };
+    
+    
+    // Sleeping lock with an owner. While higher priority tasks wait for it, the owner runs with their priority.
+    class Mutex
+    {
+    friend class TaskManager;
+    private:
+        bool used;
+        Task* owner;
+        WaitQueue waiters;
+        
+        // Link of the list of mutexes the owner holds
+        Mutex* nextHeld;
+        Mutex* prevHeld;
+        
+    public:
+        Mutex();
+    };
+    
+    
+    class Semaphore
+    {
+    friend class TaskManager;
+    private:
+        bool used;
+        common::int32_t count;
+        WaitQueue waiters;
+        
+    public:
+        Semaphore();
+    };
+    
+    
+    // Signalled waiters are moved to the wait queue of their mutex instead of all waking up to take it
+    class ConditionVariable
+    {
+    friend class TaskManager;
+    private:
+        bool used;
+        WaitQueue waiters;
+        
+    public:
+        ConditionVariable();
+    };
+    
+}
+
+#endif
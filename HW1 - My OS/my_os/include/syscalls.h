@@ -3,24 +3,59 @@
 #define __MYOS__SYSCALLS_H
 
 #include <common/types.h>
+#include <gdt.h>
+#include <memorymanagement.h>
+#include <smp.h>
 #include <hardwarecommunication/interrupts.h>
 #include <multitasking.h>
 
 namespace myos
 {
     
+    const common::uint32_t SYSENTER_STACK_SIZE = 256; // Only used until the entry stub switches to the stack of the task
+    const common::uint32_t NUM_SYSCALLS = 512; // System call numbers are below this
+    
+    // Gets the registers of the calling task and returns the stack to continue with
+    typedef common::uint32_t (*Syscall)(TaskManager* taskManager, CPUState* cpu);
+    
+    // System calls come with int 0x80, or with sysenter on CPUs which have it. Tasks call them through InterruptSyscall or
+    // FastSyscall with the number in eax and the arguments in ebx, ecx and edx, and both leave the same CPUState on the
+    // stack, so a task which blocked in one can be resumed by any interrupt.
     class SyscallHandler : public hardwarecommunication::InterruptHandler
     {
     
     private:
         TaskManager* taskManager;
         
+        // Indexed by the system call number, so dispatching is one bounds check and one indirect call
+        Syscall syscalls[NUM_SYSCALLS];
+        common::uint32_t callCounts[NUM_SYSCALLS];
+        void RegisterSyscalls();
+        
+        static SyscallHandler* activeSyscallHandler;
+        static common::uint8_t sysenterStacks[MAX_NUM_CPUS][SYSENTER_STACK_SIZE];
+        
+        // Implemented in interruptstubs.s, the sysenter entry saves the registers and calls HandleFastSyscall
+        static void FastSyscallEntry();
+        static common::uint32_t HandleFastSyscall(common::uint32_t esp);
+        
     public:
         SyscallHandler(hardwarecommunication::InterruptManager* interruptManager, myos::common::uint8_t InterruptNumber, TaskManager*);
         ~SyscallHandler();
         
         virtual myos::common::uint32_t HandleInterrupt(myos::common::uint32_t esp);
-
+        
+        // False if the number is out of range or taken
+        bool Register(common::uint32_t number, Syscall syscall);
+        common::uint32_t CallCount(common::uint32_t number);
+        static common::uint32_t ActiveCallCount(common::uint32_t number);
+        
+        // Sets up sysenter on the CPU which calls it, false if the CPU does not have it
+        static bool EnableFastSyscalls(GlobalDescriptorTable* gdt, common::uint32_t cpu);
+        
+        // Implemented in interruptstubs.s, tasks call one of them to make a system call
+        static void InterruptSyscall();
+        static void FastSyscall();
     };
     
     
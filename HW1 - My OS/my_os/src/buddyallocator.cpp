@@ -0,0 +1,237 @@
+#include <buddyallocator.h>
+#include <paging.h>
+
+using namespace myos;
+using namespace myos::common;
+
+
+const uint8_t FREE_BLOCK = 0x80;
+const uint32_t MULTIBOOT_INFO_SIZE = 88;
+const uint32_t MULTIBOOT_FLAG_MEMORY = 0x001; // mem_lower and mem_upper are valid
+const uint32_t MULTIBOOT_FLAG_MEMORY_MAP = 0x040; // mmap_length and mmap_addr are valid
+const uint32_t MULTIBOOT_MEMORY_AVAILABLE = 1;
+
+struct MultibootMemoryMapEntry
+{
+    uint32_t size; // Of the rest of the entry, without this field
+    uint64_t baseAddress;
+    uint64_t length;
+    uint32_t type;
+} __attribute__((packed));
+
+
+BuddyAllocator* BuddyAllocator::activeBuddyAllocator = 0;
+
+// The index-th usable region of the memory map, cut to the identity mapped memory below the stack area.
+// Without a memory map, the memory above 1 MiB from mem_upper is the only region.
+bool BuddyAllocator::UsableRegion(const void* multibootStructure, uint32_t index, uint32_t* start, uint32_t* end)
+{
+    const uint32_t* info = (const uint32_t*) multibootStructure;
+    uint32_t flags = info[0];
+
+    if ((flags & MULTIBOOT_FLAG_MEMORY_MAP) == 0) {
+        if (index != 0 || (flags & MULTIBOOT_FLAG_MEMORY) == 0)
+            return false;
+        *start = 1024*1024;
+        *end = 1024*1024 + info[2]*1024;
+        if (*end > STACK_AREA_BASE) *end = STACK_AREA_BASE;
+        return true;
+    }
+
+    uint32_t mapLength = info[11];
+    uint32_t mapAddress = info[12];
+    uint32_t found = 0;
+    for (uint32_t offset = 0; offset < mapLength; ) {
+        MultibootMemoryMapEntry* entry = (MultibootMemoryMapEntry*)(mapAddress + offset);
+        offset += entry->size + sizeof(entry->size);
+
+        if (entry->type != MULTIBOOT_MEMORY_AVAILABLE || entry->baseAddress >= STACK_AREA_BASE)
+            continue;
+        if (found++ != index)
+            continue;
+
+        uint64_t regionEnd = entry->baseAddress + entry->length;
+        *start = (uint32_t) entry->baseAddress;
+        *end = regionEnd > STACK_AREA_BASE ? STACK_AREA_BASE : (uint32_t) regionEnd;
+        return true;
+    }
+    return false;
+}
+
+BuddyAllocator::BuddyAllocator(const void* multibootStructure, uint32_t kernelEnd)
+{
+    activeBuddyAllocator = this;
+    for (uint32_t order = 0; order <= BUDDY_MAX_ORDER; ++order) {
+        freeLists[order] = 0;
+    }
+    frameStates = 0;
+    numFrames = 0;
+    numUsableFrames = 0;
+    numFreeFrames = 0;
+
+    // The multiboot structure and the memory map are read while the frame states are written
+    const uint32_t* info = (const uint32_t*) multibootStructure;
+    uint32_t reserved[4][2] = {
+        {0, kernelEnd},
+        {(uint32_t) multibootStructure, (uint32_t) multibootStructure + MULTIBOOT_INFO_SIZE},
+        {0, 0},
+        {0, 0}
+    };
+    if (info[0] & MULTIBOOT_FLAG_MEMORY_MAP) {
+        reserved[2][0] = info[12];
+        reserved[2][1] = info[12] + info[11];
+    }
+
+    uint32_t start, end;
+    for (uint32_t i = 0; UsableRegion(multibootStructure, i, &start, &end); ++i) {
+        if (end / PAGE_SIZE > numFrames) numFrames = end / PAGE_SIZE;
+    }
+
+    // The frame states take the first place after the kernel that is usable and not reserved
+    uint32_t statesSize = (numFrames + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    for (uint32_t i = 0; frameStates == 0 && UsableRegion(multibootStructure, i, &start, &end); ++i) {
+        uint32_t place = start > kernelEnd ? start : kernelEnd;
+        for (int r = 1; r < 3; ++r) {
+            place = (place + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+            for (int j = 1; j < 3; ++j) {
+                if (reserved[j][0] < place + statesSize && place < reserved[j][1]) place = reserved[j][1];
+            }
+        }
+        place = (place + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+        if (place >= start && place + statesSize <= end && place + statesSize > place)
+            frameStates = (uint8_t*) place;
+    }
+    if (frameStates == 0) {
+        numFrames = 0;
+        return;
+    }
+    reserved[3][0] = (uint32_t) frameStates;
+    reserved[3][1] = (uint32_t) frameStates + statesSize;
+    for (uint32_t i = 0; i < numFrames; ++i) {
+        frameStates[i] = 0;
+    }
+
+    for (uint32_t i = 0; UsableRegion(multibootStructure, i, &start, &end); ++i) {
+        AddRange(start, end, reserved, 4);
+    }
+}
+
+BuddyAllocator::~BuddyAllocator()
+{
+    if (activeBuddyAllocator == this)
+        activeBuddyAllocator = 0;
+}
+
+// Frees the frames of [start, end) which are not in a reserved range
+void BuddyAllocator::AddRange(uint32_t start, uint32_t end, const uint32_t (*reserved)[2], uint32_t numReserved)
+{
+    for (uint32_t i = 0; i < numReserved; ++i) {
+        if (reserved[i][0] < end && start < reserved[i][1]) {
+            if (start < reserved[i][0])
+                AddRange(start, reserved[i][0], reserved + i + 1, numReserved - i - 1);
+            if (reserved[i][1] < end)
+                AddRange(reserved[i][1], end, reserved + i + 1, numReserved - i - 1);
+            return;
+        }
+    }
+
+    start = (start + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    end &= ~(PAGE_SIZE - 1);
+
+    // Largest aligned blocks first, Free merges them with the blocks of neighbouring ranges
+    while (start < end) {
+        uint32_t order = BUDDY_MAX_ORDER;
+        while (order > 0 && ((start & ((PAGE_SIZE << order) - 1)) != 0 || end - start < (PAGE_SIZE << order))) {
+            --order;
+        }
+        numUsableFrames += 1 << order;
+        Free(start, order);
+        start += PAGE_SIZE << order;
+    }
+}
+
+void BuddyAllocator::Push(uint32_t address, uint32_t order)
+{
+    FreeBlock* block = (FreeBlock*) address;
+    block->prev = 0;
+    block->next = freeLists[order];
+    if (block->next != 0)
+        block->next->prev = block;
+    freeLists[order] = block;
+    frameStates[address / PAGE_SIZE] = FREE_BLOCK | order;
+}
+
+void BuddyAllocator::Remove(uint32_t address, uint32_t order)
+{
+    FreeBlock* block = (FreeBlock*) address;
+    if (block->prev != 0)
+        block->prev->next = block->next;
+    else
+        freeLists[order] = block->next;
+    if (block->next != 0)
+        block->next->prev = block->prev;
+    frameStates[address / PAGE_SIZE] = 0;
+}
+
+uint32_t BuddyAllocator::Order(uint32_t size)
+{
+    uint32_t order = 0;
+    while (order <= BUDDY_MAX_ORDER && (PAGE_SIZE << order) < size) {
+        ++order;
+    }
+    return order;
+}
+
+uint32_t BuddyAllocator::Allocate(uint32_t order)
+{
+    if (order > BUDDY_MAX_ORDER)
+        return 0;
+
+    uint32_t blockOrder = order;
+    while (blockOrder <= BUDDY_MAX_ORDER && freeLists[blockOrder] == 0) {
+        ++blockOrder;
+    }
+    if (blockOrder > BUDDY_MAX_ORDER)
+        return 0;
+
+    // Split the block and keep the upper halves free
+    uint32_t address = (uint32_t) freeLists[blockOrder];
+    Remove(address, blockOrder);
+    while (blockOrder > order) {
+        --blockOrder;
+        Push(address + (PAGE_SIZE << blockOrder), blockOrder);
+    }
+
+    numFreeFrames -= 1 << order;
+    return address;
+}
+
+void BuddyAllocator::Free(uint32_t address, uint32_t order)
+{
+    numFreeFrames += 1 << order;
+
+    while (order < BUDDY_MAX_ORDER) {
+        uint32_t buddy = address ^ (PAGE_SIZE << order);
+        if (buddy / PAGE_SIZE >= numFrames || frameStates[buddy / PAGE_SIZE] != (FREE_BLOCK | order))
+            break;
+        Remove(buddy, order);
+        address &= ~(PAGE_SIZE << order);
+        ++order;
+    }
+    Push(address, order);
+}
+
+uint32_t BuddyAllocator::UsableFrames()
+{
+    return numUsableFrames;
+}
+
+uint32_t BuddyAllocator::FreeFrames()
+{
+    return numFreeFrames;
+}
+
+uint32_t BuddyAllocator::MemoryEnd()
+{
+    return numFrames * PAGE_SIZE;
+}
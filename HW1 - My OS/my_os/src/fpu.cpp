@@ -0,0 +1,65 @@
+
+#include <fpu.h>
+
+using namespace myos;
+using namespace myos::common;
+using namespace myos::hardwarecommunication;
+
+
+const uint32_t CR0_MONITOR_COPROCESSOR = 0x2;
+const uint32_t CR0_EMULATION = 0x4;
+const uint32_t CR0_NUMERIC_ERROR = 0x20;
+const uint32_t CR4_OSFXSR = 0x200;
+const uint32_t CR4_OSXMMEXCPT = 0x400;
+
+const uint32_t CPUID_FXSR = 1 << 24;
+const uint32_t CPUID_SSE = 1 << 25;
+
+const uint8_t DEVICE_NOT_AVAILABLE_INTERRUPT = 0x07;
+
+
+FloatingPointUnit::FloatingPointUnit(InterruptManager* interruptManager, TaskManager* taskManager)
+:    InterruptHandler(interruptManager, DEVICE_NOT_AVAILABLE_INTERRUPT)
+{
+    this->taskManager = taskManager;
+    
+    // The application processors turn it on for themselves when they start
+    if (EnableProcessor()) {
+        taskManager->EnableLazyFpu();
+    }
+}
+
+FloatingPointUnit::~FloatingPointUnit()
+{
+}
+
+bool FloatingPointUnit::EnableProcessor()
+{
+    uint32_t eax = 1, ebx, ecx, edx;
+    asm volatile("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+    if ((edx & (CPUID_FXSR | CPUID_SSE)) != (CPUID_FXSR | CPUID_SSE))
+        return false;
+    
+    // No emulation, and x87 errors are reported as exceptions instead of through the PIC
+    uint32_t cr0;
+    asm volatile("mov %%cr0, %0" : "=r" (cr0));
+    cr0 = (cr0 & ~CR0_EMULATION) | CR0_MONITOR_COPROCESSOR | CR0_NUMERIC_ERROR;
+    asm volatile("mov %0, %%cr0" : : "r" (cr0));
+    
+    uint32_t cr4;
+    asm volatile("mov %%cr4, %0" : "=r" (cr4));
+    asm volatile("mov %0, %%cr4" : : "r" (cr4 | CR4_OSFXSR | CR4_OSXMMEXCPT));
+    
+    Initialize();
+    
+    // No task owns the registers yet, so the first use traps
+    SetTaskSwitched();
+    return true;
+}
+
+uint32_t FloatingPointUnit::HandleInterrupt(uint32_t esp)
+{
+    // The same task continues with its own registers loaded
+    taskManager->HandleFpuTrap();
+    return esp;
+}
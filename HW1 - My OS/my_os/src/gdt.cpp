@@ -7,9 +7,15 @@ using namespace myos::common;
 GlobalDescriptorTable::GlobalDescriptorTable()
     : nullSegmentSelector(0, 0, 0),
         unusedSegmentSelector(0, 0, 0),
-        codeSegmentSelector(0, 64*1024*1024, 0x9A),
-        dataSegmentSelector(0, 64*1024*1024, 0x92)
+        codeSegmentSelector(0, 0xFFFFFFFF, 0x9A),
+        dataSegmentSelector(0, 0xFFFFFFFF, 0x92)
 {   
+    // Flat 4 GiB segments: the heap and the paged task stack area are above 64 MiB, and the segment registers are
+    // reloaded from this table on every hardware task switch.
+    for (int j = 0; j < MAX_TASK_STATE_SEGMENTS; ++j) {
+        taskStateSegmentSelectors[j] = SegmentDescriptor(0, 0, 0);
+    }
+    
     /*
     ///////////////////////////////////////// TODO: YENI EKLENDI
     // Initialize process segment descriptors with appropriate base and limit values
@@ -42,6 +48,17 @@ uint16_t GlobalDescriptorTable::CodeSegmentSelector()
     return (uint8_t*)&codeSegmentSelector - (uint8_t*)this;
 }
 
+uint16_t GlobalDescriptorTable::SetTaskStateSegment(int index, TaskStateSegment* taskStateSegment)
+{
+    // 0x89: present, ring 0, available 32-bit task state segment
+    taskStateSegmentSelectors[index] = SegmentDescriptor((uint32_t)taskStateSegment, sizeof(TaskStateSegment) - 1, 0x89);
+    
+    // System segments have no size flag, only the high bits of the limit
+    ((uint8_t*)&taskStateSegmentSelectors[index])[6] &= 0x0F;
+    
+    return (uint8_t*)&taskStateSegmentSelectors[index] - (uint8_t*)this;
+}
+
 /*
 ////////////////////////////////////////////////////////////////////////// TODO: YENI EKLENDI
 uint16_t GlobalDescriptorTable::GetProcessCodeSegmentSelector(int processId)
@@ -0,0 +1,101 @@
+
+#include <hardwarecommunication/apic.h>
+#include <hardwarecommunication/pit.h>
+using namespace myos::common;
+using namespace myos::hardwarecommunication;
+
+
+// Register offsets from the base of the local APIC
+const uint32_t LAPIC_ID = 0x020;
+const uint32_t LAPIC_TASK_PRIORITY = 0x080;
+const uint32_t LAPIC_END_OF_INTERRUPT = 0x0B0;
+const uint32_t LAPIC_SPURIOUS_INTERRUPT_VECTOR = 0x0F0;
+const uint32_t LAPIC_INTERRUPT_COMMAND_LOW = 0x300;
+const uint32_t LAPIC_INTERRUPT_COMMAND_HIGH = 0x310;
+const uint32_t LAPIC_TIMER = 0x320;
+const uint32_t LAPIC_TIMER_INITIAL_COUNT = 0x380;
+const uint32_t LAPIC_TIMER_CURRENT_COUNT = 0x390;
+const uint32_t LAPIC_TIMER_DIVIDE = 0x3E0;
+
+const uint32_t LAPIC_ENABLE = 0x100;
+const uint32_t LAPIC_DELIVERY_PENDING = 0x1000;
+const uint32_t LAPIC_TIMER_MASKED = 0x10000;
+const uint32_t LAPIC_TIMER_PERIODIC = 0x20000;
+const uint32_t LAPIC_TIMER_DIVIDE_BY_16 = 0x3;
+
+
+volatile uint32_t* LocalApic::registers = (volatile uint32_t*) LocalApic::DEFAULT_BASE;
+
+void LocalApic::SetBase(uint32_t base)
+{
+    registers = (volatile uint32_t*) base;
+}
+
+uint32_t LocalApic::Read(uint32_t offset)
+{
+    return registers[offset / 4];
+}
+
+void LocalApic::Write(uint32_t offset, uint32_t value)
+{
+    registers[offset / 4] = value;
+}
+
+uint8_t LocalApic::Id()
+{
+    return Read(LAPIC_ID) >> 24;
+}
+
+void LocalApic::Enable(uint8_t spuriousVector)
+{
+    Write(LAPIC_TASK_PRIORITY, 0); // Accept every interrupt
+    Write(LAPIC_SPURIOUS_INTERRUPT_VECTOR, LAPIC_ENABLE | spuriousVector);
+}
+
+void LocalApic::EndOfInterrupt()
+{
+    Write(LAPIC_END_OF_INTERRUPT, 0);
+}
+
+void LocalApic::SendInterProcessorInterrupt(uint8_t apicId, uint32_t command)
+{
+    Write(LAPIC_INTERRUPT_COMMAND_HIGH, (uint32_t) apicId << 24);
+    Write(LAPIC_INTERRUPT_COMMAND_LOW, command); // Writing the low half sends it
+    while (Read(LAPIC_INTERRUPT_COMMAND_LOW) & LAPIC_DELIVERY_PENDING) {
+        asm volatile("pause");
+    }
+}
+
+void LocalApic::SendInit(uint8_t apicId)
+{
+    // INIT, level triggered, asserted
+    SendInterProcessorInterrupt(apicId, 0x4500);
+}
+
+void LocalApic::SendStartup(uint8_t apicId, uint8_t vector)
+{
+    SendInterProcessorInterrupt(apicId, 0x4600 | vector);
+}
+
+uint32_t LocalApic::MeasureTimer(uint32_t microseconds)
+{
+    ProgrammableIntervalTimer timer;
+    
+    // Count down from the largest value without raising an interrupt
+    Write(LAPIC_TIMER_DIVIDE, LAPIC_TIMER_DIVIDE_BY_16);
+    Write(LAPIC_TIMER, LAPIC_TIMER_MASKED);
+    Write(LAPIC_TIMER_INITIAL_COUNT, 0xFFFFFFFF);
+    
+    timer.Wait(microseconds);
+    
+    uint32_t elapsed = 0xFFFFFFFF - Read(LAPIC_TIMER_CURRENT_COUNT);
+    Write(LAPIC_TIMER_INITIAL_COUNT, 0); // Stops the timer
+    return elapsed;
+}
+
+void LocalApic::StartPeriodicTimer(uint8_t vector, uint32_t initialCount)
+{
+    Write(LAPIC_TIMER_DIVIDE, LAPIC_TIMER_DIVIDE_BY_16);
+    Write(LAPIC_TIMER, LAPIC_TIMER_PERIODIC | vector);
+    Write(LAPIC_TIMER_INITIAL_COUNT, initialCount != 0 ? initialCount : 1);
+}
@@ -1,5 +1,6 @@
 
 #include <hardwarecommunication/interrupts.h>
+#include <hardwarecommunication/apic.h>
 using namespace myos;
 using namespace myos::common;
 using namespace myos::hardwarecommunication;
@@ -119,6 +120,7 @@ InterruptManager::InterruptManager(uint16_t hardwareInterruptOffset, GlobalDescr
     SetInterruptDescriptorTableEntry(hardwareInterruptOffset + 0x0D, CodeSegment, &HandleInterruptRequest0x0D, 0, IDT_INTERRUPT_GATE);
     SetInterruptDescriptorTableEntry(hardwareInterruptOffset + 0x0E, CodeSegment, &HandleInterruptRequest0x0E, 0, IDT_INTERRUPT_GATE);
     SetInterruptDescriptorTableEntry(hardwareInterruptOffset + 0x0F, CodeSegment, &HandleInterruptRequest0x0F, 0, IDT_INTERRUPT_GATE);
+    SetInterruptDescriptorTableEntry(hardwareInterruptOffset + 0x10, CodeSegment, &HandleInterruptRequest0x10, 0, IDT_INTERRUPT_GATE);
 
     // For system calls interrupt 0x80, register interrupt to interrupt descriptor table.
     SetInterruptDescriptorTableEntry(                          0x80, CodeSegment, &HandleInterruptRequest0x80, 0, IDT_INTERRUPT_GATE);
@@ -141,6 +143,11 @@ InterruptManager::InterruptManager(uint16_t hardwareInterruptOffset, GlobalDescr
     programmableInterruptControllerMasterDataPort.Write(0x00);
     programmableInterruptControllerSlaveDataPort.Write(0x00);
     
+    LoadInterruptDescriptorTable();
+}
+
+void InterruptManager::LoadInterruptDescriptorTable()
+{
     // Initialize InterruptDescriptorTablePointer
     InterruptDescriptorTablePointer idt_pointer;
     idt_pointer.size  = 256*sizeof(GateDescriptor) - 1;
@@ -148,6 +155,16 @@ InterruptManager::InterruptManager(uint16_t hardwareInterruptOffset, GlobalDescr
     asm volatile("lidt %0" : : "m" (idt_pointer));
 }
 
+bool InterruptManager::IsActive()
+{
+    return ActiveInterruptManager != 0;
+}
+
+uint16_t InterruptManager::ActiveHardwareInterruptOffset()
+{
+    return ActiveInterruptManager != 0 ? ActiveInterruptManager->hardwareInterruptOffset : 0;
+}
+
 InterruptManager::~InterruptManager()
 {
     Deactivate();
@@ -158,6 +175,13 @@ uint16_t InterruptManager::HardwareInterruptOffset()
     return hardwareInterruptOffset;
 }
 
+// The interrupt switches to the given task (hardware task switch) instead of calling a handler on the current stack
+void InterruptManager::SetTaskGate(uint8_t interrupt, uint16_t taskStateSegmentSelector)
+{
+    const uint8_t IDT_TASK_GATE = 0x5;
+    SetInterruptDescriptorTableEntry(interrupt, taskStateSegmentSelector, 0, 0, IDT_TASK_GATE);
+}
+
 void InterruptManager::Activate()
 {
     // Singleton pattern: If not set, create.
@@ -197,7 +221,7 @@ uint32_t InterruptManager::DoHandleInterrupt(uint8_t interrupt, uint32_t esp)
     {
         esp = handlers[interrupt]->HandleInterrupt(esp);
     }
-    else if(interrupt != hardwareInterruptOffset)
+    else if(interrupt != hardwareInterruptOffset && interrupt != hardwareInterruptOffset + 0x10)
     {
         // If we don't have handler for this interrupt, print this message.
         printf("UNHANDLED INTERRUPT 0x");
@@ -205,12 +229,17 @@ uint32_t InterruptManager::DoHandleInterrupt(uint8_t interrupt, uint32_t esp)
         printf("\n");
     }
 
-    // Timer interrupt
-    if(interrupt == hardwareInterruptOffset)
+    // Timer interrupt: the PIT on the bootstrap processor, the local APIC timer on the others
+    if(interrupt == hardwareInterruptOffset || interrupt == hardwareInterruptOffset + 0x10)
     {
         esp = (uint32_t)taskManager->Schedule((CPUState*)esp);
     }
     
+    if(interrupt == hardwareInterruptOffset + 0x10)
+    {
+        LocalApic::EndOfInterrupt();
+    }
+    
     
     // hardware interrupts must be acknowledged, otherwise next interrupts cannot be caught.
     if(hardwareInterruptOffset <= interrupt && interrupt < hardwareInterruptOffset+16)
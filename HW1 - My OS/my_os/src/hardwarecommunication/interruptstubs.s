@@ -5,12 +5,26 @@
 .section .text
 
 .extern _ZN4myos21hardwarecommunication16InterruptManager15HandleInterruptEhj #interrups.cpp HandleInterrupt function reference
+.extern _ZN4myos10KernelLock7AcquireEv
+.extern _ZN4myos10KernelLock7ReleaseEv
+
+# The stubs push the interrupt number to the stack instead of a global variable, since several CPUs can take interrupts at the same time.
+# int_bottom takes it from there and puts ebp to its place.
 
 
 .macro HandleException num
 .global _ZN4myos21hardwarecommunication16InterruptManager19HandleException\num\()Ev
 _ZN4myos21hardwarecommunication16InterruptManager19HandleException\num\()Ev:
-    movb $\num, (interruptnumber)
+    pushl $\num
+    jmp int_bottom
+.endm
+
+# The CPU pushes an error code only for some exceptions, for the others the stub pushes 0 so that the CPUState is the same
+.macro HandleExceptionWithoutErrorCode num
+.global _ZN4myos21hardwarecommunication16InterruptManager19HandleException\num\()Ev
+_ZN4myos21hardwarecommunication16InterruptManager19HandleException\num\()Ev:
+    pushl $0
+    pushl $\num
     jmp int_bottom
 .endm
 
@@ -18,32 +32,32 @@ _ZN4myos21hardwarecommunication16InterruptManager19HandleException\num\()Ev:
 .macro HandleInterruptRequest num
 .global _ZN4myos21hardwarecommunication16InterruptManager26HandleInterruptRequest\num\()Ev
 _ZN4myos21hardwarecommunication16InterruptManager26HandleInterruptRequest\num\()Ev:
-    movb $\num + IRQ_BASE, (interruptnumber)
     pushl $0 # For error register in CPUState
+    pushl $\num + IRQ_BASE
     jmp int_bottom
 .endm
 
 
-HandleException 0x00
-HandleException 0x01
-HandleException 0x02
-HandleException 0x03
-HandleException 0x04
-HandleException 0x05
-HandleException 0x06
-HandleException 0x07
+HandleExceptionWithoutErrorCode 0x00
+HandleExceptionWithoutErrorCode 0x01
+HandleExceptionWithoutErrorCode 0x02
+HandleExceptionWithoutErrorCode 0x03
+HandleExceptionWithoutErrorCode 0x04
+HandleExceptionWithoutErrorCode 0x05
+HandleExceptionWithoutErrorCode 0x06
+HandleExceptionWithoutErrorCode 0x07
 HandleException 0x08
-HandleException 0x09
+HandleExceptionWithoutErrorCode 0x09
 HandleException 0x0A
 HandleException 0x0B
 HandleException 0x0C
 HandleException 0x0D
 HandleException 0x0E
-HandleException 0x0F
-HandleException 0x10
+HandleExceptionWithoutErrorCode 0x0F
+HandleExceptionWithoutErrorCode 0x10
 HandleException 0x11
-HandleException 0x12
-HandleException 0x13
+HandleExceptionWithoutErrorCode 0x12
+HandleExceptionWithoutErrorCode 0x13
 
 
 # Executes the macro for generating the function with different interrupt numbers
@@ -63,6 +77,7 @@ HandleInterruptRequest 0x0C
 HandleInterruptRequest 0x0D
 HandleInterruptRequest 0x0E
 HandleInterruptRequest 0x0F
+HandleInterruptRequest 0x10 # Local APIC timer of the application processors
 HandleInterruptRequest 0x31
 
 # 0x80: For system calls 
@@ -86,7 +101,7 @@ int_bottom:
     #            The stack push order must be reverse according to the written order in the CPUState class. So that when it reads 
     #            from beginning, it reads the correct value. Also, the CPU pushed registers I commented below in CPUState class are
     #            also pushed already before coming here.
-    pushl %ebp
+    xchgl %ebp, (%esp) # ebp = interrupt number
     pushl %edi
     pushl %esi
 
@@ -102,12 +117,17 @@ int_bottom:
     #mov %eax, %ees
 
     # call C++ Handler
+    # The kernel lock is released only after switching the stack, so no other CPU can resume or reuse this
+    # task's stack while this CPU is still on it.
+    call _ZN4myos10KernelLock7AcquireEv
     pushl %esp
-    push (interruptnumber)
+    pushl %ebp
     call _ZN4myos21hardwarecommunication16InterruptManager15HandleInterruptEhj
     #add %esp, 6
     mov %eax, %esp # switch the stack
     #mov %edx, %eax # TODO: YENI EKLENDI
+int_return:
+    call _ZN4myos10KernelLock7ReleaseEv
 
     # restore registers
     popl %eax
@@ -136,5 +156,78 @@ _ZN4myos21hardwarecommunication16InterruptManager15InterruptIgnoreEv:
     iret
 
 
-.data
-    interruptnumber: .byte 0
+# System call entries for the tasks (syscalls.cpp). The number is in eax and the arguments in ebx, ecx and edx.
+.global _ZN4myos14SyscallHandler16InterruptSyscallEv
+_ZN4myos14SyscallHandler16InterruptSyscallEv:
+    int $0x80
+    ret
+
+# sysenter does not save the return address or the stack, so the caller builds the iret frame of a CPUState itself
+# (eflags, cs, eip) and passes its stack in ebp, which it saves before.
+.global _ZN4myos14SyscallHandler11FastSyscallEv
+_ZN4myos14SyscallHandler11FastSyscallEv:
+    pushl %ebp
+    pushfl
+    pushl %cs
+    pushl $fast_syscall_return
+    movl %esp, %ebp
+    sysenter
+fast_syscall_return:
+    popl %ebp
+    ret
+
+
+.extern _ZN4myos14SyscallHandler17HandleFastSyscallEj
+
+# sysenter arrives here with interrupts disabled and on the sysenter stack of the CPU. The stub saves the registers
+# in the same CPUState as int_bottom on the stack of the task.
+.global _ZN4myos14SyscallHandler16FastSyscallEntryEv
+_ZN4myos14SyscallHandler16FastSyscallEntryEv:
+    movl %ebp, %esp
+    pushl $0 # For error register in CPUState
+    pushl %ebp
+    pushl %edi
+    pushl %esi
+    pushl %edx
+    pushl %ecx
+    pushl %ebx
+    pushl %eax
+    
+    call _ZN4myos10KernelLock7AcquireEv
+    pushl %esp
+    call _ZN4myos14SyscallHandler17HandleFastSyscallEj
+    add $4, %esp
+    
+    # Another task continues: leave through int_bottom, which releases the lock after switching the stack
+    cmp %eax, %esp
+    je fast_syscall_same_task
+    mov %eax, %esp
+    jmp int_return
+    
+fast_syscall_same_task:
+    call _ZN4myos10KernelLock7ReleaseEv
+    popl %eax
+    popl %ebx
+    popl %ecx
+    popl %edx
+    popl %esi
+    popl %edi
+    
+    # The caller restores ebp. Return without iret: take eip, then eflags, which turns the interrupts back on.
+    add $8, %esp
+    movl (%esp), %ebp
+    add $8, %esp
+    popfl
+    jmp *%ebp
+
+
+# Page fault task (paging.cpp PagingManager::PageFaultTask). The page fault is delivered through a task gate, so this runs on its
+# own stack with the error code pushed by the CPU. iret switches back to the faulting task and the next fault resumes after it.
+.extern _ZN4myos13PagingManager15HandlePageFaultEj
+
+.global _ZN4myos13PagingManager13PageFaultTaskEv
+_ZN4myos13PagingManager13PageFaultTaskEv:
+    call _ZN4myos13PagingManager15HandlePageFaultEj # The error code on the stack is the argument
+    add $4, %esp
+    iret
+    jmp _ZN4myos13PagingManager13PageFaultTaskEv
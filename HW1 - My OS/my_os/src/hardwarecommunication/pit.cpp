@@ -0,0 +1,64 @@
+
+#include <hardwarecommunication/pit.h>
+using namespace myos::common;
+using namespace myos::hardwarecommunication;
+
+
+ProgrammableIntervalTimer::ProgrammableIntervalTimer()
+: channel0DataPort(0x40),
+  channel2DataPort(0x42),
+  commandPort(0x43),
+  channel2GatePort(0x61)
+{
+    frequency = BASE_FREQUENCY / 65536;
+}
+
+ProgrammableIntervalTimer::~ProgrammableIntervalTimer()
+{
+}
+
+uint32_t ProgrammableIntervalTimer::SetFrequency(uint32_t hz)
+{
+    // The divisor is 16 bits wide, 0 meaning 65536
+    uint32_t divisor = (hz == 0) ? 65536 : (BASE_FREQUENCY + hz / 2) / hz;
+    if (divisor < 1) divisor = 1;
+    if (divisor > 65536) divisor = 65536;
+
+    // Channel 0, low byte then high byte, mode 3 (square wave), binary counting
+    commandPort.Write(0x36);
+    channel0DataPort.Write(divisor & 0xFF);
+    channel0DataPort.Write((divisor >> 8) & 0xFF);
+
+    frequency = BASE_FREQUENCY / divisor;
+    return frequency;
+}
+
+uint32_t ProgrammableIntervalTimer::GetFrequency()
+{
+    return frequency;
+}
+
+void ProgrammableIntervalTimer::Wait(uint32_t microseconds)
+{
+    // The counter is 16 bits wide, so longer waits are done in parts of at most 50 ms
+    while (microseconds > 0) {
+        uint32_t part = microseconds < 50000 ? microseconds : 50000;
+        microseconds -= part;
+        
+        uint32_t count = (part * (BASE_FREQUENCY / 1000) + 999) / 1000;
+        if (count == 0) count = 1;
+        
+        // Gate off and speaker off while the count is loaded
+        uint8_t gate = channel2GatePort.Read() & 0xFC;
+        channel2GatePort.Write(gate);
+        
+        // Channel 2, low byte then high byte, mode 0 (output goes high at the end of the count), binary counting
+        commandPort.Write(0xB0);
+        channel2DataPort.Write(count & 0xFF);
+        channel2DataPort.Write((count >> 8) & 0xFF);
+        
+        channel2GatePort.Write(gate | 0x01);
+        while ((channel2GatePort.Read() & 0x20) == 0) {
+        }
+    }
+}
@@ -0,0 +1,73 @@
+#include <ipc.h>
+
+using namespace myos;
+using namespace myos::common;
+
+
+RingBuffer::RingBuffer(uint8_t* data, uint32_t size)
+{
+    this->data = data;
+    this->size = size;
+    head = 0;
+    used = 0;
+}
+
+void RingBuffer::Clear()
+{
+    head = 0;
+    used = 0;
+}
+
+// Copies in at most two parts, before and after the end of the buffer
+uint32_t RingBuffer::Write(const uint8_t* source, uint32_t length)
+{
+    if (length > size - used) length = size - used;
+    
+    uint32_t tail = (head + used) % size;
+    for (uint32_t i = 0; i < length; ++i) {
+        data[tail] = source[i];
+        if (++tail == size) tail = 0;
+    }
+    used += length;
+    return length;
+}
+
+uint32_t RingBuffer::Peek(uint8_t* destination, uint32_t length)
+{
+    if (length > used) length = used;
+    
+    uint32_t position = head;
+    for (uint32_t i = 0; i < length; ++i) {
+        destination[i] = data[position];
+        if (++position == size) position = 0;
+    }
+    return length;
+}
+
+uint32_t RingBuffer::Read(uint8_t* destination, uint32_t length)
+{
+    length = Peek(destination, length);
+    head = (head + length) % size;
+    used -= length;
+    return length;
+}
+
+uint32_t RingBuffer::Used() { return used; }
+uint32_t RingBuffer::Free() { return size - used; }
+
+
+
+
+Pipe::Pipe()
+: buffer(data, PIPE_BUFFER_SIZE)
+{
+    numReaders = 0;
+    numWriters = 0;
+}
+
+MessageQueue::MessageQueue()
+: buffer(data, MESSAGE_QUEUE_BUFFER_SIZE)
+{
+    used = false;
+    numMessages = 0;
+}
@@ -2,8 +2,14 @@
 #include <common/types.h>
 #include <gdt.h>
 #include <memorymanagement.h>
+#include <buddyallocator.h>
+#include <slab.h>
+#include <paging.h>
 #include <hardwarecommunication/interrupts.h>
+#include <hardwarecommunication/pit.h>
 #include <syscalls.h>
+#include <fpu.h>
+#include <kerneldata.h>
 #include <hardwarecommunication/pci.h>
 #include <drivers/driver.h>
 #include <drivers/keyboard.h>
@@ -13,6 +19,8 @@
 #include <gui/desktop.h>
 #include <gui/window.h>
 #include <multitasking.h>
+#include <smp.h>
+#include <spinlock.h>
 
 #include <drivers/amd_am79c973.h>
 
@@ -27,10 +35,23 @@ using namespace myos::hardwarecommunication;
 using namespace myos::gui;
 
 LifeCycleType lifeCycleType = LifeCycleType::LifeCycleA; // A, B1, B2, B3, B4
-SchedulerType schedulerType = SchedulerType::RoundRobin; // PreemptivePriority, RoundRobin
+SchedulerType schedulerType = SchedulerType::RoundRobin; // PreemptivePriority, RoundRobin, MultilevelFeedbackQueue, Stride
 ProcessTablePrintType processTablePrintType = ProcessTablePrintType::PrintEverySwitch; // PrintEverySwitch, PrintEveryTimeInterrupt, PrintOnlyTermination, DoNotPrint
 bool useDelayInPrintingProcessTable = true;
 
+uint32_t timerFrequency = 1000; // Timer interrupts per second, the timer runs at about 18.2 Hz if it is not programmed
+uint32_t quantumTicks[] = {55, 55, 55}; // Time slice of High, Medium and Low priority tasks in timer ticks
+uint32_t agingTicks = 0; // PreemptivePriority moves a ready task one level up after waiting this many ticks, 0 turns aging off. Lifecycle B4 needs 137
+bool useSleepInPrograms = true; // Programs sleep between their outputs instead of running a busy delay loop
+uint32_t programSleepMilliseconds = 1000;
+bool printChildStatistics = false; // Init prints the scheduling metrics of every child it takes in waitpid
+uint32_t maxNumCpus = MAX_NUM_CPUS; // 1 keeps everything on the bootstrap processor
+uint32_t initStackSize = DEFAULT_STACK_SIZE; // Up to MAX_STACK_SIZE, forked children get the stack size of their parent
+bool useFastSyscalls = true; // System calls use sysenter instead of int 0x80 if the CPU has it
+bool printHeapReport = false; // Init prints the kernel heap statistics after its children exit
+bool runSyscallLatencyTest = false; // Init measures the cycles of a null system call before it starts its programs
+bool mirrorConsoleToSerial = false; // printf writes to COM1 too, "make runqemu" shows it in the terminal
+
 int collatzInputs[] = {7, 7, 7, 7, 7, 7, 7, 7, 7, 7};
 int binarySearchInputs[] = {110, 110, 110, 110, 110, 110, 110, 110, 110, 110};
 int linearSearchInputs[] = {175, 110, 80, 175, 175, 175, 175, 175, 175, 175};
@@ -41,16 +62,40 @@ int binarySearchNo = 0;
 int linearSearchNo = 0;
 int longRunningNo = 0;
 
+// Tasks print without a system call, so the CPUs take turns on the screen
+Spinlock consoleLock;
+
+Port8Bit serialData(0x3F8);
+Port8Bit serialLineStatus(0x3FD);
+
+void serialWrite(char c)
+{
+    while ((serialLineStatus.Read() & 0x20) == 0); // Wait until the transmitter takes a byte
+    serialData.Write(c);
+}
+
 void printf(char* str)
 {
     // The starting address for video memory. When we put something there, it is printed by graphic card.
     static uint16_t* VideoMemory = (uint16_t*)0xb8000; 
+    
+    // A task must not be interrupted while it holds the lock, since the timer interrupt may print too
+    uint32_t flags;
+    asm volatile("pushf\n pop %0\n cli" : "=r" (flags));
+    consoleLock.Acquire();
 
     // Assuming our terminal is 80*25 size, we are writing our buffer logic here.
     static uint8_t x=0,y=0;
 
     for(int i = 0; str[i] != '\0'; ++i)
     {
+        if(mirrorConsoleToSerial)
+        {
+            if(str[i] == '\n')
+                serialWrite('\r');
+            serialWrite(str[i]);
+        }
+        
         switch(str[i])
         {
             case '\n':
@@ -78,6 +123,9 @@ void printf(char* str)
             y = 0;
         }
     }
+    
+    consoleLock.Release();
+    asm volatile("push %0\n popf" : : "r" (flags) : "memory", "cc");
 }
 
 void printfHex(uint8_t key)
@@ -206,54 +254,348 @@ public:
 TaskManager* taskManager;
 GlobalDescriptorTable* gdtRef;
 
+// The wrappers below call SyscallHandler::FastSyscall (sysenter) if the CPU has it, otherwise InterruptSyscall (int 0x80)
+void (*syscallEntry)() = &SyscallHandler::InterruptSyscall;
+#define SYSCALL "call *syscallEntry"
+
 void sysprintf(char* str)
 {
-    asm("int $0x80" : : "a" (4), "b" (str));
+    asm(SYSCALL : : "a" (1), "b" (str));
 }
 
 int sysfork()
 {
-    asm("int $0x80" : : "a" (57));
+    asm(SYSCALL : : "a" (57));
 }
 
 void sysexecve(void (*entrypoint)())
 {
-    asm("int $0x80" : : "a" (59), "b" (entrypoint));
+    asm(SYSCALL : : "a" (59), "b" (entrypoint));
+}
+
+// Starts a child at entrypoint with the given priority, without copying the stack like sysfork. stackSize 0 gives the
+// child a stack of the size of its parent's. Returns its pid or -1.
+int32_t sysspawn(void (*entrypoint)(), Priority priority, uint32_t stackSize = 0)
+{
+    int32_t pid;
+    asm volatile(SYSCALL : "=a"(pid) : "a" (120), "b" (entrypoint), "c" ((uint32_t) priority), "d" (stackSize) : "memory");
+    return pid;
+}
+
+// Starts a child for every request in one system call and fills in their pids. Returns the number of children started.
+uint32_t sysspawnbatch(SpawnRequest* requests, uint32_t count)
+{
+    uint32_t spawned;
+    asm volatile(SYSCALL : "=a"(spawned) : "a" (401), "b" (requests), "c" (count) : "memory");
+    return spawned;
 }
 
 void sysexit() 
 {
-    asm("int $0x80" : : "a" (8));
+    asm(SYSCALL : : "a" (8));
 }
 
 uint32_t syswaitpid(uint32_t pid) 
 {
     uint32_t result;
-    asm("int $0x80" : : "a" (7), "b" (pid));
+    asm(SYSCALL : : "a" (7), "b" (pid));
     asm("" : "=a"(result));
     return result;
 }
 
 void sysblockforcollatz() 
 {
-    asm("int $0x80" : : "a" (9));
+    asm(SYSCALL : : "a" (9));
 }
 
 void syssetlasttaskpriority(Priority priority) 
 {
-    asm("int $0x80" : : "a" (10), "b" ((uint32_t) priority));
+    asm(SYSCALL : : "a" (10), "b" ((uint32_t) priority));
+}
+
+KernelData* kernelData = 0; // The read-only kernel data page, 0 if it could not be mapped
+
+// Reads the entry of the CPU the task runs on from the kernel data page. The task can be preempted or moved to another
+// CPU meanwhile, so it reads again until the CPU and the switch count of the entry are the same before and after.
+void readRunningTask(int32_t* pid, int32_t* forkPid)
+{
+    while (true) {
+        uint32_t cpu = MultiprocessorManager::CurrentCpuIndex();
+        KernelDataProcessor* entry = &kernelData->processors[cpu];
+        uint32_t switches = entry->switches;
+        *pid = entry->pid;
+        *forkPid = entry->forkPid;
+        if ((switches & 1) == 0 && entry->switches == switches && MultiprocessorManager::CurrentCpuIndex() == cpu)
+            return;
+    }
 }
 
 uint32_t sysforkpid()
 {
     uint32_t forkPid;
-    asm("int $0x80" : "=a"(forkPid) : "a" (58));
+    if (kernelData != 0) {
+        int32_t pid;
+        readRunningTask(&pid, (int32_t*) &forkPid);
+        return forkPid;
+    }
+    asm(SYSCALL : "=a"(forkPid) : "a" (58));
     return forkPid;
 }
 
+int32_t sysgetpid()
+{
+    int32_t pid;
+    if (kernelData != 0) {
+        int32_t forkPid;
+        readRunningTask(&pid, &forkPid);
+        return pid;
+    }
+    asm(SYSCALL : "=a"(pid) : "a" (20));
+    return pid;
+}
+
+// The time only comes from the kernel data page, 0 without it
+uint32_t sysgetticks()
+{
+    return kernelData != 0 ? kernelData->ticks : 0;
+}
+
+uint32_t sysgetmilliseconds()
+{
+    return kernelData != 0 ? kernelData->milliseconds : 0;
+}
+
+// Calls of the given system call number so far
+uint32_t syssyscallcount(uint32_t number)
+{
+    uint32_t count;
+    asm(SYSCALL : "=a"(count) : "a" (400), "b" (number));
+    return count;
+}
+
 void syscollatzadded() 
 {
-    asm("int $0x80" : : "a" (11));
+    asm(SYSCALL : : "a" (11));
+}
+
+// Share of the last added task in stride scheduling, relative to the tickets of the other tasks
+void syssetlasttasktickets(uint32_t tickets) 
+{
+    asm(SYSCALL : : "a" (12), "b" (tickets));
+}
+
+void syssleep(uint32_t milliseconds) 
+{
+    asm(SYSCALL : : "a" (162), "b" (milliseconds));
+}
+
+int sysgettaskstatistics(int32_t pid, TaskStatistics* statistics) 
+{
+    int result;
+    asm(SYSCALL : "=a"(result) : "a" (77), "b" (pid), "c" (statistics) : "memory");
+    return result;
+}
+
+// Makes the calling task periodic with the given budget of CPU time in every period, which has to be used before the deadline.
+// Times are in milliseconds, period 0 makes it a normal task again. Returns -1 if the CPUs cannot guarantee the budget.
+int sysrealtime(uint32_t period, uint32_t budget, uint32_t deadline) 
+{
+    int result;
+    asm volatile(SYSCALL : "=a"(result) : "a" (351), "b" (period), "c" (budget), "d" (deadline) : "memory");
+    return result;
+}
+
+int sysheapstatistics(HeapStatistics* statistics) 
+{
+    int result;
+    asm volatile(SYSCALL : "=a"(result) : "a" (402), "b" (statistics) : "memory");
+    return result;
+}
+
+// A real-time task calls it at the end of every job and continues at the start of its next period
+void sysyield() 
+{
+    asm volatile(SYSCALL : : "a" (158) : "memory");
+}
+
+int sysmutexcreate() 
+{
+    int result;
+    asm volatile(SYSCALL : "=a"(result) : "a" (200) : "memory");
+    return result;
+}
+
+// Blocks until the mutex is free, then the caller owns it
+int sysmutexlock(int mutex) 
+{
+    int result;
+    asm volatile(SYSCALL : "=a"(result) : "a" (201), "b" (mutex) : "memory");
+    return result;
+}
+
+int sysmutextrylock(int mutex) 
+{
+    int result;
+    asm volatile(SYSCALL : "=a"(result) : "a" (202), "b" (mutex) : "memory");
+    return result;
+}
+
+int sysmutexunlock(int mutex) 
+{
+    int result;
+    asm volatile(SYSCALL : "=a"(result) : "a" (203), "b" (mutex) : "memory");
+    return result;
+}
+
+int sysmutexdestroy(int mutex) 
+{
+    int result;
+    asm volatile(SYSCALL : "=a"(result) : "a" (204), "b" (mutex) : "memory");
+    return result;
+}
+
+int syssemaphorecreate(int count) 
+{
+    int result;
+    asm volatile(SYSCALL : "=a"(result) : "a" (205), "b" (count) : "memory");
+    return result;
+}
+
+// Blocks while the count is 0, then decrements it
+int syssemaphorewait(int semaphore) 
+{
+    int result;
+    asm volatile(SYSCALL : "=a"(result) : "a" (206), "b" (semaphore) : "memory");
+    return result;
+}
+
+int syssemaphoretrywait(int semaphore) 
+{
+    int result;
+    asm volatile(SYSCALL : "=a"(result) : "a" (207), "b" (semaphore) : "memory");
+    return result;
+}
+
+int syssemaphorepost(int semaphore) 
+{
+    int result;
+    asm volatile(SYSCALL : "=a"(result) : "a" (208), "b" (semaphore) : "memory");
+    return result;
+}
+
+int syssemaphoredestroy(int semaphore) 
+{
+    int result;
+    asm volatile(SYSCALL : "=a"(result) : "a" (209), "b" (semaphore) : "memory");
+    return result;
+}
+
+int sysconditioncreate() 
+{
+    int result;
+    asm volatile(SYSCALL : "=a"(result) : "a" (210) : "memory");
+    return result;
+}
+
+// Unlocks the mutex while waiting for a signal, and returns with the mutex locked
+int sysconditionwait(int condition, int mutex) 
+{
+    int result;
+    asm volatile(SYSCALL : "=a"(result) : "a" (211), "b" (condition), "c" (mutex) : "memory");
+    return result;
+}
+
+int sysconditionsignal(int condition) 
+{
+    int result;
+    asm volatile(SYSCALL : "=a"(result) : "a" (212), "b" (condition) : "memory");
+    return result;
+}
+
+int sysconditionbroadcast(int condition) 
+{
+    int result;
+    asm volatile(SYSCALL : "=a"(result) : "a" (213), "b" (condition) : "memory");
+    return result;
+}
+
+int sysconditiondestroy(int condition) 
+{
+    int result;
+    asm volatile(SYSCALL : "=a"(result) : "a" (214), "b" (condition) : "memory");
+    return result;
+}
+
+// Fills descriptors with the read and the write end of a new pipe
+int syspipe(int32_t descriptors[2]) 
+{
+    int result;
+    asm volatile(SYSCALL : "=a"(result) : "a" (42), "b" (descriptors) : "memory");
+    return result;
+}
+
+// Blocks while the pipe is empty, returns 0 at the end of the stream
+int sysread(int descriptor, void* buffer, uint32_t length) 
+{
+    int result;
+    asm volatile(SYSCALL : "=a"(result) : "a" (3), "b" (descriptor), "c" (buffer), "d" (length) : "memory");
+    return result;
+}
+
+// Blocks until the whole buffer is in the pipe
+int syswrite(int descriptor, const void* buffer, uint32_t length) 
+{
+    int result;
+    asm volatile(SYSCALL : "=a"(result) : "a" (4), "b" (descriptor), "c" (buffer), "d" (length) : "memory");
+    return result;
+}
+
+int sysclose(int descriptor) 
+{
+    int result;
+    asm volatile(SYSCALL : "=a"(result) : "a" (6), "b" (descriptor) : "memory");
+    return result;
+}
+
+int sysmqcreate() 
+{
+    int result;
+    asm volatile(SYSCALL : "=a"(result) : "a" (277) : "memory");
+    return result;
+}
+
+int sysmqdestroy(int queue) 
+{
+    int result;
+    asm volatile(SYSCALL : "=a"(result) : "a" (278), "b" (queue) : "memory");
+    return result;
+}
+
+// Blocks while the queue is full
+int sysmqsend(int queue, const void* message, uint32_t length) 
+{
+    int result;
+    asm volatile(SYSCALL : "=a"(result) : "a" (279), "b" (queue), "c" (message), "d" (length) : "memory");
+    return result;
+}
+
+// Blocks while the queue is empty, returns the length of the message
+int sysmqreceive(int queue, void* buffer, uint32_t size) 
+{
+    int result;
+    asm volatile(SYSCALL : "=a"(result) : "a" (280), "b" (queue), "c" (buffer), "d" (size) : "memory");
+    return result;
+}
+
+// Paces the output of the programs. Sleeping leaves the CPU to the other tasks, the delay loop uses the whole time slice.
+void programDelay() 
+{
+    if (useSleepInPrograms) {
+        syssleep(programSleepMilliseconds);
+    }
+    else {
+        Helper::Delay();
+    }
 }
 
 int sysrand() 
@@ -266,6 +608,135 @@ int sysrand()
     return num;
 }
 
+// Prints the counters of the kernel heap, the live allocations by size and how fragmented the free memory is
+void heapReport() 
+{
+    HeapStatistics statistics;
+    if (sysheapstatistics(&statistics) != 0)
+        return;
+    
+    printf("heap: ");
+    printInteger(statistics.regions);
+    printf(" regions ");
+    printInteger(statistics.heapBytes / 1024);
+    printf(" KiB, in use ");
+    printInteger(statistics.bytesInUse);
+    printf(" peak ");
+    printInteger(statistics.peakBytesInUse);
+    printf(" live ");
+    printInteger(statistics.liveAllocations);
+    printf("\nmalloc ");
+    printInteger(statistics.mallocs);
+    printf(" free ");
+    printInteger(statistics.frees);
+    printf(" failed ");
+    printInteger(statistics.failures);
+    printf("\n");
+    
+    for (uint32_t i = 0; i < HEAP_NUM_SIZE_CLASSES; ++i) {
+        if (statistics.liveAllocationsBySize[i] == 0)
+            continue;
+        if (i < HEAP_NUM_SIZE_CLASSES - 1) {
+            printf("<=");
+            printInteger(16 << i);
+        }
+        else {
+            printf(">");
+            printInteger(16 << (i - 1));
+        }
+        printf(": ");
+        printInteger(statistics.liveAllocationsBySize[i]);
+        printf(" ");
+    }
+    printf("\nfree ");
+    printInteger(statistics.freeBytes);
+    printf(" in ");
+    printInteger(statistics.freeBlocks);
+    printf(" blocks, largest ");
+    printInteger(statistics.largestFreeBlock);
+    printf(" fragmentation ");
+    printInteger(statistics.fragmentation);
+    printf("%");
+    if (statistics.corruptBlocks != 0)
+        printf(" CORRUPT");
+    printf("\n");
+    
+    for (uint32_t i = 0; i < statistics.numCallSites; ++i) {
+        printfHex32(statistics.callSites[i].address);
+        printf(": ");
+        printInteger(statistics.callSites[i].allocations);
+        printf(" allocations ");
+        printInteger(statistics.callSites[i].bytes);
+        printf(" bytes\n");
+    }
+    
+    // The object caches live in the kernel heap, one line for each
+    for (ObjectCache* cache = ObjectCache::First(); cache != 0; cache = cache->Next()) {
+        ObjectCacheStatistics cacheStatistics;
+        cache->GetStatistics(&cacheStatistics);
+        printf((char*) cache->GetName());
+        printf(":");
+        printInteger(cacheStatistics.objectSize);
+        printf(" bytes x");
+        printInteger(cacheStatistics.objectsPerSlab);
+        printf(" slabs");
+        printInteger(cacheStatistics.slabs);
+        printf(" in use");
+        printInteger(cacheStatistics.objectsInUse);
+        printf(" alloc");
+        printInteger(cacheStatistics.allocations);
+        printf(" free");
+        printInteger(cacheStatistics.frees);
+        printf(" grows");
+        printInteger(cacheStatistics.grows);
+        printf(" reaps");
+        printInteger(cacheStatistics.reaps);
+        printf(" failed");
+        printInteger(cacheStatistics.failures);
+        printf("\n");
+    }
+}
+
+// Waits all children of the init process, and prints their metrics in timer ticks if printChildStatistics is set.
+// With printHeapReport, the heap report follows once all of them have exited.
+void waitChildren() 
+{
+    int32_t pid;
+    while ((pid = syswaitpid(-1)) != -1) {
+        TaskStatistics statistics;
+        if (!printChildStatistics || sysgettaskstatistics(TASK_STATISTICS_LAST_CHILD, &statistics) != 0)
+            continue;
+        
+        printf("PID ");
+        printInteger(pid);
+        printf(" response ");
+        printInteger(statistics.firstRunTick - statistics.createdTick);
+        printf(" turnaround ");
+        printInteger(statistics.exitTick - statistics.createdTick);
+        printf(" wait ");
+        printInteger(statistics.waitTicks);
+        printf(" cpu ");
+        printInteger(statistics.cpuTicks);
+        printf(" switches ");
+        printInteger(statistics.voluntarySwitches);
+        printf("/");
+        printInteger(statistics.involuntarySwitches);
+        printf("\n");
+    }
+    
+    if (printHeapReport)
+        heapReport();
+}
+
+void syscallLatencyTest();
+
+// Runs the measurements selected in the configuration, each alone before the programs of the lifecycle start
+void runStartupTests() 
+{
+    if (runSyscallLatencyTest)
+        syswaitpid(sysspawn(syscallLatencyTest, Priority::High));
+}
+
 /* HOMEWORK TASKS */
 void collatz() 
 {
@@ -287,7 +758,7 @@ void collatz()
             printf(" ");
         }
         printf("\n");
-        Helper::Delay();
+        programDelay();
     }
     
     sysexit();
@@ -305,7 +776,7 @@ void longRunningProgram()
     printf("Result: ");
     printInteger(result);
     printf("\n");
-    Helper::Delay();
+    programDelay();
     sysexit();
 }
 
@@ -336,7 +807,7 @@ void binarySearch()
         printf(" ");
     }
     printf("\n");
-    Helper::Delay();
+    programDelay();
     
     // Binary search
     int li = 0;
@@ -358,7 +829,7 @@ void binarySearch()
     printf("Result: ");
     printInteger(resIdx);
     printf("\n");
-    Helper::Delay();
+    programDelay();
     sysexit();
 }
 
@@ -378,47 +849,34 @@ void linearSearch()
     printf("Result: ");
     printInteger(resIdx);
     printf("\n"); 
-    Helper::Delay();
+    programDelay();
     sysexit();
 }
 
 void initA()
 {
-    sysfork();
-    if (sysforkpid() == 0) {
-        sysexecve(collatz);
-    }
-    sysfork();
-    if (sysforkpid() == 0) {
-        sysexecve(collatz);
-    }
-    sysfork();
-    if (sysforkpid() == 0) {
-        sysexecve(collatz);
-    }
+    runStartupTests();
     
+    sysspawn(collatz, Priority::High);
+    sysspawn(collatz, Priority::High);
+    sysspawn(collatz, Priority::High);
     
-    sysfork();
-    if (sysforkpid() == 0) {
-        sysexecve(longRunningProgram);
-    }
-    sysfork();
-    if (sysforkpid() == 0) {
-        sysexecve(longRunningProgram);
-    }
-    sysfork();
-    if (sysforkpid() == 0) {
-        sysexecve(longRunningProgram);
-    }
     
-    while (syswaitpid(-1) != -1);
+    sysspawn(longRunningProgram, Priority::High);
+    sysspawn(longRunningProgram, Priority::High);
+    sysspawn(longRunningProgram, Priority::High);
+    
+    waitChildren();
     printf("All programs terminated \n");
     
-    while(1);
+    // Nothing left to do, the idle task halts the CPU from now on
+    sysexit();
 }
 
 void initB1() 
 {
+    runStartupTests();
+    
     void (*entryPoints[]) (void) = {collatz, linearSearch, binarySearch, longRunningProgram};
     
     int randNumber = sysrand() % 4;
@@ -426,22 +884,25 @@ void initB1()
     printInteger(randNumber);
     printf("\n");
     
-    void (*entrypoint)() = entryPoints[randNumber];
+    SpawnRequest requests[10];
     for (int i = 0; i < 10; ++i) {
-        sysfork();
-        if (sysforkpid() == 0) {
-            sysexecve(entrypoint);
-        }
+        requests[i].entrypoint = entryPoints[randNumber];
+        requests[i].priority = Priority::High;
+        requests[i].stackSize = 0;
     }
+    sysspawnbatch(requests, 10);
  
-    while (syswaitpid(-1) != -1);
+    waitChildren();
     printf("All programs terminated \n");
     
-    while(1);
+    // Nothing left to do, the idle task halts the CPU from now on
+    sysexit();
 }
 
 void initB2() 
 {
+    runStartupTests();
+    
     void (*entryPoints[]) (void) = {collatz, linearSearch, binarySearch, longRunningProgram};
     
     int randNumber1 = sysrand() % 4;
@@ -457,105 +918,64 @@ void initB2()
     printInteger(randNumber2);
     printf("\n");
     
-    void (*entrypoint1)() = entryPoints[randNumber1];
-    void (*entrypoint2)() = entryPoints[randNumber2];
-
-    for (int i = 0; i < 3; ++i) {
-        sysfork();
-        if (sysforkpid() == 0) {
-            sysexecve(entrypoint1);
-        }
+    SpawnRequest requests[6];
+    for (int i = 0; i < 6; ++i) {
+        requests[i].entrypoint = i < 3 ? entryPoints[randNumber1] : entryPoints[randNumber2];
+        requests[i].priority = Priority::High;
+        requests[i].stackSize = 0;
     }
+    sysspawnbatch(requests, 6);
     
-    for (int i = 0; i < 3; ++i) {
-        sysfork();
-        if (sysforkpid() == 0) {
-            sysexecve(entrypoint2);
-        }
-    }
-    
-    while (syswaitpid(-1) != -1);
+    waitChildren();
     printf("All programs terminated \n");
     
-    while(1);
+    // Nothing left to do, the idle task halts the CPU from now on
+    sysexit();
 }
 
 
 void initB3()
 {
-    sysfork();
-    if (sysforkpid() == 0) {
-        sysexecve(&collatz);
-    }
-    syssetlasttaskpriority(Priority::Low);
+    runStartupTests();
+    
+    sysspawn(&collatz, Priority::Low);
     syscollatzadded();
     sysblockforcollatz();
     
     // Init other tasks like that
-    sysfork();
-    if (sysforkpid() == 0) {
-        sysexecve(&longRunningProgram);
-    }
-    syssetlasttaskpriority(Priority::Low);
-    
-    sysfork();
-    if (sysforkpid() == 0) {
-        sysexecve(&binarySearch);
-    }
-    syssetlasttaskpriority(Priority::Low);
+    sysspawn(&longRunningProgram, Priority::Low);
+    sysspawn(&binarySearch, Priority::Low);
+    sysspawn(&linearSearch, Priority::Low);
     
-    sysfork();
-    if (sysforkpid() == 0) {
-        sysexecve(&linearSearch);
-    }
-    syssetlasttaskpriority(Priority::Low);
-    
-    while (syswaitpid(-1) != -1);
+    waitChildren();
     printf("All programs terminated \n");
     
-    while(1);
+    // Nothing left to do, the idle task halts the CPU from now on
+    sysexit();
 }
 
 void initB4()
 {
+    runStartupTests();
+    
     taskManager->SetIgnoreSchedule(true);
     
     // Critical region: Prepare ready queue before start scheduling
-    sysfork();
-    if (sysforkpid() == 0) {
-        sysexecve(&collatz);
-    }
-    syssetlasttaskpriority(Priority::Low);
+    sysspawn(&collatz, Priority::Low);
     syscollatzadded();
     
-    
-    sysfork();
-    if (sysforkpid() == 0) {
-        sysexecve(&longRunningProgram);
-    }
-    syssetlasttaskpriority(Priority::Medium);
-    
-    
-    sysfork();
-    if (sysforkpid() == 0) {
-        sysexecve(&binarySearch);
-    }
-    syssetlasttaskpriority(Priority::Medium);
-    
-    
-    sysfork();
-    if (sysforkpid() == 0) {
-        sysexecve(&linearSearch);
-    }
-    syssetlasttaskpriority(Priority::Medium);
+    sysspawn(&longRunningProgram, Priority::Medium);
+    sysspawn(&binarySearch, Priority::Medium);
+    sysspawn(&linearSearch, Priority::Medium);
     
     
     taskManager->SetIgnoreSchedule(false);
 
-    while (syswaitpid(-1) != -1);
+    waitChildren();
     printf("All programs terminated \n");
     
-    while(1);
+    // Nothing left to do, the idle task halts the CPU from now on
+    sysexit();
 }
 
 /* SYSTEM CALL TESTS */
@@ -631,45 +1051,137 @@ void forkExecveWaitTest() {
     while (1);
 }
 
+// The producer writes more than fits into the pipe at once, the consumer reads until the end of the stream
+int32_t pipeDescriptors[2];
+uint8_t pipeData[10000];
+
+void pipeConsumer() 
+{
+    sysclose(pipeDescriptors[1]); // Otherwise the stream never ends
+    
+    uint8_t buffer[512];
+    uint32_t total = 0;
+    uint32_t sum = 0;
+    int length;
+    while ((length = sysread(pipeDescriptors[0], buffer, sizeof(buffer))) > 0) {
+        for (int i = 0; i < length; ++i) sum += buffer[i];
+        total += length;
+    }
+    
+    printf("Consumer read ");
+    printInteger(total);
+    printf(" bytes, checksum ");
+    printInteger(sum);
+    printf("\n");
+    sysexit();
+}
+
+void pipeTest() 
+{
+    uint32_t sum = 0;
+    for (int i = 0; i < sizeof(pipeData); ++i) {
+        pipeData[i] = i;
+        sum += pipeData[i];
+    }
+    
+    syspipe(pipeDescriptors);
+    sysfork();
+    if (sysforkpid() == 0) {
+        sysexecve(pipeConsumer);
+    }
+    
+    sysclose(pipeDescriptors[0]);
+    int written = syswrite(pipeDescriptors[1], pipeData, sizeof(pipeData));
+    sysclose(pipeDescriptors[1]);
+    
+    printf("Producer wrote ");
+    printInteger(written);
+    printf(" bytes, checksum ");
+    printInteger(sum);
+    printf("\n");
+    syswaitpid(-1);
+    sysexit();
+}
+
+// Average time stamp counter cycles of a system call which does almost nothing, made through the given entry,
+// or of reading the same value from the kernel data page if entry is 0
+uint32_t measureSyscall(void (*entry)(), uint32_t rounds) 
+{
+    void (*previousEntry)() = syscallEntry;
+    if (entry != 0) syscallEntry = entry;
+    
+    uint32_t start, end, high;
+    uint32_t sum = 0;
+    asm volatile("rdtsc" : "=a" (start), "=d" (high));
+    for (uint32_t i = 0; i < rounds; ++i) {
+        uint32_t forkPid;
+        if (entry != 0) asm volatile(SYSCALL : "=a"(forkPid) : "a" (58));
+        else forkPid = sysforkpid();
+        sum += forkPid;
+    }
+    asm volatile("rdtsc" : "=a" (end), "=d" (high));
+    
+    syscallEntry = previousEntry;
+    asm volatile("" : : "r" (sum)); // Keeps the calls
+    return (end - start) / rounds;
+}
+
+void syscallLatencyTest() 
+{
+    printf("Null system call: int 0x80 ");
+    printInteger(measureSyscall(&SyscallHandler::InterruptSyscall, 10000));
+    printf(" cycles");
+    if (syscallEntry == &SyscallHandler::FastSyscall) {
+        printf(", sysenter ");
+        printInteger(measureSyscall(&SyscallHandler::FastSyscall, 10000));
+        printf(" cycles");
+    }
+    if (kernelData != 0) {
+        printf(", kernel data page ");
+        printInteger(measureSyscall(0, 10000));
+        printf(" cycles");
+    }
+    printf("\n");
+    printf("System call 58 was called ");
+    printInteger(syssyscallcount(58));
+    printf(" times\n");
+    sysexit();
+}
+
 void startInitProcess(GlobalDescriptorTable* gdt) 
 {
     if (lifeCycleType == LifeCycleType::LifeCycleA) 
     {
-        Task task1(gdt, initA); 
-        taskManager->AddTask(&task1, Priority::High, -1);
+        taskManager->AddTask(initA, Priority::High, -1, initStackSize);
     }
     else if (lifeCycleType == LifeCycleType::LifeCycleB1) 
     {
-        Task task1(gdt, initB1); 
-        taskManager->AddTask(&task1, Priority::High, -1);
+        taskManager->AddTask(initB1, Priority::High, -1, initStackSize);
     }
     else if (lifeCycleType == LifeCycleType::LifeCycleB2) 
     {
-        Task task1(gdt, initB2); 
-        taskManager->AddTask(&task1, Priority::High, -1);
+        taskManager->AddTask(initB2, Priority::High, -1, initStackSize);
     }
     else if (lifeCycleType == LifeCycleType::LifeCycleB3) 
     {
-        if (schedulerType == SchedulerType::RoundRobin) 
+        if (schedulerType != SchedulerType::PreemptivePriority) 
         {
             printf("Scheduler type MUST be PreemptivePriority for lifecycle B3 and B4 \n");
         }
         else 
         {
-            Task task1(gdt, initB3); 
-            taskManager->AddTask(&task1, Priority::High, -1);
+            taskManager->AddTask(initB3, Priority::High, -1, initStackSize);
         }
     }
     else if (lifeCycleType == LifeCycleType::LifeCycleB4) 
     {
-        if (schedulerType == SchedulerType::RoundRobin) 
+        if (schedulerType != SchedulerType::PreemptivePriority) 
         {
             printf("Scheduler type MUST be PreemptivePriority for lifecycle B3 and B4 \n");
         }
         else 
         {
-            Task task1(gdt, initB4); 
-            taskManager->AddTask(&task1, Priority::High, -1);
+            taskManager->AddTask(initB4, Priority::High, -1, initStackSize);
         }
     }
 }
@@ -686,6 +1198,8 @@ extern "C" void callConstructors()
 }
 
 
+extern "C" uint8_t kernel_end[]; // From linker.ld
+
 extern "C" void kernelMain(const void* multiboot_structure, uint32_t /*multiboot_magic*/)
 {
     printf("Hello World! --- OS by Emre Oytun \n\n\n\n\n\n\n");
@@ -693,15 +1207,14 @@ extern "C" void kernelMain(const void* multiboot_structure, uint32_t /*multiboot
     GlobalDescriptorTable gdt;
     gdtRef = &gdt;
     
-    uint32_t* memupper = (uint32_t*)(((size_t)multiboot_structure) + 8);
-    size_t heap = 10*1024*1024;
-    MemoryManager memoryManager(heap, (*memupper)*1024 - heap - 10*1024);
+    // All RAM after the kernel is in blocks of the buddy allocator, the heap takes blocks from it as it grows
+    BuddyAllocator buddyAllocator(multiboot_structure, (uint32_t) kernel_end);
+    MemoryManager memoryManager(0, 0);
+    memoryManager.SetBuddyAllocator(&buddyAllocator);
     
-    printf("heap: 0x");
-    printfHex((heap >> 24) & 0xFF);
-    printfHex((heap >> 16) & 0xFF);
-    printfHex((heap >> 8 ) & 0xFF);
-    printfHex((heap      ) & 0xFF);
+    printf("memory: ");
+    printInteger(buddyAllocator.UsableFrames() * (PAGE_SIZE / 1024));
+    printf(" KiB");
     
     void* allocated = memoryManager.malloc(1024);
     printf("\nallocated: 0x");
@@ -711,11 +1224,40 @@ extern "C" void kernelMain(const void* multiboot_structure, uint32_t /*multiboot
     printfHex(((size_t)allocated      ) & 0xFF);
     printf("\n");
     
+    // Physical frames for the demand paged, copy-on-write task stacks
+    PageFrameAllocator frameAllocator(&buddyAllocator);
+    PagingManager paging(&gdt, &frameAllocator);
+    paging.Activate();
+    
     taskManager = new TaskManager(&gdt, schedulerType, lifeCycleType, processTablePrintType, useDelayInPrintingProcessTable);
+    
+    // Tasks read their pids and the time from this page without a system call
+    uint32_t kernelDataFrame = paging.MapSharedPage(KERNEL_DATA_ADDRESS);
+    if (kernelDataFrame != 0) {
+        taskManager->SetKernelData((KernelData*) kernelDataFrame);
+        kernelData = (KernelData*) KERNEL_DATA_ADDRESS;
+    }
     startInitProcess(&gdt);
     
+    for (int i = 0; i < 3; ++i) {
+        taskManager->SetQuantum((Priority) i, quantumTicks[i]);
+    }
+    taskManager->SetAgingTicks(agingTicks);
+    
     InterruptManager interrupts(0x20, &gdt, taskManager);
+    interrupts.SetTaskGate(0x0E, paging.PageFaultTaskSegmentSelector());
     SyscallHandler syscalls(&interrupts, 0x80, taskManager);
+    if (useFastSyscalls && SyscallHandler::EnableFastSyscalls(&gdt, 0)) {
+        syscallEntry = &SyscallHandler::FastSyscall;
+    }
+    FloatingPointUnit fpu(&interrupts, taskManager);
+    
+    ProgrammableIntervalTimer timer;
+    taskManager->SetTimerFrequency(timer.SetFrequency(timerFrequency));
+    
+    // The other CPUs wait for the interrupts to be activated before they start scheduling
+    MultiprocessorManager multiprocessor(&paging, taskManager);
+    multiprocessor.StartApplicationProcessors(maxNumCpus, timer.GetFrequency());
     
     // Initialize hardware(drivers) before activating interrupt manager
     printf("Initializing Hardware, Stage 1\n");
@@ -798,6 +1340,8 @@ extern "C" void kernelMain(const void* multiboot_structure, uint32_t /*multiboot
     {
         #ifdef GRAPHICSMODE
             desktop.Draw(&vga);
+        #else
+            asm volatile("hlt"); // Only until the first timer interrupt switches to the init process
         #endif
     }
 }
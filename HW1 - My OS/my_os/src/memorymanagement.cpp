@@ -1,15 +1,139 @@
  
 #include <memorymanagement.h>
+#include <paging.h>
 
 using namespace myos;
 using namespace myos::common;
 
 
 MemoryManager* MemoryManager::activeMemoryManager = 0;
-        
+
+// Room for the headers at both ends of a new region, with some to spare
+const size_t HEAP_REGION_OVERHEAD = 64;
+
+// Distinct callers a walk of the heap can tell apart
+const uint32_t HEAP_WALK_CALL_SITES = 64;
+
+// Index of the highest and the lowest set bit, x must not be 0
+static inline uint32_t HighestBit(uint32_t x)
+{
+    uint32_t index;
+    asm("bsr %1, %0" : "=r" (index) : "rm" (x));
+    return index;
+}
+
+static inline uint32_t LowestBit(uint32_t x)
+{
+    uint32_t index;
+    asm("bsf %1, %0" : "=r" (index) : "rm" (x));
+    return index;
+}
+
+static inline uint32_t SizeClass(size_t size)
+{
+    uint32_t sizeClass = size <= 16 ? 0 : HighestBit(size - 1) - 3;
+    return sizeClass < HEAP_NUM_SIZE_CLASSES ? sizeClass : HEAP_NUM_SIZE_CLASSES - 1;
+}
+
+MemoryManager::~MemoryManager()
+{
+    if(activeMemoryManager == this)
+        activeMemoryManager = 0;
+}
+
+void MemoryManager::SetBuddyAllocator(BuddyAllocator* buddyAllocator)
+{
+    this->buddyAllocator = buddyAllocator;
+}
+
+void MemoryManager::CountMalloc(size_t size)
+{
+    ++statistics.mallocs;
+    ++statistics.liveAllocations;
+    ++statistics.liveAllocationsBySize[SizeClass(size)];
+    statistics.bytesInUse += size;
+    if(statistics.bytesInUse > statistics.peakBytesInUse)
+        statistics.peakBytesInUse = statistics.bytesInUse;
+}
+
+void MemoryManager::CountFree(size_t size)
+{
+    ++statistics.frees;
+    --statistics.liveAllocations;
+    --statistics.liveAllocationsBySize[SizeClass(size)];
+    statistics.bytesInUse -= size;
+}
+
+void MemoryManager::CountCallSite(HeapCallSite* callSites, uint32_t* numCallSites, uint32_t maxCallSites, uint32_t address, size_t size)
+{
+    uint32_t i = 0;
+    while(i < *numCallSites && callSites[i].address != address)
+        ++i;
+    if(i == *numCallSites)
+    {
+        if(i == maxCallSites)
+            return;
+        callSites[i].address = address;
+        callSites[i].allocations = 0;
+        callSites[i].bytes = 0;
+        ++*numCallSites;
+    }
+    ++callSites[i].allocations;
+    callSites[i].bytes += size;
+}
+
+// Fills in what follows from the walk: the fragmentation and the callers with the most bytes
+static void FinishWalk(HeapStatistics* statistics, HeapCallSite* callSites, uint32_t numCallSites)
+{
+    // Scaled down so the product fits in 32 bits
+    uint32_t freeBytes = statistics->freeBytes;
+    uint32_t largestFreeBlock = statistics->largestFreeBlock;
+    while(freeBytes >= 0x1000000)
+    {
+        freeBytes >>= 1;
+        largestFreeBlock >>= 1;
+    }
+    statistics->fragmentation = freeBytes == 0 ? 0 : (freeBytes - largestFreeBlock) * 100 / freeBytes;
+    
+    statistics->numCallSites = 0;
+    while(statistics->numCallSites < HEAP_MAX_CALL_SITES && numCallSites > 0)
+    {
+        uint32_t largest = 0;
+        for(uint32_t i = 1; i < numCallSites; ++i)
+            if(callSites[i].bytes > callSites[largest].bytes)
+                largest = i;
+        statistics->callSites[statistics->numCallSites++] = callSites[largest];
+        callSites[largest] = callSites[--numCallSites];
+    }
+}
+
+// Adds a block of the buddy allocator big enough for size bytes as a new region. It takes 4 MiB if it can, so the heap
+// grows in few pieces, and smaller blocks when memory runs low.
+bool MemoryManager::Grow(size_t size)
+{
+    if(buddyAllocator == 0 || size > (PAGE_SIZE << BUDDY_MAX_ORDER))
+        return false;
+    
+    uint32_t minOrder = BuddyAllocator::Order(size + HEAP_REGION_OVERHEAD);
+    for(uint32_t order = BUDDY_MAX_ORDER + 1; order > minOrder; --order)
+    {
+        uint32_t address = buddyAllocator->Allocate(order - 1);
+        if(address != 0)
+        {
+            AddRegion(address, PAGE_SIZE << (order - 1));
+            return true;
+        }
+    }
+    return false;
+}
+
+#ifdef FIRSTFIT_HEAP
+
 MemoryManager::MemoryManager(size_t start, size_t size)
 {
     activeMemoryManager = this;
+    buddyAllocator = 0;
+    statistics = HeapStatistics();
     
     if(size < sizeof(MemoryChunk))
     {
@@ -23,16 +147,13 @@ MemoryManager::MemoryManager(size_t start, size_t size)
         first -> prev = 0;
         first -> next = 0;
         first -> size = size - sizeof(MemoryChunk);
+        
+        statistics.regions = 1;
+        statistics.heapBytes = size;
     }
 }
 
-MemoryManager::~MemoryManager()
-{
-    if(activeMemoryManager == this)
-        activeMemoryManager = 0;
-}
-        
-void* MemoryManager::malloc(size_t size)
+void* MemoryManager::malloc(size_t size, uint32_t callSite)
 {
     MemoryChunk *result = 0;
     
@@ -40,8 +161,13 @@ void* MemoryManager::malloc(size_t size)
         if(chunk->size > size && !chunk->allocated)
             result = chunk;
         
+    if(result == 0 && Grow(size) && first->size > size)
+        result = first; // The new region is at the front of the list
     if(result == 0)
+    {
+        ++statistics.failures;
         return 0;
+    }
     
     if(result->size >= size + sizeof(MemoryChunk) + 1)
     {
@@ -59,14 +185,21 @@ void* MemoryManager::malloc(size_t size)
     }
     
     result->allocated = true;
+#ifdef HEAP_CALL_SITES
+    result->callSite = callSite != 0 ? callSite : (uint32_t)__builtin_return_address(0);
+#endif
+    CountMalloc(result->size);
     return (void*)(((size_t)result) + sizeof(MemoryChunk));
 }
 
 void MemoryManager::free(void* ptr)
 {
+    if(ptr == 0)
+        return;
     MemoryChunk* chunk = (MemoryChunk*)((size_t)ptr - sizeof(MemoryChunk));
     
     chunk -> allocated = false;
+    CountFree(chunk->size);
     
     if(chunk->prev != 0 && !chunk->prev->allocated)
     {
@@ -88,6 +221,296 @@ void MemoryManager::free(void* ptr)
     
 }
 
+// The region ends with an allocated empty chunk, so its chunks are never merged with the ones after it in the list
+void MemoryManager::AddRegion(size_t start, size_t size)
+{
+    if(size < 2*sizeof(MemoryChunk) + 1)
+        return;
+    
+    MemoryChunk* chunk = (MemoryChunk*)start;
+    MemoryChunk* end = (MemoryChunk*)(start + size - sizeof(MemoryChunk));
+    
+    chunk -> allocated = false;
+    chunk -> prev = 0;
+    chunk -> next = end;
+    chunk -> size = size - 2*sizeof(MemoryChunk);
+    
+    end -> allocated = true;
+    end -> prev = chunk;
+    end -> next = first;
+    end -> size = 0;
+#ifdef HEAP_CALL_SITES
+    end -> callSite = 0;
+#endif
+    if(first != 0)
+        first->prev = end;
+    
+    first = chunk;
+    
+    ++statistics.regions;
+    statistics.heapBytes += size;
+}
+
+void MemoryManager::GetStatistics(HeapStatistics* statistics)
+{
+    *statistics = this->statistics;
+    
+    HeapCallSite callSites[HEAP_WALK_CALL_SITES];
+    uint32_t numCallSites = 0;
+    for(MemoryChunk* chunk = first; chunk != 0; chunk = chunk->next)
+    {
+        if(chunk->next != 0 && chunk->next->prev != chunk)
+        {
+            ++statistics->corruptBlocks;
+            break;
+        }
+        if(chunk->allocated)
+        {
+#ifdef HEAP_CALL_SITES
+            if(chunk->callSite != 0) // Not the chunk at the end of a region
+                CountCallSite(callSites, &numCallSites, HEAP_WALK_CALL_SITES, chunk->callSite, chunk->size);
+#endif
+            continue;
+        }
+        ++statistics->freeBlocks;
+        statistics->freeBytes += chunk->size;
+        if(chunk->size > statistics->largestFreeBlock)
+            statistics->largestFreeBlock = chunk->size;
+    }
+    FinishWalk(statistics, callSites, numCallSites);
+}
+
+#else
+
+static inline size_t BlockSize(MemoryBlock* block)
+{
+    return block->size & ~(size_t)1;
+}
+
+static inline bool IsFree(MemoryBlock* block)
+{
+    return (block->size & 1) != 0;
+}
+
+static inline MemoryBlock* NextBlock(MemoryBlock* block)
+{
+    return (MemoryBlock*)((size_t)block + HEAP_BLOCK_HEADER_SIZE + BlockSize(block));
+}
+
+// The free list which holds blocks of the given size
+static inline void MapSize(size_t size, uint32_t* firstLevel, uint32_t* secondLevel)
+{
+    if (size < (1 << HEAP_FIRST_LEVEL_SHIFT)) {
+        *firstLevel = 0;
+        *secondLevel = size / HEAP_ALIGNMENT;
+    }
+    else {
+        uint32_t highestBit = HighestBit(size);
+        *firstLevel = highestBit - (HEAP_FIRST_LEVEL_SHIFT - 1);
+        *secondLevel = (size >> (highestBit - HEAP_SECOND_LEVEL_LOG2)) - HEAP_NUM_SECOND_LEVELS;
+    }
+}
+
+MemoryManager::MemoryManager(size_t start, size_t size)
+{
+    activeMemoryManager = this;
+    buddyAllocator = 0;
+    statistics = HeapStatistics();
+    firstRegion = 0;
+    
+    firstLevelBitmap = 0;
+    for (uint32_t i = 0; i < HEAP_NUM_FIRST_LEVELS; ++i) {
+        secondLevelBitmaps[i] = 0;
+        for (uint32_t j = 0; j < HEAP_NUM_SECOND_LEVELS; ++j) {
+            freeLists[i][j] = 0;
+        }
+    }
+    
+    AddRegion(start, size);
+}
+
+void MemoryManager::AddRegion(size_t start, size_t size)
+{
+    size_t end = (start + size) & ~(HEAP_ALIGNMENT - 1);
+    start = (start + HEAP_ALIGNMENT - 1) & ~(HEAP_ALIGNMENT - 1);
+    if (end < start || end - start < 3*HEAP_BLOCK_HEADER_SIZE + 2*HEAP_MIN_BLOCK_SIZE)
+        return;
+    
+    // One free block for the whole region and an empty used block at its end, so the last block has a neighbour too.
+    // The block at the end links the regions for GetStatistics.
+    MemoryBlock* block = (MemoryBlock*)start;
+    block->size = end - start - 2*HEAP_BLOCK_HEADER_SIZE - HEAP_MIN_BLOCK_SIZE;
+    block->prevPhysical = 0;
+    MemoryBlock* sentinel = NextBlock(block);
+    sentinel->size = 0;
+    sentinel->prevPhysical = block;
+    sentinel->nextFree = firstRegion;
+    firstRegion = block;
+    InsertFreeBlock(block);
+    
+    ++statistics.regions;
+    statistics.heapBytes += end - start;
+}
+
+void MemoryManager::InsertFreeBlock(MemoryBlock* block)
+{
+    uint32_t firstLevel, secondLevel;
+    MapSize(BlockSize(block), &firstLevel, &secondLevel);
+    
+    block->size |= 1;
+    block->prevFree = 0;
+    block->nextFree = freeLists[firstLevel][secondLevel];
+    if (block->nextFree != 0)
+        block->nextFree->prevFree = block;
+    freeLists[firstLevel][secondLevel] = block;
+    
+    firstLevelBitmap |= 1 << firstLevel;
+    secondLevelBitmaps[firstLevel] |= 1 << secondLevel;
+}
+
+void MemoryManager::RemoveFreeBlock(MemoryBlock* block)
+{
+    uint32_t firstLevel, secondLevel;
+    MapSize(BlockSize(block), &firstLevel, &secondLevel);
+    
+    block->size &= ~(size_t)1;
+    if (block->prevFree != 0)
+        block->prevFree->nextFree = block->nextFree;
+    else
+        freeLists[firstLevel][secondLevel] = block->nextFree;
+    if (block->nextFree != 0)
+        block->nextFree->prevFree = block->prevFree;
+    
+    if (freeLists[firstLevel][secondLevel] == 0) {
+        secondLevelBitmaps[firstLevel] &= ~(1 << secondLevel);
+        if (secondLevelBitmaps[firstLevel] == 0)
+            firstLevelBitmap &= ~(1 << firstLevel);
+    }
+}
+
+// A free block of at least size bytes, or 0. The size is rounded up to the next free list, so that any block of that
+// list or of a bigger one fits without searching a list.
+MemoryBlock* MemoryManager::FindFreeBlock(size_t size)
+{
+    uint32_t firstLevel, secondLevel;
+    MapSize(size, &firstLevel, &secondLevel);
+    MemoryBlock* sameList = freeLists[firstLevel][secondLevel];
+    
+    if (size >= (1 << HEAP_FIRST_LEVEL_SHIFT)) {
+        MapSize(size + (1 << (HighestBit(size) - HEAP_SECOND_LEVEL_LOG2)) - 1, &firstLevel, &secondLevel);
+    }
+    
+    uint32_t secondLevelMap = secondLevelBitmaps[firstLevel] & (~0u << secondLevel);
+    if (secondLevelMap == 0) {
+        // Nothing left in this power of two, take the smallest bigger one
+        uint32_t firstLevelMap = firstLevel + 1 < HEAP_NUM_FIRST_LEVELS ? firstLevelBitmap & (~0u << (firstLevel + 1)) : 0;
+        if (firstLevelMap == 0) {
+            // The first block of the list of the size itself may still be big enough, like the only block of an empty heap
+            return sameList != 0 && BlockSize(sameList) >= size ? sameList : 0;
+        }
+        firstLevel = LowestBit(firstLevelMap);
+        secondLevelMap = secondLevelBitmaps[firstLevel];
+    }
+    return freeLists[firstLevel][LowestBit(secondLevelMap)];
+}
+
+void* MemoryManager::malloc(size_t size, uint32_t callSite)
+{
+    if (size > HEAP_MAX_ALLOCATION) {
+        ++statistics.failures;
+        return 0;
+    }
+    size = (size + HEAP_ALIGNMENT - 1) & ~(HEAP_ALIGNMENT - 1);
+    if (size < HEAP_MIN_BLOCK_SIZE)
+        size = HEAP_MIN_BLOCK_SIZE;
+    
+    MemoryBlock* block = FindFreeBlock(size);
+    if (block == 0 && Grow(size))
+        block = FindFreeBlock(size);
+    if (block == 0) {
+        ++statistics.failures;
+        return 0;
+    }
+    RemoveFreeBlock(block);
+    
+    // Give the rest back as a free block of its own, if it is big enough for one
+    if (block->size >= size + HEAP_BLOCK_HEADER_SIZE + HEAP_MIN_BLOCK_SIZE) {
+        MemoryBlock* rest = (MemoryBlock*)((size_t)block + HEAP_BLOCK_HEADER_SIZE + size);
+        rest->size = block->size - size - HEAP_BLOCK_HEADER_SIZE;
+        rest->prevPhysical = block;
+        NextBlock(rest)->prevPhysical = rest;
+        block->size = size;
+        InsertFreeBlock(rest);
+    }
+    
+#ifdef HEAP_CALL_SITES
+    block->callSite = callSite != 0 ? callSite : (uint32_t)__builtin_return_address(0);
+#endif
+    CountMalloc(block->size);
+    return (void*)((size_t)block + HEAP_BLOCK_HEADER_SIZE);
+}
+
+void MemoryManager::free(void* ptr)
+{
+    if (ptr == 0)
+        return;
+    MemoryBlock* block = (MemoryBlock*)((size_t)ptr - HEAP_BLOCK_HEADER_SIZE);
+    CountFree(block->size);
+    
+    MemoryBlock* next = NextBlock(block);
+    if (IsFree(next)) {
+        RemoveFreeBlock(next);
+        block->size += HEAP_BLOCK_HEADER_SIZE + next->size;
+    }
+    
+    MemoryBlock* prev = block->prevPhysical;
+    if (prev != 0 && IsFree(prev)) {
+        RemoveFreeBlock(prev);
+        prev->size += HEAP_BLOCK_HEADER_SIZE + block->size;
+        block = prev;
+    }
+    
+    NextBlock(block)->prevPhysical = block;
+    InsertFreeBlock(block);
+}
+
+void MemoryManager::GetStatistics(HeapStatistics* statistics)
+{
+    *statistics = this->statistics;
+    
+    HeapCallSite callSites[HEAP_WALK_CALL_SITES];
+    uint32_t numCallSites = 0;
+    for (MemoryBlock* region = firstRegion; region != 0; ) {
+        MemoryBlock* block = region;
+        while (BlockSize(block) != 0) {
+            MemoryBlock* next = NextBlock(block);
+            if (next->prevPhysical != block || (IsFree(block) && IsFree(next)))
+                break;
+            
+            if (IsFree(block)) {
+                ++statistics->freeBlocks;
+                statistics->freeBytes += BlockSize(block);
+                if (BlockSize(block) > statistics->largestFreeBlock)
+                    statistics->largestFreeBlock = BlockSize(block);
+            }
+#ifdef HEAP_CALL_SITES
+            else {
+                CountCallSite(callSites, &numCallSites, HEAP_WALK_CALL_SITES, block->callSite, BlockSize(block));
+            }
+#endif
+            block = next;
+        }
+        if (BlockSize(block) != 0 || IsFree(block)) {
+            // The headers do not fit together, so the end of this region cannot be found
+            ++statistics->corruptBlocks;
+            break;
+        }
+        region = block->nextFree;
+    }
+    FinishWalk(statistics, callSites, numCallSites);
+}
+
+#endif
 
 
 
@@ -95,14 +518,14 @@ void* operator new(unsigned size)
 {
     if(myos::MemoryManager::activeMemoryManager == 0)
         return 0;
-    return myos::MemoryManager::activeMemoryManager->malloc(size);
+    return myos::MemoryManager::activeMemoryManager->malloc(size, (uint32_t)__builtin_return_address(0));
 }
 
 void* operator new[](unsigned size)
 {
     if(myos::MemoryManager::activeMemoryManager == 0)
         return 0;
-    return myos::MemoryManager::activeMemoryManager->malloc(size);
+    return myos::MemoryManager::activeMemoryManager->malloc(size, (uint32_t)__builtin_return_address(0));
 }
 
 void* operator new(unsigned size, void* ptr)
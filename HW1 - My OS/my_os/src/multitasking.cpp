@@ -1,5 +1,6 @@
 
 #include <multitasking.h>
+#include <fpu.h>
 
 using namespace myos;
 using namespace myos::common;
@@ -9,35 +10,76 @@ void printfHex(uint8_t);
 void printfHex32(uint32_t);
 void printInteger(int num);
 
+static inline common::uint64_t ReadTimeStampCounter()
+{
+    common::uint64_t clockCounter;
+    asm volatile("rdtsc" : "=A"(clockCounter));
+    return clockCounter;
+}
+
 
 Task::Task() 
 { 
+    stack = 0; // Taken from the stack pool of TaskManager when the task is added
+    stackSize = 0;
     ppid = -1;
     forkPid = -1;
     waitingChild = false;
     parentTookInWait = false;
+    nextReady = 0;
+    prevReady = 0;
+    readyLevel = 0;
+    inReadyQueue = false;
+    levelSinceTick = 0;
+    mlfqLevel = 0;
+    tickets = STRIDE_DEFAULT_TICKETS;
+    stride = STRIDE_ONE / STRIDE_DEFAULT_TICKETS;
+    pass = 0;
+    heapIndex = 0;
+    realTime = false;
+    period = 0;
+    budget = 0;
+    relativeDeadline = 0;
+    utilization = 0;
+    releaseTick = 0;
+    absoluteDeadline = 0;
+    budgetLeft = 0;
+    readySince = 0;
+    runningSince = 0;
+    readySinceTick = 0;
+    onCpu = false;
+    nextTimer = 0;
+    wakeTick = 0;
+    quantum = 0;
+    sliceTicks = 0;
+    cpu = 0;
+    nextWaiting = 0;
+    prevWaiting = 0;
+    waitQueue = 0;
+    waitLevel = 0;
+    waitingMutex = 0;
+    heldMutexes = 0;
+    usesFpu = false;
+    for (int i = 0; i < MAX_NUM_DESCRIPTORS; ++i) {
+        descriptors[i] = -1;
+    }
+    ipcBuffer = 0;
+    ipcLength = 0;
+    ipcDone = 0;
+    parent = 0;
+    firstChild = 0;
+    nextSibling = 0;
+    prevSibling = 0;
+    zombieHead = 0;
+    zombieTail = 0;
+    nextZombie = 0;
+    prevZombie = 0;
+    numChildren = 0;
+    slotUsed = false;
+    slotGeneration = 0;
+    nextFree = 0;
 }
     
-Task::Task(GlobalDescriptorTable *gdt, void entrypoint())
-{
-    ppid = -1;
-    forkPid = -1;
-    waitingChild = false;
-    parentTookInWait = false;
-    
-    Reset(gdt, entrypoint);
-}
-
-Task::Task(const Task& task)
-{
-    ppid = -1;
-    forkPid = -1;
-    waitingChild = false;
-    parentTookInWait = false;
-    
-    this->Copy(&task);
-}
-
 Task::~Task() 
 { 
     
@@ -45,7 +87,7 @@ Task::~Task()
 
 void Task::Reset(GlobalDescriptorTable* gdt, void entrypoint()) {
     // Allocate stack memory for the CPUState of this task.
-    cpustate = (CPUState*)(stack + MAX_STACK_SIZE - sizeof(CPUState));
+    cpustate = (CPUState*)(stack + stackSize - sizeof(CPUState));
     
     // Initialize register of this task/process.
     cpustate -> eax = 0;
@@ -62,111 +104,1781 @@ void Task::Reset(GlobalDescriptorTable* gdt, void entrypoint()) {
     cpustate -> eflags = 0x202;
 }
 
-void Task::Copy(const Task* oth) 
+bool Task::Copy(const Task* oth) 
+{
+    // Both stacks have the same size, so cpustate is at the same offset in the copy
+    this->cpustate = (CPUState*) (this->stack - (oth->stack - (uint8_t*) oth->cpustate));
+    
+    // Share the used part of the stack copy-on-write instead of copying it byte by byte
+    return PagingManager::activePagingManager->CloneStack((uint32_t) this->stack, (uint32_t) oth->stack, stackSize, (uint32_t) oth->cpustate);
+}
+
+void Task::CopyCpuState(CPUState* cpustate) 
+{
+    *(this->cpustate) = *cpustate;
+}
+
+CPUState* Task::GetCPUState() { return cpustate; }
+void Task::SetCPUState(CPUState* cpustate) { this->cpustate = cpustate; }
+
+Priority Task::GetPriority() { return priority; }
+void Task::SetPriority(Priority priority) { this->priority = priority; this->basePriority = priority; }
+
+common::int32_t Task::GetPid() { return pid; }
+void Task::SetPid(common::int32_t pid) { this->pid = pid; }
+
+common::int32_t Task::GetPPid() { return ppid; }
+void Task::SetPPid(common::int32_t ppid) { this->ppid = ppid; }
+
+State Task::GetState() { return this->state; }
+void Task::SetState(State state) { this->state = state; }
+
+bool Task::GetParentTookInWait() { return this->parentTookInWait; }
+void Task::SetParentTookInWait(bool parentTookInWait) { this->parentTookInWait = parentTookInWait; }
+
+common::int32_t Task::GetArrivalOrder() { return this->arrivalOrder; }
+void Task::SetArrivalOrder(common::int32_t arrivalOrder) { this->arrivalOrder = arrivalOrder; }
+
+
+
+
+ReadyQueue::ReadyQueue()
+{
+    for (int i = 0; i < NUM_READY_LEVELS; ++i) {
+        heads[i] = 0;
+        tails[i] = 0;
+    }
+    bitmap = 0;
+    length = 0;
+    order = OrderByLevel;
+}
+
+void ReadyQueue::SetOrder(ReadyQueueOrder order)
+{
+    this->order = order;
+}
+
+void ReadyQueue::PushBack(Task* task, common::uint32_t level)
+{
+    if (task->inReadyQueue) {
+        Remove(task);
+    }
+    if (order != OrderByLevel) {
+        PushHeap(task);
+        return;
+    }
+    
+    task->readyLevel = level;
+    task->nextReady = 0;
+    task->prevReady = tails[level];
+    
+    if (tails[level] != 0) tails[level]->nextReady = task;
+    else heads[level] = task;
+    tails[level] = task;
+    
+    task->inReadyQueue = true;
+    bitmap |= (1u << level);
+    ++length;
+}
+
+void ReadyQueue::PushFront(Task* task, common::uint32_t level)
+{
+    if (task->inReadyQueue) {
+        Remove(task);
+    }
+    if (order != OrderByLevel) {
+        PushHeap(task);
+        return;
+    }
+    
+    task->readyLevel = level;
+    task->prevReady = 0;
+    task->nextReady = heads[level];
+    
+    if (heads[level] != 0) heads[level]->prevReady = task;
+    else tails[level] = task;
+    heads[level] = task;
+    
+    task->inReadyQueue = true;
+    bitmap |= (1u << level);
+    ++length;
+}
+
+Task* ReadyQueue::PopFront()
+{
+    if (order != OrderByLevel) {
+        if (length == 0)
+            return 0; // null
+        Task* task = heap[0];
+        RemoveHeap(task);
+        return task;
+    }
+    
+    if (bitmap == 0)
+        return 0; // null
+    
+    // The lowest set bit is the highest priority non-empty level (find-first-set)
+    Task* task = heads[__builtin_ctz(bitmap)];
+    Remove(task);
+    return task;
+}
+
+void ReadyQueue::Remove(Task* task)
+{
+    if (!task->inReadyQueue)
+        return;
+    if (order != OrderByLevel) {
+        RemoveHeap(task);
+        return;
+    }
+    
+    common::uint32_t level = task->readyLevel;
+    
+    if (task->prevReady != 0) task->prevReady->nextReady = task->nextReady;
+    else heads[level] = task->nextReady;
+    
+    if (task->nextReady != 0) task->nextReady->prevReady = task->prevReady;
+    else tails[level] = task->prevReady;
+    
+    if (heads[level] == 0) {
+        bitmap &= ~(1u << level);
+    }
+    
+    task->nextReady = 0;
+    task->prevReady = 0;
+    task->inReadyQueue = false;
+    --length;
+}
+
+bool ReadyQueue::IsEmpty() { return length == 0; }
+
+common::uint32_t ReadyQueue::HighestLevel()
+{
+    if (order != OrderByLevel)
+        return length == 0 ? NUM_READY_LEVELS : 0;
+    if (bitmap == 0)
+        return NUM_READY_LEVELS;
+    return __builtin_ctz(bitmap);
+}
+int ReadyQueue::Length() { return length; }
+
+Task* ReadyQueue::First()
+{
+    if (order != OrderByLevel)
+        return length == 0 ? 0 : heap[0];
+    if (bitmap == 0)
+        return 0;
+    return heads[__builtin_ctz(bitmap)];
+}
+
+Task* ReadyQueue::Head(common::uint32_t level)
+{
+    return heads[level];
+}
+
+// In a heap only the first task is in dispatch order, the rest follow in heap order
+Task* ReadyQueue::Next(Task* task)
+{
+    if (order != OrderByLevel)
+        return task->heapIndex + 1 < length ? heap[task->heapIndex + 1] : 0;
+    if (task->nextReady != 0)
+        return task->nextReady;
+    
+    // Continue with the next non-empty level after this one
+    common::uint32_t rest = (task->readyLevel + 1 < NUM_READY_LEVELS) ? bitmap & ~((2u << task->readyLevel) - 1) : 0;
+    if (rest == 0)
+        return 0;
+    return heads[__builtin_ctz(rest)];
+}
+
+void ReadyQueue::PushHeap(Task* task)
+{
+    task->heapIndex = length;
+    heap[length] = task;
+    ++length;
+    task->inReadyQueue = true;
+    SiftUp(task->heapIndex);
+}
+
+void ReadyQueue::RemoveHeap(Task* task)
+{
+    // The last task fills the hole and moves up or down to its place
+    common::uint32_t index = task->heapIndex;
+    --length;
+    if (index < length) {
+        heap[index] = heap[length];
+        heap[index]->heapIndex = index;
+        SiftUp(index);
+        SiftDown(heap[index]->heapIndex);
+    }
+    task->inReadyQueue = false;
+}
+
+// Deadlines are compared by their distance so that they can wrap around
+bool ReadyQueue::Before(Task* task, Task* other)
+{
+    if (order == OrderByPass)
+        return task->pass < other->pass;
+    return (common::int32_t) (task->absoluteDeadline - other->absoluteDeadline) < 0;
+}
+
+void ReadyQueue::SiftUp(common::uint32_t index)
+{
+    Task* task = heap[index];
+    while (index > 0) {
+        common::uint32_t parent = (index - 1) / 2;
+        if (!Before(task, heap[parent]))
+            break;
+        heap[index] = heap[parent];
+        heap[index]->heapIndex = index;
+        index = parent;
+    }
+    heap[index] = task;
+    task->heapIndex = index;
+}
+
+void ReadyQueue::SiftDown(common::uint32_t index)
+{
+    Task* task = heap[index];
+    while (true) {
+        common::uint32_t child = 2 * index + 1;
+        if (child >= length)
+            break;
+        if (child + 1 < length && Before(heap[child + 1], heap[child]))
+            ++child;
+        if (!Before(heap[child], task))
+            break;
+        heap[index] = heap[child];
+        heap[index]->heapIndex = index;
+        index = child;
+    }
+    heap[index] = task;
+    task->heapIndex = index;
+}
+
+
+
+
+
+
+TimerWheel::TimerWheel()
+{
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; ++level) {
+        for (int slot = 0; slot < TIMER_WHEEL_SLOTS; ++slot) {
+            heads[level][slot] = 0;
+            tails[level][slot] = 0;
+        }
+    }
+    currentTick = 1; // The task manager counts a tick before it advances the wheel, so the first Advance is tick 1
+    length = 0;
+}
+
+void TimerWheel::Insert(Task* task, common::uint32_t wakeTick)
+{
+    task->wakeTick = wakeTick;
+    Place(task);
+    ++length;
+}
+
+// Puts the task into the lowest level whose range covers the time left until its wake tick
+void TimerWheel::Place(Task* task)
+{
+    const common::uint32_t maxDelta = (1u << (TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOT_BITS)) - 1;
+    
+    common::int32_t delta = (common::int32_t)(task->wakeTick - currentTick);
+    common::uint32_t wakeTick = task->wakeTick;
+    if (delta < 0) {
+        delta = 0;
+        wakeTick = currentTick;
+    }
+    // Longer sleeps wait in the last slot which can be reached, and are placed again from there
+    if ((common::uint32_t) delta > maxDelta) {
+        delta = maxDelta;
+        wakeTick = currentTick + maxDelta;
+    }
+    
+    common::uint32_t level = 0;
+    while (level + 1 < TIMER_WHEEL_LEVELS && (common::uint32_t) delta >= (1u << ((level + 1) * TIMER_WHEEL_SLOT_BITS))) {
+        ++level;
+    }
+    common::uint32_t slot = (wakeTick >> (level * TIMER_WHEEL_SLOT_BITS)) & (TIMER_WHEEL_SLOTS - 1);
+    
+    task->nextTimer = 0;
+    if (tails[level][slot] != 0) tails[level][slot]->nextTimer = task;
+    else heads[level][slot] = task;
+    tails[level][slot] = task;
+}
+
+Task* TimerWheel::Advance()
+{
+    if (length == 0) {
+        ++currentTick;
+        return 0;
+    }
+    
+    // When a level wraps around, the tasks of the next slot of the level above are close enough to be placed lower
+    for (common::uint32_t level = 1; level < TIMER_WHEEL_LEVELS; ++level) {
+        if ((currentTick & ((1u << (level * TIMER_WHEEL_SLOT_BITS)) - 1)) != 0)
+            break;
+        
+        common::uint32_t slot = (currentTick >> (level * TIMER_WHEEL_SLOT_BITS)) & (TIMER_WHEEL_SLOTS - 1);
+        Task* task = heads[level][slot];
+        heads[level][slot] = 0;
+        tails[level][slot] = 0;
+        while (task != 0) {
+            Task* next = task->nextTimer;
+            Place(task);
+            task = next;
+        }
+    }
+    
+    common::uint32_t slot = currentTick & (TIMER_WHEEL_SLOTS - 1);
+    Task* expired = heads[0][slot];
+    heads[0][slot] = 0;
+    tails[0][slot] = 0;
+    
+    for (Task* task = expired; task != 0; task = task->nextTimer) {
+        --length;
+    }
+    
+    ++currentTick;
+    return expired;
+}
+
+int TimerWheel::Length() { return length; }
+
+
+
+
+
+
+Processor::Processor()
+{
+    currentTask = 0; // null
+    ticks = 0;
+    idleTicks = 0;
+    pass = 0;
+    realTimeUtilization = 0;
+    realTimeQueue.SetOrder(OrderByDeadline);
+    online = false;
+    fpuOwner = 0; // null
+    fpuTrapArmed = true; // FloatingPointUnit::EnableProcessor leaves CR0.TS set
+}
+
+
+
+
+
+
+TaskManager::TaskManager(GlobalDescriptorTable *gdt, SchedulerType schedulerType, LifeCycleType lifeCycleType, ProcessTablePrintType processTablePrintType, bool useDelayInPrintingProcessTable)
+{
+    numTasks = 0;
+    numSlots = 0;
+    numProcessors = 0;
+    freeSlotsHead = 0;
+    freeSlotsTail = 0;
+    lastAddedTask = 0;
+    collatzTask = 0;
+    exitedStack = 0;
+    exitedStackSize = 0;
+    nextArrivalOrder = 1;
+    for (int i = 0; i < 3; ++i) {
+        quanta[i] = 1;
+    }
+    ticks = 0;
+    timerFrequency = 18; // The rate of the timer if it is not programmed
+    kernelData = 0; // null
+    millisecondRemainder = 0;
+    slicesSinceBoost = 0;
+    agingTicks = 0;
+    lazyFpu = false;
+    interruptNumAfterCollatz = -1;
+    blockedTaskForCollatz = 0;
+    ignoreSchedule = 0;
+    
+    this->gdt = gdt;
+    this->schedulerType = schedulerType;
+    this->lifeCycleType = lifeCycleType;
+    this->processTablePrintType = processTablePrintType;
+    this->useDelayInPrintingProcessTable = useDelayInPrintingProcessTable;
+    
+    for (int i = 0; i < MAX_NUM_CPUS; ++i) {
+        processors[i].readyQueue.SetOrder(schedulerType == SchedulerType::Stride ? OrderByPass : OrderByLevel);
+    }
+    
+    InitializeProcessor(0); // The bootstrap processor
+}
+
+common::uint8_t TaskManager::idleStacks[MAX_NUM_CPUS][IDLE_STACK_SIZE];
+
+// Waits for the next interrupt without using the CPU
+void TaskManager::Idle()
+{
+    while (1) {
+        asm volatile("hlt");
+    }
+}
+
+void TaskManager::InitializeProcessor(common::uint32_t cpu)
+{
+    Processor* processor = &processors[cpu];
+    Task* idleTask = &processor->idleTask;
+    idleTask->pid = -1;
+    idleTask->ppid = -1;
+    idleTask->priority = Priority::Low;
+    idleTask->state = State::Ready;
+    idleTask->slotUsed = true; // So that it is never put into the free slot list
+    idleTask->cpu = cpu;
+    
+    CPUState* cpustate = (CPUState*)(idleStacks[cpu] + IDLE_STACK_SIZE - sizeof(CPUState));
+    cpustate -> eax = 0;
+    cpustate -> ebx = 0;
+    cpustate -> ecx = 0;
+    cpustate -> edx = 0;
+    cpustate -> esi = 0;
+    cpustate -> edi = 0;
+    cpustate -> ebp = 0;
+    cpustate -> error = 0;
+    cpustate -> eip = (uint32_t)Idle;
+    cpustate -> cs = gdt->CodeSegmentSelector();
+    cpustate -> eflags = 0x202; // Interrupts must be enabled, otherwise hlt never returns
+    idleTask->cpustate = cpustate;
+    
+    processor->online = true;
+    if (cpu + 1 > numProcessors) numProcessors = cpu + 1;
+}
+
+void TaskManager::StartProcessor(common::uint32_t cpu)
+{
+    if (cpu < MAX_NUM_CPUS) {
+        InitializeProcessor(cpu);
+    }
+}
+
+common::uint32_t TaskManager::NumProcessors()
+{
+    return numProcessors;
+}
+
+bool TaskManager::IsIdleTask(Task* task)
+{
+    return task == &processors[task->cpu].idleTask;
+}
+
+Processor* TaskManager::CurrentProcessor()
+{
+    if (numProcessors == 1)
+        return &processors[0];
+    return &processors[MultiprocessorManager::CurrentCpuIndex()];
+}
+
+// New tasks go to the CPU with the fewest tasks, counting the running one
+Processor* TaskManager::LeastLoadedProcessor()
+{
+    Processor* best = &processors[0];
+    int bestLoad = -1;
+    for (common::uint32_t i = 0; i < numProcessors; ++i) {
+        Processor* processor = &processors[i];
+        if (!processor->online)
+            continue;
+        
+        int load = processor->readyQueue.Length() + processor->realTimeQueue.Length();
+        if (processor->currentTask != 0 && !IsIdleTask(processor->currentTask)) ++load;
+        if (bestLoad == -1 || load < bestLoad) {
+            best = processor;
+            bestLoad = load;
+        }
+    }
+    return best;
+}
+
+// The other CPU with the longest ready queue, or null if all of them are empty
+Processor* TaskManager::BusiestProcessor(Processor* except)
+{
+    Processor* busiest = 0; // null
+    for (common::uint32_t i = 0; i < numProcessors; ++i) {
+        Processor* processor = &processors[i];
+        if (processor == except || !processor->online || processor->readyQueue.IsEmpty())
+            continue;
+        if (busiest == 0 || processor->readyQueue.Length() > busiest->readyQueue.Length()) {
+            busiest = processor;
+        }
+    }
+    return busiest;
+}
+
+bool TaskManager::HasReadyTask(Processor* processor)
+{
+    return !processor->readyQueue.IsEmpty() || !processor->realTimeQueue.IsEmpty() || (numProcessors > 1 && BusiestProcessor(processor) != 0);
+}
+
+// Moves the next task of the busiest CPU to the given one, which has nothing to run
+Task* TaskManager::StealTask(Processor* thief)
+{
+    Processor* victim = BusiestProcessor(thief);
+    if (victim == 0)
+        return 0; // null
+    
+    // The task whose registers the victim holds stays there, the victim could not save them for the thief
+    Task* task = victim->readyQueue.First();
+    if (task == victim->fpuOwner)
+        task = victim->readyQueue.Next(task);
+    if (task == 0)
+        return 0; // null
+    victim->readyQueue.Remove(task);
+    task->cpu = thief - processors;
+    return task;
+}
+
+TaskManager::~TaskManager()
+{
+}
+
+// Takes a never used slot first, then the slot that was reaped the earliest
+Task* TaskManager::AllocateTaskSlot()
+{
+    Task* task = 0; // null
+    if (numSlots < MAX_NUM_TASKS) {
+        task = &tasks[numSlots];
+        ++numSlots;
+    }
+    else if (freeSlotsHead != 0) {
+        task = freeSlotsHead;
+        freeSlotsHead = task->nextFree;
+        if (freeSlotsHead == 0) freeSlotsTail = 0;
+    }
+    else {
+        return 0; // null
+    }
+    
+    task->slotUsed = true;
+    task->nextFree = 0;
+    ++numTasks;
+    return task;
+}
+
+bool TaskManager::AllocateStack(Task* task, common::uint32_t size)
+{
+    task->stackSize = StackPool::StackSize(size);
+    task->stack = stackPool.Allocate(size);
+    if (task->stack == exitedStack) exitedStack = 0; // Prepared for the new task instead of trimmed
+    return task->stack != 0;
+}
+
+// Puts the stack of an exiting task back into the pool. Its pages stay mapped for now, the task still runs on it.
+void TaskManager::FreeStack(Task* task)
+{
+    if (exitedStack != 0) {
+        PagingManager::activePagingManager->TrimStack((uint32_t) exitedStack, exitedStackSize);
+    }
+    exitedStack = task->stack;
+    exitedStackSize = task->stackSize;
+    
+    stackPool.Free(task->stack, task->stackSize);
+    task->stack = 0;
+}
+
+// Returns the slot of a terminated task which nobody will wait for anymore
+void TaskManager::ReleaseTask(Task* task)
+{
+    task->slotUsed = false;
+    
+    // The pid of the next task in this slot differs by MAX_NUM_TASKS, so pid % MAX_NUM_TASKS is still the slot index
+    task->slotGeneration = (task->slotGeneration + 1) % (0x7FFFFFFF / MAX_NUM_TASKS);
+    
+    task->nextFree = 0;
+    if (freeSlotsTail != 0) freeSlotsTail->nextFree = task;
+    else freeSlotsHead = task;
+    freeSlotsTail = task;
+    
+    if (lastAddedTask == task) lastAddedTask = 0;
+    --numTasks;
+}
+
+// Gives up the children of an exiting task: terminated ones are released, alive ones will be released on their exit
+void TaskManager::OrphanChildren(Task* parent)
+{
+    while (parent->firstChild != 0) {
+        Task* child = parent->firstChild;
+        RemoveZombie(child);
+        UnlinkChild(child);
+        child->SetPPid(-1);
+        
+        if (child->GetState() == State::Terminated) {
+            ReleaseTask(child);
+        }
+    }
+}
+
+void TaskManager::LinkChild(Task* parent, Task* child)
+{
+    child->parent = parent;
+    child->prevSibling = 0;
+    child->nextSibling = parent->firstChild;
+    if (parent->firstChild != 0) parent->firstChild->prevSibling = child;
+    parent->firstChild = child;
+    ++parent->numChildren;
+}
+
+void TaskManager::UnlinkChild(Task* child)
+{
+    Task* parent = child->parent;
+    if (parent == 0)
+        return;
+    
+    if (child->prevSibling != 0) child->prevSibling->nextSibling = child->nextSibling;
+    else parent->firstChild = child->nextSibling;
+    if (child->nextSibling != 0) child->nextSibling->prevSibling = child->prevSibling;
+    
+    child->parent = 0;
+    child->nextSibling = 0;
+    child->prevSibling = 0;
+    --parent->numChildren;
+}
+
+// Queues a terminated child for its parent's waitpid
+void TaskManager::PushZombie(Task* child)
+{
+    Task* parent = child->parent;
+    child->nextZombie = 0;
+    child->prevZombie = parent->zombieTail;
+    if (parent->zombieTail != 0) parent->zombieTail->nextZombie = child;
+    else parent->zombieHead = child;
+    parent->zombieTail = child;
+}
+
+void TaskManager::RemoveZombie(Task* child)
+{
+    Task* parent = child->parent;
+    if (parent == 0 || (child->prevZombie == 0 && parent->zombieHead != child))
+        return; // Not in the zombie queue
+    
+    if (child->prevZombie != 0) child->prevZombie->nextZombie = child->nextZombie;
+    else parent->zombieHead = child->nextZombie;
+    if (child->nextZombie != 0) child->nextZombie->prevZombie = child->prevZombie;
+    else parent->zombieTail = child->prevZombie;
+    
+    child->nextZombie = 0;
+    child->prevZombie = 0;
+}
+
+// The parent took the exit of the child, so its slot can be reused
+void TaskManager::ReapChild(Task* child)
+{
+    RemoveZombie(child);
+    child->parent->lastChildStatistics = child->statistics;
+    UnlinkChild(child);
+    child->SetParentTookInWait(true);
+    ReleaseTask(child);
+}
+
+// Returns the task with the given pid or null if there is no such task
+Task* TaskManager::FindTask(common::int32_t pid)
+{
+    if (pid < 0)
+        return 0; // null
+    
+    Task* task = &tasks[pid % MAX_NUM_TASKS];
+    if (!task->slotUsed || task->GetPid() != pid)
+        return 0; // null
+    return task;
+}
+
+// Sets up the scheduling fields of a newly added task and makes it ready
+void TaskManager::InitializeTask(Task* task, Priority priority, common::int32_t ppid)
+{
+    task->SetPriority(priority);
+    task->SetPid((task - tasks) + task->slotGeneration * MAX_NUM_TASKS);
+    task->SetPPid(ppid);
+    task->SetArrivalOrder(nextArrivalOrder);
+    task->mlfqLevel = 0; // New tasks start at the top level of the multilevel feedback queue
+    task->tickets = STRIDE_DEFAULT_TICKETS;
+    task->stride = STRIDE_ONE / STRIDE_DEFAULT_TICKETS;
+    task->pass = 0; // Moved up to the pass of its CPU when it is queued
+    task->realTime = false; // A forked child of a real-time task has to be admitted on its own
+    task->quantum = 0;
+    task->sliceTicks = 0;
+    task->cpu = LeastLoadedProcessor() - processors;
+    task->waitQueue = 0;
+    task->waitingMutex = 0;
+    task->heldMutexes = 0;
+    task->usesFpu = false;
+    for (int i = 0; i < MAX_NUM_DESCRIPTORS; ++i) {
+        task->descriptors[i] = -1; // Fork copies the descriptors of the parent afterwards
+    }
+    task->waitingChild = false;
+    task->parentTookInWait = false;
+    
+    TaskStatistics statistics = {};
+    statistics.createdTime = ReadTimeStampCounter();
+    statistics.createdTick = ticks;
+    task->statistics = statistics;
+    task->lastChildStatistics = TaskStatistics();
+    task->readySince = statistics.createdTime;
+    task->readySinceTick = ticks;
+    task->onCpu = false;
+    
+    task->firstChild = 0;
+    task->numChildren = 0;
+    task->zombieHead = 0;
+    task->zombieTail = 0;
+    task->nextZombie = 0;
+    task->prevZombie = 0;
+    task->parent = 0;
+    Task* parent = FindTask(ppid);
+    if (parent != 0) {
+        LinkChild(parent, task);
+    }
+    
+    AddToReadyQueue(task);
+    
+    lastAddedTask = task;
+    ++nextArrivalOrder;
+}
+
+// Adds a copy of the given task, used by fork
+Task* TaskManager::AddTask(Task* newTask, Priority priority, common::int32_t ppid)
+{
+    // Take a free slot. Return null, if all slots are used.
+    Task* task = AllocateTaskSlot();
+    if (task == 0)
+        return 0; // null
+    
+    // The copy gets a stack of the same size, the saved stack pointers stay valid relative to the top
+    if (!AllocateStack(task, newTask->stackSize)) {
+        ReleaseTask(task);
+        return 0; // null
+    }
+    if (!task->Copy(newTask)) {
+        stackPool.Free(task->stack, task->stackSize);
+        task->stack = 0;
+        ReleaseTask(task);
+        return 0; // null
+    }
+    
+    InitializeTask(task, priority, ppid);
+    task->quantum = newTask->quantum; // A forked task keeps the time slice and the share of its parent
+    task->tickets = newTask->tickets;
+    task->stride = newTask->stride;
+    return task;
+}
+
+// Adds a new task which starts from the given entry point
+Task* TaskManager::AddTask(void entrypoint(), Priority priority, common::int32_t ppid, common::uint32_t stackSize)
+{
+    // Take a free slot. Return null, if all slots are used.
+    Task* task = AllocateTaskSlot();
+    if (task == 0)
+        return 0; // null
+    
+    if (!AllocateStack(task, stackSize)) {
+        ReleaseTask(task);
+        return 0; // null
+    }
+    if (!PagingManager::activePagingManager->PrepareStack((uint32_t) task->stack, task->stackSize)) {
+        stackPool.Free(task->stack, task->stackSize);
+        task->stack = 0;
+        ReleaseTask(task);
+        return 0; // null
+    }
+    task->Reset(gdt, entrypoint);
+    
+    InitializeTask(task, priority, ppid);
+    return task;
+}
+
+void TaskManager::CollatzAdded() 
+{
+    if (lastAddedTask != 0) {
+        collatzTask = lastAddedTask;
+        interruptNumAfterCollatz = 0;
+    }
+}
+
+void TaskManager::SetLastTaskPriority(common::uint32_t priority) 
+{
+    Priority newPriority = (Priority) priority;
+    if (lastAddedTask != 0) {
+        Task* task = lastAddedTask;
+        RemoveFromReadyQueue(task->GetPid());
+        task->SetPriority(newPriority);
+        task->priority = InheritedPriority(task);
+        AddToReadyQueue(task);
+    }
+}
+
+void TaskManager::SetLastTaskTickets(common::uint32_t tickets) 
+{
+    if (lastAddedTask != 0) {
+        SetTaskTickets(lastAddedTask->GetPid(), tickets);
+    }
+}
+
+bool TaskManager::SetTaskTickets(common::int32_t pid, common::uint32_t tickets) 
+{
+    Task* task = FindTask(pid);
+    if (task == 0 || tickets == 0 || tickets > STRIDE_MAX_TICKETS)
+        return false;
+    
+    task->tickets = tickets;
+    task->stride = STRIDE_ONE / tickets;
+    return true;
+}
+
+// Sets the time slice of the tasks with given priority which do not have their own quantum
+void TaskManager::SetQuantum(Priority priority, common::uint32_t ticks) 
+{
+    quanta[priority] = ticks != 0 ? ticks : 1;
+}
+
+void TaskManager::SetAgingTicks(common::uint32_t ticks) 
+{
+    agingTicks = ticks;
+}
+
+void TaskManager::EnableLazyFpu() 
+{
+    lazyFpu = true;
+}
+
+common::uint8_t* TaskManager::FpuState(Task* task)
+{
+    return (common::uint8_t*) (((common::uint32_t) task->fpuArea + 15) & ~15);
+}
+
+// Only the task whose registers the CPU holds can use them without a trap. The CR0 write is skipped if the trap is
+// already as it should be, so switches between tasks which do not use the registers do not touch the FPU at all.
+void TaskManager::SwitchFpu(Processor* processor, Task* oldTask, Task* task)
+{
+    if (!lazyFpu)
+        return;
+    
+    // A task moved to another CPU while it ran (sched_setattr) cannot leave its registers here
+    if (oldTask != 0 && oldTask == processor->fpuOwner && &processors[oldTask->cpu] != processor) {
+        ReleaseFpu(oldTask, true);
+    }
+    
+    bool trap = task != processor->fpuOwner;
+    if (trap == processor->fpuTrapArmed)
+        return;
+    if (trap) FloatingPointUnit::SetTaskSwitched();
+    else FloatingPointUnit::ClearTaskSwitched();
+    processor->fpuTrapArmed = trap;
+}
+
+// Saves the registers of the previous owner and loads the ones of the running task. A page fault, which runs as a hardware
+// task, sets CR0.TS as well, so the owner itself can trap once; then only the trap is cleared.
+void TaskManager::HandleFpuTrap()
+{
+    Processor* processor = CurrentProcessor();
+    Task* task = processor->currentTask;
+    FloatingPointUnit::ClearTaskSwitched();
+    processor->fpuTrapArmed = false;
+    if (processor->fpuOwner == task)
+        return;
+    
+    if (processor->fpuOwner != 0) {
+        FloatingPointUnit::Save(FpuState(processor->fpuOwner));
+    }
+    if (task->usesFpu) FloatingPointUnit::Restore(FpuState(task));
+    else FloatingPointUnit::Initialize();
+    task->usesFpu = true;
+    processor->fpuOwner = task;
+}
+
+// Takes the registers of a task out of the CPU which calls it, saving them first if they are still needed.
+// If the task runs on, it traps on its next use and gets them back.
+void TaskManager::ReleaseFpu(Task* task, bool save)
+{
+    Processor* processor = CurrentProcessor();
+    if (processor->fpuOwner != task)
+        return;
+    
+    if (save) {
+        FloatingPointUnit::ClearTaskSwitched(); // A page fault may have set CR0.TS
+        FloatingPointUnit::Save(FpuState(task));
+    }
+    processor->fpuOwner = 0; // null
+    FloatingPointUnit::SetTaskSwitched();
+    processor->fpuTrapArmed = true;
+}
+
+// Sets the time slice of one task, 0 makes it use the quantum of its priority again
+bool TaskManager::SetTaskQuantum(common::int32_t pid, common::uint32_t ticks) 
+{
+    Task* task = FindTask(pid);
+    if (task == 0)
+        return false;
+    
+    task->quantum = ticks;
+    return true;
+}
+
+// Blocks the running task for at least the given time
+common::uint32_t TaskManager::Sleep(common::uint32_t milliseconds, CPUState* cpustate) 
+{
+    if (milliseconds == 0)
+        return (common::uint32_t) cpustate;
+    
+    common::uint32_t sleepTicks = MillisecondsToTicks(milliseconds);
+    
+    Task* runningTask = GetCurrentTask();
+    runningTask->SetCPUState(cpustate);
+    runningTask->SetState(State::Blocked);
+    sleepingTasks.Insert(runningTask, ticks + sleepTicks + 1); // The current tick is partly over
+    
+    return (common::uint32_t) Schedule();
+}
+
+// Rounds up to whole ticks without overflowing milliseconds * timerFrequency
+common::uint32_t TaskManager::MillisecondsToTicks(common::uint32_t milliseconds) 
+{
+    return (milliseconds / 1000) * timerFrequency + ((milliseconds % 1000) * timerFrequency + 999) / 1000;
+}
+
+// The CPU of the task if its real-time utilization still fits there, otherwise the first CPU where it fits
+Processor* TaskManager::AdmitRealTimeTask(Task* task, common::uint32_t utilization) 
+{
+    const common::uint32_t limit = REALTIME_UTILIZATION_ONE / 100 * REALTIME_UTILIZATION_LIMIT;
+    
+    Processor* own = &processors[task->cpu];
+    if (own->realTimeUtilization + utilization <= limit)
+        return own;
+    
+    for (common::uint32_t i = 0; i < numProcessors; ++i) {
+        Processor* processor = &processors[i];
+        if (processor->online && processor->realTimeUtilization + utilization <= limit)
+            return processor;
+    }
+    return 0; // null
+}
+
+common::int32_t TaskManager::SetRealTime(common::uint32_t period, common::uint32_t budget, common::uint32_t deadline) 
+{
+    Task* task = GetCurrentTask();
+    
+    // Give up the utilization admitted before, also if the new parameters are rejected
+    if (task->realTime) {
+        processors[task->cpu].realTimeUtilization -= task->utilization;
+        task->realTime = false;
+    }
+    if (period == 0)
+        return 0;
+    
+    common::uint32_t periodTicks = MillisecondsToTicks(period);
+    common::uint32_t budgetTicks = MillisecondsToTicks(budget);
+    common::uint32_t deadlineTicks = MillisecondsToTicks(deadline);
+    if (budgetTicks == 0 || budgetTicks > deadlineTicks || deadlineTicks > periodTicks || periodTicks > REALTIME_MAX_PERIOD)
+        return -1;
+    
+    common::uint32_t utilization = (budgetTicks << 16) / periodTicks;
+    Processor* processor = AdmitRealTimeTask(task, utilization);
+    if (processor == 0)
+        return -1;
+    
+    // The task moves to the other CPU when it is queued the next time
+    processor->realTimeUtilization += utilization;
+    task->cpu = processor - processors;
+    task->realTime = true;
+    task->period = periodTicks;
+    task->budget = budgetTicks;
+    task->relativeDeadline = deadlineTicks;
+    task->utilization = utilization;
+    
+    // The first job starts now
+    task->releaseTick = ticks;
+    task->absoluteDeadline = ticks + deadlineTicks;
+    task->budgetLeft = budgetTicks;
+    return 0;
+}
+
+// Sets up the next job of a real-time task. Returns false if the job starts in the future, then the task sleeps until then.
+// A task which is more than a period behind starts its next job right away.
+bool TaskManager::ReleaseNextJob(Task* task) 
+{
+    task->releaseTick += task->period;
+    if ((common::int32_t) (task->releaseTick - ticks) < 0) task->releaseTick = ticks;
+    task->absoluteDeadline = task->releaseTick + task->relativeDeadline;
+    task->budgetLeft = task->budget;
+    
+    if (task->releaseTick == ticks)
+        return true;
+    
+    task->SetState(State::Blocked);
+    sleepingTasks.Insert(task, task->releaseTick);
+    return false;
+}
+
+common::uint32_t TaskManager::Yield(CPUState* cpustate) 
+{
+    Task* runningTask = GetCurrentTask();
+    runningTask->SetCPUState(cpustate);
+    
+    if (runningTask->realTime) {
+        ++runningTask->statistics.completedJobs;
+        if ((common::int32_t) (ticks - runningTask->absoluteDeadline) > 0) ++runningTask->statistics.deadlineMisses;
+        
+        if (!ReleaseNextJob(runningTask))
+            return (common::uint32_t) Schedule();
+    }
+    
+    AddToReadyQueue(runningTask);
+    return (common::uint32_t) Schedule();
+}
+
+// Called on every timer interrupt, makes the tasks whose sleep is over ready
+void TaskManager::WakeSleepingTasks() 
+{
+    Task* task = sleepingTasks.Advance();
+    while (task != 0) {
+        Task* next = task->nextTimer;
+        task->nextTimer = 0;
+        AddToReadyQueue(task);
+        task = next;
+    }
+}
+
+void TaskManager::SetTimerFrequency(common::uint32_t hz) 
+{
+    timerFrequency = hz;
+    if (kernelData != 0) kernelData->timerFrequency = hz;
+}
+
+void TaskManager::SetKernelData(KernelData* kernelData) 
+{
+    this->kernelData = kernelData;
+    kernelData->ticks = ticks;
+    kernelData->timerFrequency = timerFrequency;
+    for (common::uint32_t cpu = 0; cpu < MAX_NUM_CPUS; ++cpu) {
+        kernelData->processors[cpu].pid = -1;
+        kernelData->processors[cpu].forkPid = -1;
+    }
+}
+
+// Changes the entry of the CPU in the kernel data page, see KernelDataProcessor
+void TaskManager::PublishRunningTask(Processor* processor, Task* task) 
+{
+    if (kernelData == 0)
+        return;
+    
+    KernelDataProcessor* entry = &kernelData->processors[processor - processors];
+    ++entry->switches;
+    entry->pid = task->GetPid();
+    entry->forkPid = task->forkPid;
+    ++entry->switches;
+}
+
+common::uint32_t TaskManager::GetTicks() 
+{
+    return ticks;
+}
+
+common::uint32_t TaskManager::GetIdleTicks() 
+{
+    common::uint32_t idleTicks = 0;
+    for (common::uint32_t i = 0; i < numProcessors; ++i) {
+        idleTicks += processors[i].idleTicks;
+    }
+    return idleTicks;
+}
+
+// Charges the time since the task became ready as waiting time and starts its running time
+void TaskManager::StartRunning(Task* task) 
+{
+    common::uint64_t now = ReadTimeStampCounter();
+    if (!IsIdleTask(task)) {
+        task->statistics.waitTime += now - task->readySince;
+        task->statistics.waitTicks += ticks - task->readySinceTick;
+    }
+    if (task->statistics.firstRunTime == 0) {
+        task->statistics.firstRunTime = now;
+        task->statistics.firstRunTick = ticks;
+    }
+    task->runningSince = now;
+    task->onCpu = true;
+}
+
+// Ends the running time of a task which leaves the CPU. A task which is still ready has been preempted.
+void TaskManager::StopRunning(Task* task) 
+{
+    if (!task->onCpu)
+        return;
+    
+    task->statistics.cpuTime += ReadTimeStampCounter() - task->runningSince;
+    if (task->GetState() == State::Ready) ++task->statistics.involuntarySwitches;
+    else ++task->statistics.voluntarySwitches;
+    task->onCpu = false;
+}
+
+// Copies the statistics of the task with given pid, the running task or the child it has taken in waitpid last
+bool TaskManager::GetStatistics(common::int32_t pid, TaskStatistics* statistics) 
+{
+    Task* runningTask = GetCurrentTask();
+    Task* task = 0;
+    if (pid == TASK_STATISTICS_LAST_CHILD) {
+        if (runningTask == 0)
+            return false;
+        *statistics = runningTask->lastChildStatistics;
+        return true;
+    }
+    
+    task = (pid == TASK_STATISTICS_SELF) ? runningTask : FindTask(pid);
+    if (task == 0)
+        return false;
+    
+    *statistics = task->statistics;
+    
+    // Include the current running interval
+    if (task->onCpu) {
+        statistics->cpuTime += ReadTimeStampCounter() - task->runningSince;
+    }
+    return true;
+}
+
+// Blocks the running task in the given wait queue, the caller schedules the next task
+void TaskManager::Block(WaitQueue* waitQueue, CPUState* cpustate) 
+{
+    Task* runningTask = GetCurrentTask();
+    runningTask->SetCPUState(cpustate);
+    runningTask->SetState(State::Blocked);
+    waitQueue->PushBack(runningTask);
+}
+
+// Makes a task taken from a wait queue ready, the result is returned from its system call
+void TaskManager::WakeWaiter(Task* task, common::uint32_t result) 
+{
+    task->GetCPUState()->eax = result;
+    AddToReadyQueue(task);
+}
+
+// The highest priority of the task itself and of the tasks waiting for its mutexes
+Priority TaskManager::InheritedPriority(Task* task) 
+{
+    common::uint32_t priority = task->basePriority;
+    for (Mutex* mutex = task->heldMutexes; mutex != 0; mutex = mutex->nextHeld) {
+        common::uint32_t waiterPriority = mutex->waiters.HighestPriority();
+        if (waiterPriority < priority) priority = waiterPriority;
+    }
+    return (Priority) priority;
+}
+
+// Recomputes the priority of the task after the waiters of its mutexes changed, and passes a change on to the owner
+// of the mutex the task itself waits for. The chain is bounded in case the tasks are deadlocked in a cycle.
+void TaskManager::UpdateInheritedPriority(Task* task) 
+{
+    for (int depth = 0; task != 0 && depth < MAX_NUM_TASKS; ++depth) {
+        Priority priority = InheritedPriority(task);
+        if (priority == task->priority)
+            return;
+        task->priority = priority;
+        
+        // Move the task to the level of its new priority
+        if (task->waitQueue != 0) {
+            WaitQueue* waitQueue = task->waitQueue;
+            waitQueue->Remove(task);
+            waitQueue->PushBack(task);
+        }
+        else if (task->inReadyQueue && !task->realTime && schedulerType == SchedulerType::PreemptivePriority) {
+            processors[task->cpu].readyQueue.Remove(task);
+            AddToReadyQueuePreemptivePriority(task);
+        }
+        
+        Mutex* mutex = task->waitingMutex;
+        task = (mutex != 0 && task->waitQueue == &mutex->waiters) ? mutex->owner : 0;
+    }
+}
+
+Mutex* TaskManager::FindMutex(common::int32_t id) 
+{
+    if (id < 0 || id >= MAX_NUM_MUTEXES || !mutexes[id].used)
+        return 0; // null
+    return &mutexes[id];
+}
+
+Semaphore* TaskManager::FindSemaphore(common::int32_t id) 
+{
+    if (id < 0 || id >= MAX_NUM_SEMAPHORES || !semaphores[id].used)
+        return 0; // null
+    return &semaphores[id];
+}
+
+ConditionVariable* TaskManager::FindConditionVariable(common::int32_t id) 
+{
+    if (id < 0 || id >= MAX_NUM_CONDITION_VARIABLES || !conditionVariables[id].used)
+        return 0; // null
+    return &conditionVariables[id];
+}
+
+void TaskManager::GiveMutex(Mutex* mutex, Task* task) 
+{
+    mutex->owner = task;
+    mutex->prevHeld = 0;
+    mutex->nextHeld = task->heldMutexes;
+    if (task->heldMutexes != 0) task->heldMutexes->prevHeld = mutex;
+    task->heldMutexes = mutex;
+    task->waitingMutex = 0;
+    
+    // The new owner runs with the priority of the tasks still waiting
+    UpdateInheritedPriority(task);
+}
+
+// Hands the mutex over to its highest priority waiter, so a woken waiter never has to compete for it again
+void TaskManager::ReleaseMutex(Mutex* mutex) 
+{
+    Task* owner = mutex->owner;
+    if (mutex->prevHeld != 0) mutex->prevHeld->nextHeld = mutex->nextHeld;
+    else owner->heldMutexes = mutex->nextHeld;
+    if (mutex->nextHeld != 0) mutex->nextHeld->prevHeld = mutex->prevHeld;
+    mutex->nextHeld = 0;
+    mutex->prevHeld = 0;
+    mutex->owner = 0;
+    
+    Task* next = mutex->waiters.PopFront();
+    if (next != 0) {
+        GiveMutex(mutex, next);
+        WakeWaiter(next, 0);
+    }
+    
+    UpdateInheritedPriority(owner);
+}
+
+void TaskManager::ReleaseMutexes(Task* task) 
+{
+    while (task->heldMutexes != 0) {
+        ReleaseMutex(task->heldMutexes);
+    }
+}
+
+// A signalled condition variable waiter takes its mutex again, or waits for it without running in between
+void TaskManager::RetakeMutex(Task* task) 
+{
+    Mutex* mutex = task->waitingMutex;
+    if (!mutex->used) {
+        task->waitingMutex = 0;
+        WakeWaiter(task, -1);
+    }
+    else if (mutex->owner == 0) {
+        GiveMutex(mutex, task);
+        WakeWaiter(task, 0);
+    }
+    else {
+        mutex->waiters.PushBack(task);
+        UpdateInheritedPriority(mutex->owner);
+    }
+}
+
+common::int32_t TaskManager::CreateMutex() 
+{
+    for (int i = 0; i < MAX_NUM_MUTEXES; ++i) {
+        if (!mutexes[i].used) {
+            mutexes[i].used = true;
+            mutexes[i].owner = 0;
+            return i;
+        }
+    }
+    return -1;
+}
+
+common::uint32_t TaskManager::LockMutex(common::int32_t id, CPUState* cpustate) 
+{
+    Mutex* mutex = FindMutex(id);
+    Task* runningTask = GetCurrentTask();
+    
+    // The mutex is not recursive, locking it again would never return
+    if (mutex == 0 || mutex->owner == runningTask) {
+        cpustate->eax = -1;
+        return (common::uint32_t) cpustate;
+    }
+    
+    if (mutex->owner == 0) {
+        GiveMutex(mutex, runningTask);
+        cpustate->eax = 0;
+        return (common::uint32_t) cpustate;
+    }
+    
+    runningTask->waitingMutex = mutex;
+    Block(&mutex->waiters, cpustate);
+    UpdateInheritedPriority(mutex->owner);
+    return (common::uint32_t) Schedule();
+}
+
+common::int32_t TaskManager::TryLockMutex(common::int32_t id) 
+{
+    Mutex* mutex = FindMutex(id);
+    if (mutex == 0 || mutex->owner != 0)
+        return -1;
+    
+    GiveMutex(mutex, GetCurrentTask());
+    return 0;
+}
+
+common::int32_t TaskManager::UnlockMutex(common::int32_t id) 
+{
+    Mutex* mutex = FindMutex(id);
+    if (mutex == 0 || mutex->owner != GetCurrentTask())
+        return -1;
+    
+    ReleaseMutex(mutex);
+    return 0;
+}
+
+common::int32_t TaskManager::DestroyMutex(common::int32_t id) 
+{
+    Mutex* mutex = FindMutex(id);
+    if (mutex == 0 || mutex->owner != 0 || !mutex->waiters.IsEmpty())
+        return -1;
+    
+    mutex->used = false;
+    return 0;
+}
+
+common::int32_t TaskManager::CreateSemaphore(common::int32_t count) 
+{
+    if (count < 0)
+        return -1;
+    
+    for (int i = 0; i < MAX_NUM_SEMAPHORES; ++i) {
+        if (!semaphores[i].used) {
+            semaphores[i].used = true;
+            semaphores[i].count = count;
+            return i;
+        }
+    }
+    return -1;
+}
+
+common::uint32_t TaskManager::WaitSemaphore(common::int32_t id, CPUState* cpustate) 
+{
+    Semaphore* semaphore = FindSemaphore(id);
+    if (semaphore == 0) {
+        cpustate->eax = -1;
+        return (common::uint32_t) cpustate;
+    }
+    
+    if (semaphore->count > 0) {
+        --semaphore->count;
+        cpustate->eax = 0;
+        return (common::uint32_t) cpustate;
+    }
+    
+    Block(&semaphore->waiters, cpustate);
+    return (common::uint32_t) Schedule();
+}
+
+common::int32_t TaskManager::TryWaitSemaphore(common::int32_t id) 
+{
+    Semaphore* semaphore = FindSemaphore(id);
+    if (semaphore == 0 || semaphore->count == 0)
+        return -1;
+    
+    --semaphore->count;
+    return 0;
+}
+
+common::int32_t TaskManager::PostSemaphore(common::int32_t id) 
+{
+    Semaphore* semaphore = FindSemaphore(id);
+    if (semaphore == 0)
+        return -1;
+    
+    // A waiter takes the unit directly, so the count stays 0
+    Task* task = semaphore->waiters.PopFront();
+    if (task != 0) {
+        WakeWaiter(task, 0);
+    }
+    else {
+        ++semaphore->count;
+    }
+    return 0;
+}
+
+common::int32_t TaskManager::DestroySemaphore(common::int32_t id) 
+{
+    Semaphore* semaphore = FindSemaphore(id);
+    if (semaphore == 0 || !semaphore->waiters.IsEmpty())
+        return -1;
+    
+    semaphore->used = false;
+    return 0;
+}
+
+common::int32_t TaskManager::CreateConditionVariable() 
+{
+    for (int i = 0; i < MAX_NUM_CONDITION_VARIABLES; ++i) {
+        if (!conditionVariables[i].used) {
+            conditionVariables[i].used = true;
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Unlocks the mutex and blocks until a signal, then returns with the mutex locked again
+common::uint32_t TaskManager::WaitConditionVariable(common::int32_t id, common::int32_t mutexId, CPUState* cpustate) 
+{
+    ConditionVariable* conditionVariable = FindConditionVariable(id);
+    Mutex* mutex = FindMutex(mutexId);
+    Task* runningTask = GetCurrentTask();
+    if (conditionVariable == 0 || mutex == 0 || mutex->owner != runningTask) {
+        cpustate->eax = -1;
+        return (common::uint32_t) cpustate;
+    }
+    
+    ReleaseMutex(mutex);
+    runningTask->waitingMutex = mutex;
+    Block(&conditionVariable->waiters, cpustate);
+    return (common::uint32_t) Schedule();
+}
+
+common::int32_t TaskManager::SignalConditionVariable(common::int32_t id) 
+{
+    ConditionVariable* conditionVariable = FindConditionVariable(id);
+    if (conditionVariable == 0)
+        return -1;
+    
+    Task* task = conditionVariable->waiters.PopFront();
+    if (task != 0) {
+        RetakeMutex(task);
+    }
+    return 0;
+}
+
+common::int32_t TaskManager::BroadcastConditionVariable(common::int32_t id) 
+{
+    ConditionVariable* conditionVariable = FindConditionVariable(id);
+    if (conditionVariable == 0)
+        return -1;
+    
+    Task* task;
+    while ((task = conditionVariable->waiters.PopFront()) != 0) {
+        RetakeMutex(task);
+    }
+    return 0;
+}
+
+common::int32_t TaskManager::DestroyConditionVariable(common::int32_t id) 
+{
+    ConditionVariable* conditionVariable = FindConditionVariable(id);
+    if (conditionVariable == 0 || !conditionVariable->waiters.IsEmpty())
+        return -1;
+    
+    conditionVariable->used = false;
+    return 0;
+}
+
+Pipe* TaskManager::FindPipe(common::int32_t descriptor, common::uint32_t end) 
+{
+    if (descriptor < 0 || descriptor >= MAX_NUM_DESCRIPTORS)
+        return 0; // null
+    
+    common::int32_t value = GetCurrentTask()->descriptors[descriptor];
+    if (value < 0 || value % 2 != end)
+        return 0; // null
+    return &pipes[value / 2];
+}
+
+MessageQueue* TaskManager::FindMessageQueue(common::int32_t id) 
+{
+    if (id < 0 || id >= MAX_NUM_MESSAGE_QUEUES || !messageQueues[id].used)
+        return 0; // null
+    return &messageQueues[id];
+}
+
+// Moves data from blocked writers into the buffer and from the buffer to blocked readers until neither can go on.
+// A write larger than the buffer goes through it in chunks, and the writer wakes up when its last chunk is in.
+void TaskManager::PumpPipe(Pipe* pipe) 
+{
+    bool progress = true;
+    while (progress) {
+        progress = false;
+        
+        Task* writer = pipe->writers.First();
+        if (writer != 0 && pipe->buffer.Free() > 0) {
+            common::uint32_t length = pipe->buffer.Write(writer->ipcBuffer, writer->ipcLength);
+            writer->ipcBuffer += length;
+            writer->ipcLength -= length;
+            writer->ipcDone += length;
+            if (writer->ipcLength == 0) {
+                pipe->writers.Remove(writer);
+                WakeWaiter(writer, writer->ipcDone);
+            }
+            progress = true;
+        }
+        
+        Task* reader = pipe->readers.First();
+        if (reader != 0 && pipe->buffer.Used() > 0) {
+            common::uint32_t length = pipe->buffer.Read(reader->ipcBuffer, reader->ipcLength);
+            pipe->readers.Remove(reader);
+            WakeWaiter(reader, length);
+            progress = true;
+        }
+    }
+}
+
+void TaskManager::CloseDescriptor(Task* task, common::int32_t descriptor) 
+{
+    common::int32_t value = task->descriptors[descriptor];
+    task->descriptors[descriptor] = -1;
+    Pipe* pipe = &pipes[value / 2];
+    
+    if (value % 2 == 0) {
+        // Nobody will read the rest, the blocked writers return what they have written or -1
+        if (--pipe->numReaders == 0) {
+            while (!pipe->writers.IsEmpty()) {
+                Task* writer = pipe->writers.PopFront();
+                WakeWaiter(writer, writer->ipcDone > 0 ? writer->ipcDone : -1);
+            }
+        }
+    }
+    else {
+        // The buffer is empty while readers are blocked, so they are at the end of the stream
+        if (--pipe->numWriters == 0) {
+            while (!pipe->readers.IsEmpty()) {
+                WakeWaiter(pipe->readers.PopFront(), 0);
+            }
+        }
+    }
+    
+    if (pipe->numReaders == 0 && pipe->numWriters == 0) {
+        pipe->buffer.Clear();
+    }
+}
+
+void TaskManager::CloseDescriptors(Task* task) 
+{
+    for (int i = 0; i < MAX_NUM_DESCRIPTORS; ++i) {
+        if (task->descriptors[i] >= 0) {
+            CloseDescriptor(task, i);
+        }
+    }
+}
+
+void TaskManager::DuplicateDescriptors(Task* parent, Task* child) 
+{
+    for (int i = 0; i < MAX_NUM_DESCRIPTORS; ++i) {
+        common::int32_t value = parent->descriptors[i];
+        child->descriptors[i] = value;
+        if (value < 0)
+            continue;
+        
+        if (value % 2 == 0) ++pipes[value / 2].numReaders;
+        else ++pipes[value / 2].numWriters;
+    }
+}
+
+common::int32_t TaskManager::CreatePipe(common::int32_t* descriptors) 
+{
+    Task* runningTask = GetCurrentTask();
+    
+    // A pipe without any open end is free
+    Pipe* pipe = 0;
+    for (int i = 0; i < MAX_NUM_PIPES && pipe == 0; ++i) {
+        if (pipes[i].numReaders == 0 && pipes[i].numWriters == 0) pipe = &pipes[i];
+    }
+    
+    int readDescriptor = -1;
+    int writeDescriptor = -1;
+    for (int i = 0; i < MAX_NUM_DESCRIPTORS && writeDescriptor < 0; ++i) {
+        if (runningTask->descriptors[i] >= 0) continue;
+        if (readDescriptor < 0) readDescriptor = i;
+        else writeDescriptor = i;
+    }
+    
+    if (pipe == 0 || writeDescriptor < 0)
+        return -1;
+    
+    common::int32_t index = pipe - pipes;
+    runningTask->descriptors[readDescriptor] = index * 2;
+    runningTask->descriptors[writeDescriptor] = index * 2 + 1;
+    pipe->numReaders = 1;
+    pipe->numWriters = 1;
+    
+    descriptors[0] = readDescriptor;
+    descriptors[1] = writeDescriptor;
+    return 0;
+}
+
+common::uint32_t TaskManager::Read(common::int32_t descriptor, common::uint8_t* buffer, common::uint32_t length, CPUState* cpustate) 
+{
+    Pipe* pipe = FindPipe(descriptor, 0);
+    if (pipe == 0) {
+        cpustate->eax = -1;
+        return (common::uint32_t) cpustate;
+    }
+    
+    if (length == 0 || pipe->buffer.Used() > 0 || pipe->numWriters == 0) {
+        cpustate->eax = pipe->buffer.Read(buffer, length);
+        PumpPipe(pipe); // Blocked writers may fit now
+        return (common::uint32_t) cpustate;
+    }
+    
+    Task* runningTask = GetCurrentTask();
+    runningTask->ipcBuffer = buffer;
+    runningTask->ipcLength = length;
+    Block(&pipe->readers, cpustate);
+    return (common::uint32_t) Schedule();
+}
+
+common::uint32_t TaskManager::Write(common::int32_t descriptor, const common::uint8_t* buffer, common::uint32_t length, CPUState* cpustate) 
 {
-    // task.stack + 4096 - task.cpustate = this->stack + 4096 - this->cpustate
-    this->cpustate = (CPUState*) (this->stack - (oth->stack - (uint8_t*) oth->cpustate));
+    Pipe* pipe = FindPipe(descriptor, 1);
+    if (pipe == 0 || pipe->numReaders == 0) {
+        cpustate->eax = -1;
+        return (common::uint32_t) cpustate;
+    }
+    
+    // Hand the data to blocked readers as long as they take it. Blocked writers keep their turn, since the buffer is full while they wait.
+    common::uint32_t written = 0;
+    while (true) {
+        written += pipe->buffer.Write(buffer + written, length - written);
+        PumpPipe(pipe);
+        if (written == length || pipe->buffer.Free() == 0)
+            break;
+    }
     
-    for (int i = 0; i < MAX_STACK_SIZE; ++i) {
-        this->stack[i] = oth->stack[i];
+    if (written == length) {
+        cpustate->eax = length;
+        return (common::uint32_t) cpustate;
     }
+    
+    Task* runningTask = GetCurrentTask();
+    runningTask->ipcBuffer = (common::uint8_t*) buffer + written;
+    runningTask->ipcLength = length - written;
+    runningTask->ipcDone = written;
+    Block(&pipe->writers, cpustate);
+    return (common::uint32_t) Schedule();
 }
 
-void Task::CopyCpuState(CPUState* cpustate) 
+common::int32_t TaskManager::Close(common::int32_t descriptor) 
 {
-    *(this->cpustate) = *cpustate;
+    Task* runningTask = GetCurrentTask();
+    if (descriptor < 0 || descriptor >= MAX_NUM_DESCRIPTORS || runningTask->descriptors[descriptor] < 0)
+        return -1;
+    
+    CloseDescriptor(runningTask, descriptor);
+    return 0;
 }
 
-CPUState* Task::GetCPUState() { return cpustate; }
-void Task::SetCPUState(CPUState* cpustate) { this->cpustate = cpustate; }
-
-Priority Task::GetPriority() { return priority; }
-void Task::SetPriority(Priority priority) { this->priority = priority; }
-
-common::int32_t Task::GetPid() { return pid; }
-void Task::SetPid(common::int32_t pid) { this->pid = pid; }
-
-common::int32_t Task::GetPPid() { return ppid; }
-void Task::SetPPid(common::int32_t ppid) { this->ppid = ppid; }
-
-State Task::GetState() { return this->state; }
-void Task::SetState(State state) { this->state = state; }
-
-bool Task::GetParentTookInWait() { return this->parentTookInWait; }
-void Task::SetParentTookInWait(bool parentTookInWait) { this->parentTookInWait = parentTookInWait; }
-
-common::int32_t Task::GetArrivalOrder() { return this->arrivalOrder; }
-void Task::SetArrivalOrder(common::int32_t arrivalOrder) { this->arrivalOrder = arrivalOrder; }
-
-
-
-
-
-
-TaskManager::TaskManager(GlobalDescriptorTable *gdt, SchedulerType schedulerType, LifeCycleType lifeCycleType, ProcessTablePrintType processTablePrintType, bool useDelayInPrintingProcessTable)
+common::int32_t TaskManager::CreateMessageQueue() 
 {
-    numTasks = 0;
-    currentTask = -1;
-    nextArrivalOrder = 1;
-    queueLen = 0;
-    interruptNumAfterCollatz = -1;
-    blockedTaskForCollatz = 0;
-    ignoreSchedule = 0;
-    
-    this->gdt = gdt;
-    this->schedulerType = schedulerType;
-    this->lifeCycleType = lifeCycleType;
-    this->processTablePrintType = processTablePrintType;
-    this->useDelayInPrintingProcessTable = useDelayInPrintingProcessTable;
+    for (int i = 0; i < MAX_NUM_MESSAGE_QUEUES; ++i) {
+        if (!messageQueues[i].used) {
+            messageQueues[i].used = true;
+            messageQueues[i].buffer.Clear();
+            messageQueues[i].numMessages = 0;
+            return i;
+        }
+    }
+    return -1;
 }
 
-TaskManager::~TaskManager()
+// Delivers messages from blocked senders and to blocked receivers in order until neither can go on
+void TaskManager::PumpMessageQueue(MessageQueue* messageQueue) 
 {
+    bool progress = true;
+    while (progress) {
+        progress = false;
+        
+        Task* sender = messageQueue->senders.First();
+        if (sender != 0 && messageQueue->buffer.Free() >= sizeof(common::uint16_t) + sender->ipcLength) {
+            common::uint16_t length = sender->ipcLength;
+            messageQueue->buffer.Write((common::uint8_t*) &length, sizeof(length));
+            messageQueue->buffer.Write(sender->ipcBuffer, length);
+            ++messageQueue->numMessages;
+            messageQueue->senders.Remove(sender);
+            WakeWaiter(sender, 0);
+            progress = true;
+        }
+        
+        Task* receiver = messageQueue->receivers.First();
+        if (receiver != 0 && messageQueue->numMessages > 0) {
+            common::uint16_t length;
+            messageQueue->buffer.Peek((common::uint8_t*) &length, sizeof(length));
+            messageQueue->receivers.Remove(receiver);
+            if (length > receiver->ipcLength) {
+                WakeWaiter(receiver, -1);
+            }
+            else {
+                messageQueue->buffer.Read((common::uint8_t*) &length, sizeof(length));
+                messageQueue->buffer.Read(receiver->ipcBuffer, length);
+                --messageQueue->numMessages;
+                WakeWaiter(receiver, length);
+            }
+            progress = true;
+        }
+    }
 }
 
-Task* TaskManager::AddTask(Task* newTask, Priority priority, common::int32_t ppid)
+common::uint32_t TaskManager::SendMessage(common::int32_t id, const common::uint8_t* message, common::uint32_t length, CPUState* cpustate) 
 {
-    // Check Tasks array size. Return false, if it is full.
-    if(numTasks >= MAX_NUM_TASKS)
-        return 0; // null
-    
-    Task* task = &tasks[numTasks];
-    task->Copy(newTask);
-    task->SetPriority(priority);
-    task->SetPid(numTasks);
-    task->SetPPid(ppid);
-    task->SetArrivalOrder(nextArrivalOrder);
+    MessageQueue* messageQueue = FindMessageQueue(id);
+    if (messageQueue == 0 || length > MAX_MESSAGE_SIZE) {
+        cpustate->eax = -1;
+        return (common::uint32_t) cpustate;
+    }
     
-    AddToReadyQueue(task);
+    // Earlier senders keep their turn
+    if (messageQueue->senders.IsEmpty() && messageQueue->buffer.Free() >= sizeof(common::uint16_t) + length) {
+        common::uint16_t messageLength = length;
+        messageQueue->buffer.Write((common::uint8_t*) &messageLength, sizeof(messageLength));
+        messageQueue->buffer.Write(message, length);
+        ++messageQueue->numMessages;
+        PumpMessageQueue(messageQueue); // Wakes a blocked receiver
+        cpustate->eax = 0;
+        return (common::uint32_t) cpustate;
+    }
     
-    ++numTasks;
-    ++nextArrivalOrder;
-
-    return task;
+    Task* runningTask = GetCurrentTask();
+    runningTask->ipcBuffer = (common::uint8_t*) message;
+    runningTask->ipcLength = length;
+    Block(&messageQueue->senders, cpustate);
+    return (common::uint32_t) Schedule();
 }
 
-void TaskManager::CollatzAdded() 
+common::uint32_t TaskManager::ReceiveMessage(common::int32_t id, common::uint8_t* buffer, common::uint32_t size, CPUState* cpustate) 
 {
-    if (numTasks > 0) {
-        collatzTask = &tasks[numTasks - 1];
-        interruptNumAfterCollatz = 0;
+    MessageQueue* messageQueue = FindMessageQueue(id);
+    if (messageQueue == 0) {
+        cpustate->eax = -1;
+        return (common::uint32_t) cpustate;
+    }
+    
+    if (messageQueue->numMessages > 0) {
+        common::uint16_t length;
+        messageQueue->buffer.Peek((common::uint8_t*) &length, sizeof(length));
+        if (length > size) {
+            cpustate->eax = -1;
+            return (common::uint32_t) cpustate;
+        }
+        
+        messageQueue->buffer.Read((common::uint8_t*) &length, sizeof(length));
+        messageQueue->buffer.Read(buffer, length);
+        --messageQueue->numMessages;
+        PumpMessageQueue(messageQueue); // Blocked senders may fit now
+        cpustate->eax = length;
+        return (common::uint32_t) cpustate;
     }
+    
+    Task* runningTask = GetCurrentTask();
+    runningTask->ipcBuffer = buffer;
+    runningTask->ipcLength = size;
+    Block(&messageQueue->receivers, cpustate);
+    return (common::uint32_t) Schedule();
 }
 
-void TaskManager::SetLastTaskPriority(common::uint32_t priority) 
+common::int32_t TaskManager::DestroyMessageQueue(common::int32_t id) 
 {
-    Priority newPriority = (Priority) priority;
-    if (numTasks > 0) {
-        Task* task = &tasks[numTasks - 1];
-        RemoveFromReadyQueue(task->GetPid());
-        task->SetPriority(newPriority);
-        AddToReadyQueue(task);
-    }
+    MessageQueue* messageQueue = FindMessageQueue(id);
+    if (messageQueue == 0 || !messageQueue->senders.IsEmpty() || !messageQueue->receivers.IsEmpty())
+        return -1;
+    
+    messageQueue->used = false;
+    return 0;
 }
 
 common::uint32_t TaskManager::BlockForCollatz(CPUState* cpustate) 
 {
-    Task* runningTask = &tasks[currentTask];
+    Task* runningTask = GetCurrentTask();
     runningTask->SetCPUState(cpustate);
     runningTask->SetState(State::Blocked);
     
@@ -182,22 +1894,76 @@ void TaskManager::Fork(CPUState* cpustate)
     parent->SetCPUState(cpustate); // Save the current cpustate to the currently running process which is parent
     
     Task* child = AddTask(parent, parent->GetPriority(), parent->GetPid());
-    if (child != 0) {
-        child->CopyCpuState(cpustate); // Copy the cpustate in any case
+    if (child == 0) {
+        // No free task slot, so the fork fails
+        parent->forkPid = -1;
+        cpustate->ecx = -1;
+        return;
+    }
+    child->CopyCpuState(cpustate); // Copy the cpustate in any case
+    DuplicateDescriptors(parent, child);
+    
+    // The child starts with the x87 and SSE registers of the parent, which may be in this CPU only
+    if (parent->usesFpu) {
+        Processor* processor = CurrentProcessor();
+        if (processor->fpuOwner == parent) {
+            FloatingPointUnit::ClearTaskSwitched(); // A page fault may have set CR0.TS
+            processor->fpuTrapArmed = false;
+            FloatingPointUnit::Save(FpuState(parent));
+        }
+        common::uint8_t* from = FpuState(parent);
+        common::uint8_t* to = FpuState(child);
+        for (common::uint32_t i = 0; i < FPU_STATE_SIZE; ++i) {
+            to[i] = from[i];
+        }
+        child->usesFpu = true;
     }
     
     // Set the fork pids 
     parent->forkPid = child->GetPid();
     child->forkPid = 0;
+    PublishRunningTask(CurrentProcessor(), parent);
     
     cpustate->ecx = child->GetPid();
     child->GetCPUState()->ecx = 0;
 }
 
+common::int32_t TaskManager::Spawn(void (*entrypoint)(), common::uint32_t priority, common::uint32_t stackSize) 
+{
+    if (priority > Low || StackPool::StackSize(stackSize) == 0)
+        return -1;
+    
+    Task* parent = GetCurrentTask();
+    Task* child = AddTask(entrypoint, (Priority) priority, parent->GetPid(), stackSize != 0 ? stackSize : parent->stackSize);
+    if (child == 0)
+        return -1;
+    
+    // Like a forked and executed child, it keeps the descriptors, the time slice and the share of its parent
+    DuplicateDescriptors(parent, child);
+    child->quantum = parent->quantum;
+    child->tickets = parent->tickets;
+    child->stride = parent->stride;
+    child->forkPid = 0;
+    return child->GetPid();
+}
+
+common::uint32_t TaskManager::SpawnBatch(SpawnRequest* requests, common::uint32_t count) 
+{
+    common::uint32_t spawned = 0;
+    for (; spawned < count; ++spawned) {
+        requests[spawned].pid = Spawn(requests[spawned].entrypoint, requests[spawned].priority, requests[spawned].stackSize);
+        if (requests[spawned].pid == -1)
+            break;
+    }
+    return spawned;
+}
+
 common::uint32_t TaskManager::Execve(void (*entrypoint)()) 
 {
     Task* runningTask = GetCurrentTask();
     runningTask->Reset(gdt, entrypoint);
+    ReleaseFpu(runningTask, false);
+    runningTask->usesFpu = false;
    
     return (common::uint32_t) runningTask->GetCPUState();
 }
@@ -210,32 +1976,18 @@ common::uint32_t TaskManager::Waitpid(common::uint32_t pid, CPUState* cpustate)
     // Waiting for any child of the current process
     if (pid == -1) {
         
-        // Search through processes to find if there is a child which has been terminated
-        uint32_t childId = 0;
-        uint32_t childNum = 0;
-        bool isFound = false;
-        Task* task = 0; // null
-        for (int i = 0; i < numTasks && !isFound; ++i) {
-            task = &tasks[i];
-            if (!task->GetParentTookInWait() && task->GetPPid() == runningTask->GetPid()) {
-                ++childNum;
-                if (task->GetState() == State::Terminated) {
-                    childId = task->GetPid();
-                    isFound = true;
-                }
-            }
-        }
-        
-        // A terminated child is found
-        if (isFound) {
-            task->SetParentTookInWait(true);
+        // A terminated child is found: take the one which terminated first
+        if (runningTask->zombieHead != 0) {
+            Task* task = runningTask->zombieHead;
+            uint32_t childId = task->GetPid();
+            ReapChild(task);
             cpustate->eax = childId;
             return (common::uint32_t) cpustate;
         }
         
         // Not found any child
-        if (childNum == 0) {
-            cpustate->eax = childId = -1;
+        if (runningTask->numChildren == 0) {
+            cpustate->eax = -1;
             runningTask->waitingChild = false;
             return (common::uint32_t) cpustate;
         }
@@ -250,16 +2002,10 @@ common::uint32_t TaskManager::Waitpid(common::uint32_t pid, CPUState* cpustate)
     }
     
     // Waiting for specific pid if it is actually the child of the current process
-    if (pid >= numTasks) {
-        cpustate->eax = -1;
-        runningTask->waitingChild = false;
-        return (common::uint32_t) cpustate;
-    }
-
-    Task* task = &tasks[pid];
+    Task* task = FindTask(pid);
     
     // The process with given pid is not child of this process
-    if (task->GetParentTookInWait() || task->GetPPid() != runningTask->GetPid()) {
+    if (task == 0 || task->parent != runningTask) {
         cpustate->eax = -1;
         runningTask->waitingChild = false;
         return (common::uint32_t) cpustate;
@@ -267,7 +2013,7 @@ common::uint32_t TaskManager::Waitpid(common::uint32_t pid, CPUState* cpustate)
     
     // The task is the child of the process as we check above, and its state is Terminated.
     if (task->GetState() == State::Terminated) {
-        task->SetParentTookInWait(true);
+        ReapChild(task);
         cpustate->eax = pid;
         return (common::uint32_t) cpustate;
     }
@@ -284,21 +2030,42 @@ common::uint32_t TaskManager::Exit()
 {
     Task* runningTask = GetCurrentTask();
     runningTask->SetState(State::Terminated);
+    StopRunning(runningTask);
+    runningTask->statistics.exitTime = ReadTimeStampCounter();
+    runningTask->statistics.exitTick = ticks;
+    
+    // The waiters of its mutexes would block forever otherwise
+    ReleaseMutexes(runningTask);
+    
+    if (runningTask->realTime) {
+        processors[runningTask->cpu].realTimeUtilization -= runningTask->utilization;
+        runningTask->realTime = false;
+    }
+    
+    // Readers of its pipes see the end of the stream once no writer is left
+    CloseDescriptors(runningTask);
+    
+    // Nobody can wait for the children of this task anymore
+    OrphanChildren(runningTask);
     
     // First check if the runningTask has a parent (init process does not have parent)
-    if (runningTask->GetPPid() != -1) {
-        Task* parent = &tasks[runningTask->GetPPid()];
-        
+    Task* parent = runningTask->parent;
+    if (parent != 0) {
         // Check if parent is waiting for a child, and the pid is either -1 or the pid of this task
         if (parent->waitingChild && (parent->waitingChildId == -1 || parent->waitingChildId == runningTask->GetPid())) 
         {
-            runningTask->SetParentTookInWait(true);
-            
             parent->waitingChild = false;
             AddToReadyQueue(parent);
             
             CPUState* parentCpuState = parent->GetCPUState();
             parentCpuState->eax = runningTask->GetPid();
+            
+            parent->lastChildStatistics = runningTask->statistics;
+            UnlinkChild(runningTask);
+            runningTask->SetParentTookInWait(true);
+        }
+        else {
+            PushZombie(runningTask);
         }
     }
     
@@ -313,99 +2080,276 @@ common::uint32_t TaskManager::Exit()
         PrintProcessTable();
     }
     
+    // A terminated task does not need its stack or its registers anymore, even if its parent has not waited for it yet
+    FreeStack(runningTask);
+    ReleaseFpu(runningTask, false);
+    
+    // The slot can be reused if no parent will wait for this task
+    if (parent == 0 || runningTask->GetParentTookInWait()) {
+        ReleaseTask(runningTask);
+    }
+    
     return (common::uint32_t) Schedule();
 }
 
 void TaskManager::AddToReadyQueue(Task* task) 
 {
+    if (task->GetState() != State::Ready) {
+        task->readySince = ReadTimeStampCounter();
+        task->readySinceTick = ticks;
+    }
     task->SetState(State::Ready);
     
-    if (schedulerType == SchedulerType::RoundRobin) {
+    if (task->realTime) {
+        processors[task->cpu].realTimeQueue.PushBack(task, 0);
+    }
+    else if (schedulerType == SchedulerType::RoundRobin) {
         AddToReadyQueueRoundRobin(task);
     }
+    else if (schedulerType == SchedulerType::MultilevelFeedbackQueue) {
+        AddToReadyQueueMultilevelFeedbackQueue(task);
+    }
+    else if (schedulerType == SchedulerType::Stride) {
+        AddToReadyQueueStride(task);
+    }
     else {
         AddToReadyQueuePreemptivePriority(task);
     }
 }
 
+// A task waits in the ready queue of the CPU it ran on last, or which it was given when it was added
 void TaskManager::AddToReadyQueueRoundRobin(Task* task) 
 {
-    // Add the element at the tail
-    readyQueue[queueLen] = task;
-    ++queueLen;
+    // Add the element at the tail, every task shares the same level
+    processors[task->cpu].readyQueue.PushBack(task, 0);
 }
 
 void TaskManager::AddToReadyQueuePreemptivePriority(Task* task) 
 {
-    // Insertion sort since it is an online sorting algorithm
-    readyQueue[queueLen] = task; // Put it at the end firstly
-    
-    int priority = task->GetPriority();
-    int arrivalOrder = task->GetArrivalOrder();
+    // Each priority has its own FIFO level, so no sorting is needed. Aging starts over at the task's own priority.
+    task->levelSinceTick = ticks;
+    processors[task->cpu].readyQueue.PushBack(task, task->GetPriority());
+}
+
+// Moves the tasks which have waited agingTicks in their level one level up, in front of the tasks which have not aged.
+// The head of a level has waited the longest, so a tick costs one check per level plus one per moved task.
+void TaskManager::AgeReadyTasks(Processor* processor) 
+{
+    ReadyQueue* readyQueue = &processor->readyQueue;
+    for (common::uint32_t level = Priority::Medium; level <= Priority::Low; ++level) {
+        Task* task = readyQueue->Head(level);
+        while (task != 0 && ticks - task->levelSinceTick >= agingTicks) {
+            readyQueue->Remove(task);
+            task->levelSinceTick = ticks;
+            readyQueue->PushFront(task, level - 1);
+            task = readyQueue->Head(level);
+        }
+    }
+}
+
+void TaskManager::AddToReadyQueueMultilevelFeedbackQueue(Task* task) 
+{
+    processors[task->cpu].readyQueue.PushBack(task, task->mlfqLevel);
+}
+
+// A task which was not ready for a while must not catch up on the time it missed, so its pass
+// is moved up to the pass of the CPU. Otherwise it would run alone until its pass reaches the others.
+void TaskManager::AddToReadyQueueStride(Task* task) 
+{
+    Processor* processor = &processors[task->cpu];
+    if (task->pass < processor->pass) task->pass = processor->pass;
+    processor->readyQueue.PushBack(task, 0);
+}
+
+ReadyQueue* TaskManager::ReadyQueueOf(Task* task) 
+{
+    return task->realTime ? &processors[task->cpu].realTimeQueue : &processors[task->cpu].readyQueue;
+}
+
+// Puts the preempted running task back to the ready queue
+void TaskManager::ReturnToReadyQueue(Task* task) 
+{
+    task->readySince = ReadTimeStampCounter();
+    task->readySinceTick = ticks;
+    task->SetState(State::Ready);
+    ReadyQueue* readyQueue = &processors[task->cpu].readyQueue;
     
-    bool isDone = false;
-    int i = queueLen - 1;
-    while (i >= 0 && !isDone) {
-        int othPriority = readyQueue[i] -> GetPriority();
-        int othArrivalOrder = readyQueue[i]->GetArrivalOrder();
-        
-        if (priority < othPriority || (priority == othPriority && arrivalOrder < othArrivalOrder)) {
-            readyQueue[i + 1] = readyQueue[i];
-            --i;
+    if (task->realTime) {
+        processors[task->cpu].realTimeQueue.PushBack(task, 0);
+    }
+    else if (schedulerType == SchedulerType::RoundRobin) {
+        AddToReadyQueueRoundRobin(task);
+    }
+    else if (schedulerType == SchedulerType::MultilevelFeedbackQueue) {
+        // A task which still has time left in its slice was preempted by a higher level, so it continues first in its level.
+        // Otherwise it is demoted already and waits behind the tasks of its new level.
+        if (task->sliceTicks > 0) readyQueue->PushFront(task, task->mlfqLevel);
+        else readyQueue->PushBack(task, task->mlfqLevel);
+    }
+    else if (schedulerType == SchedulerType::Stride) {
+        // Its pass has grown while it ran, which decides its place
+        readyQueue->PushBack(task, 0);
+    }
+    else {
+        // Tasks with the same priority do not preempt each other, so the preempted task keeps its place at the head.
+        // At the end of its slice it lets a task which aged into its level go first.
+        common::uint32_t level = task->GetPriority();
+        Task* head = readyQueue->Head(level);
+        task->levelSinceTick = ticks;
+        readyQueue->PushFront(task, level);
+        if (task->sliceTicks == 0 && head != 0 && head->GetPriority() > level) {
+            readyQueue->Remove(head);
+            readyQueue->PushFront(head, level);
         }
-        else isDone = true;
     }
-    readyQueue[i + 1] = task;
-    ++queueLen;
 }
 
-Task* TaskManager::PopFromReadyQueue() 
+Task* TaskManager::PopFromReadyQueue(Processor* processor) 
 {
-    // Remove and return head 
-    Task* task = readyQueue[0]; // We know there is at least one element before calling this method already, so no need to extra check
-    for (int i = 1; i < queueLen; ++i) {
-        readyQueue[i - 1] = readyQueue[i];
+    // Remove and return head of the highest priority non-empty level, or take a task from another CPU
+    Task* task = processor->readyQueue.PopFront();
+    if (task == 0 && numProcessors > 1) {
+        task = StealTask(processor);
     }
-    --queueLen;
     return task;
 }
 
-// Round robin schedule
-CPUState* TaskManager::RoundRobinSchedule() 
+// Makes the head of the ready queue of this CPU the running task
+CPUState* TaskManager::DispatchNextTask() 
 {
     // Ready process'ler arasindan bulup verilen strategy degiskenine gore next process'i bulup running yapacak
-    int oldTask = currentTask;
+    Processor* processor = CurrentProcessor();
+    Task* oldTask = processor->currentTask;
     
-    Task* task = PopFromReadyQueue();
+    // Real-time tasks first. Nothing to run, so halt until an interrupt makes a task ready.
+    Task* task = processor->realTimeQueue.PopFront();
+    if (task == 0) task = PopFromReadyQueue(processor);
+    if (task == 0) task = &processor->idleTask;
     task->SetState(State::Running);
-    currentTask = task->GetPid();
+    processor->currentTask = task;
+    if (schedulerType == SchedulerType::Stride && !IsIdleTask(task) && !task->realTime && task->pass > processor->pass) {
+        processor->pass = task->pass;
+    }
+    
+    if (oldTask != task) {
+        if (oldTask != 0) StopRunning(oldTask);
+        StartRunning(task);
+        SwitchFpu(processor, oldTask, task);
+        PublishRunningTask(processor, task);
+    }
     
     // If there is a context switch, then print the process table
-    if (processTablePrintType == ProcessTablePrintType::PrintEveryTimeInterrupt || (oldTask != currentTask && processTablePrintType == ProcessTablePrintType::PrintEverySwitch)) 
+    if (processTablePrintType == ProcessTablePrintType::PrintEveryTimeInterrupt || (oldTask != task && processTablePrintType == ProcessTablePrintType::PrintEverySwitch)) 
     {
         PrintProcessTable();
     }
     
-    return tasks[currentTask].cpustate;
+    return task->cpustate;
+}
+
+// Round robin schedule
+CPUState* TaskManager::RoundRobinSchedule() 
+{
+    // The single level of the ready queue is in arrival order to the queue
+    return DispatchNextTask();
 }
 
 // Preemptive priority schedule
 CPUState* TaskManager::PreemptivePrioritySchedule() 
 {
-    // Ready process'ler arasindan bulup verilen strategy degiskenine gore next process'i bulup running yapacak
-    int oldTask = currentTask;
+    // The ready queue levels are the priorities, so its head is the earliest task with the highest priority
+    return DispatchNextTask();
+}
+
+// Multilevel feedback queue schedule
+CPUState* TaskManager::MultilevelFeedbackQueueSchedule() 
+{
+    // The ready queue levels are the feedback levels, so its head is the earliest task in the highest level
+    return DispatchNextTask();
+}
+
+// Stride schedule
+CPUState* TaskManager::StrideSchedule() 
+{
+    // The ready queue is ordered by pass, so its head is the task which is furthest behind its share
+    return DispatchNextTask();
+}
+
+// Length of the current time slice of the task in timer ticks
+common::uint32_t TaskManager::TimeSlice(Task* task) 
+{
+    common::uint32_t slice = task->quantum != 0 ? task->quantum : quanta[task->GetPriority()];
+    if (schedulerType == SchedulerType::MultilevelFeedbackQueue) {
+        slice *= MLFQ_QUANTA[task->mlfqLevel];
+    }
+    return slice;
+}
+
+// Charges one timer tick to the running task and returns true if it should keep the CPU
+bool TaskManager::ContinueTimeSlice(Task* task) 
+{
+    ++task->sliceTicks;
+    task->pass += task->stride;
     
-    Task* task = PopFromReadyQueue();
-    task->SetState(State::Running);
-    currentTask = task->GetPid();
+    // A real-time job runs until it completes, its budget is used up or a job with an earlier deadline is ready.
+    // Without budget, it waits for its next period so that it cannot take time from the other real-time tasks.
+    ReadyQueue* realTimeQueue = &processors[task->cpu].realTimeQueue;
+    if (task->realTime) {
+        task->sliceTicks = 0;
+        if (--task->budgetLeft == 0) {
+            ++task->statistics.deadlineMisses;
+            ReleaseNextJob(task);
+            return false;
+        }
+        Task* first = realTimeQueue->First();
+        return first == 0 || (common::int32_t) (first->absoluteDeadline - task->absoluteDeadline) >= 0;
+    }
     
-    // If there is a context switch, then print the process table
-    if (processTablePrintType == ProcessTablePrintType::PrintEveryTimeInterrupt || (oldTask != currentTask && processTablePrintType == ProcessTablePrintType::PrintEverySwitch)) 
-    {
-        PrintProcessTable();
+    // The task used its whole slice. In multilevel feedback queue, it also moves one level down.
+    if (task->sliceTicks >= TimeSlice(task)) {
+        if (schedulerType == SchedulerType::MultilevelFeedbackQueue && task->mlfqLevel + 1 < MLFQ_NUM_LEVELS) {
+            ++task->mlfqLevel;
+        }
+        task->sliceTicks = 0;
+        return false;
+    }
+    
+    // Preempt the task if a real-time task or a higher level task is ready on this CPU
+    if (!realTimeQueue->IsEmpty())
+        return false;
+    ReadyQueue* readyQueue = &processors[task->cpu].readyQueue;
+    if (schedulerType == SchedulerType::MultilevelFeedbackQueue) {
+        return readyQueue->HighestLevel() >= task->mlfqLevel;
+    }
+    if (schedulerType == SchedulerType::PreemptivePriority) {
+        // An aged task keeps the level it was dispatched from until its slice is over
+        common::uint32_t level = task->GetPriority();
+        if (task->readyLevel < level) level = task->readyLevel;
+        return readyQueue->HighestLevel() >= level;
+    }
+    return true;
+}
+
+// Moves every task back to the top level so that demoted tasks cannot starve
+void TaskManager::BoostMultilevelFeedbackQueue() 
+{
+    for (int i = 0; i < numSlots; ++i) {
+        Task* task = &tasks[i];
+        task->mlfqLevel = 0;
+        task->sliceTicks = 0;
+    }
+    
+    // Requeue the waiting tasks in their current dispatch order
+    for (common::uint32_t cpu = 0; cpu < numProcessors; ++cpu) {
+        ReadyQueue* readyQueue = &processors[cpu].readyQueue;
+        int len = readyQueue->Length();
+        for (int i = 0; i < len; ++i) {
+            Task* task = readyQueue->PopFront();
+            readyQueue->PushBack(task, 0);
+        }
     }
     
-    return tasks[currentTask].cpustate;
+    slicesSinceBoost = 0;
 }
 
 // Schedules the next process according to the scheduler type
@@ -414,28 +2358,50 @@ CPUState* TaskManager::Schedule()
     if (schedulerType == SchedulerType::RoundRobin) {
         return RoundRobinSchedule();
     }
+    if (schedulerType == SchedulerType::MultilevelFeedbackQueue) {
+        return MultilevelFeedbackQueueSchedule();
+    }
+    if (schedulerType == SchedulerType::Stride) {
+        return StrideSchedule();
+    }
     return PreemptivePrioritySchedule();
 }
 
 // Finds the process with given pid if any, and removes it from the queue
 void TaskManager::RemoveFromReadyQueue(int pid) 
 {
-    int idx = -1;
-    for (int i = 0; i < queueLen && idx == -1; ++i) {
-        if (readyQueue[i]->GetPid() == pid) {
-            idx = i;
-        }
-    }
-    if (idx != -1) {
-        for (int i = idx + 1; i < queueLen; ++i) {
-            readyQueue[i - 1] = readyQueue[i];
-        }
-        --queueLen;
+    Task* task = FindTask(pid);
+    if (task != 0) {
+        ReadyQueueOf(task)->Remove(task);
     }
 }
 
 CPUState* TaskManager::Schedule(CPUState* cpustate)
 {
+    // The bootstrap processor keeps the time, every CPU counts its own ticks
+    Processor* processor = CurrentProcessor();
+    Task* currentTask = processor->currentTask;
+    bool bootstrapProcessor = processor == &processors[0];
+    if (bootstrapProcessor) {
+        ++ticks;
+        if (kernelData != 0) {
+            kernelData->ticks = ticks;
+            millisecondRemainder += 1000;
+            kernelData->milliseconds += millisecondRemainder / timerFrequency;
+            millisecondRemainder %= timerFrequency;
+        }
+    }
+    ++processor->ticks;
+    if (currentTask != 0 && IsIdleTask(currentTask)) {
+        ++processor->idleTicks;
+    }
+    if (currentTask != 0) {
+        ++currentTask->statistics.cpuTicks;
+    }
+    if (bootstrapProcessor) {
+        WakeSleepingTasks();
+    }
+    
     if(numTasks <= 0)
         return cpustate;
     
@@ -444,25 +2410,26 @@ CPUState* TaskManager::Schedule(CPUState* cpustate)
         return cpustate;
     }
     
-    // If collatz task added, then increment the "interruptNumAfterCollatz" counter
-    if (interruptNumAfterCollatz != -1) ++interruptNumAfterCollatz;
+    // Waiting tasks rise in priority before the running task is compared with them
+    if (agingTicks != 0 && schedulerType == SchedulerType::PreemptivePriority) {
+        AgeReadyTasks(processor);
+    }
     
-    // In strategy 4, the collatz's priority is set to High after 5th interrupt
-    if (lifeCycleType == LifeCycleType::LifeCycleB4 && interruptNumAfterCollatz == 5) {
-        printf("\nBEFORE 5th INTERRUPT (SEE TABLE BELOW) : \n");
-        --interruptNumAfterCollatz;
-        PrintProcessTable();   
-        Helper::Delay();
-        
-        RemoveFromReadyQueue(collatzTask->GetPid());
-        collatzTask->SetPriority(Priority::High);
-        AddToReadyQueue(collatzTask);
-        
-        ++interruptNumAfterCollatz;
-        PrintProcessTable();
-        Helper::Delay();
+    // The running task keeps the CPU until its time slice is over or a higher level task is ready.
+    // The idle task is left as soon as any task is ready.
+    if (currentTask != 0) {
+        currentTask->cpustate = cpustate;
+        if (IsIdleTask(currentTask) ? !HasReadyTask(processor) : ContinueTimeSlice(currentTask)) {
+            if (processTablePrintType == ProcessTablePrintType::PrintEveryTimeInterrupt) {
+                PrintProcessTable();
+            }
+            return cpustate;
+        }
     }
     
+    // If collatz task added, then increment the "interruptNumAfterCollatz" counter
+    if (interruptNumAfterCollatz != -1) ++interruptNumAfterCollatz;
+    
     // If 5th interrupt after collatz tasks started, then unblock the init process which is blocked after adding collatz task to ready queue.
     if (lifeCycleType == LifeCycleType::LifeCycleB3 && interruptNumAfterCollatz != -1) {
         if (interruptNumAfterCollatz == 5 && blockedTaskForCollatz != 0) {
@@ -479,9 +2446,13 @@ CPUState* TaskManager::Schedule(CPUState* cpustate)
         }
     }
     
-    if(currentTask >= 0) {
-        tasks[currentTask].cpustate = cpustate;
-        AddToReadyQueue(&tasks[currentTask]);
+    if (schedulerType == SchedulerType::MultilevelFeedbackQueue && ++slicesSinceBoost >= MLFQ_BOOST_PERIOD) {
+        BoostMultilevelFeedbackQueue();
+    }
+    
+    // A real-time task without budget is sleeping until its next period
+    if(currentTask != 0 && !IsIdleTask(currentTask) && currentTask->GetState() == State::Running) {
+        ReturnToReadyQueue(currentTask);
     }
     
     return Schedule();
@@ -489,7 +2460,7 @@ CPUState* TaskManager::Schedule(CPUState* cpustate)
 
 Task* TaskManager::GetCurrentTask() 
 {
-    return &tasks[currentTask];
+    return CurrentProcessor()->currentTask;
 }
 
 
@@ -524,27 +2495,63 @@ void TaskManager::PrintProcessInfo(Task* task)
             break;
     }
 
-    printInteger(task->GetPriority());
+    // In multilevel feedback queue, the current level is the priority of the task. In stride scheduling, it is the tickets.
+    if (schedulerType == SchedulerType::MultilevelFeedbackQueue) {
+        printInteger(task->mlfqLevel);
+    }
+    else if (schedulerType == SchedulerType::Stride) {
+        printInteger(task->tickets);
+    }
+    else {
+        printInteger(task->GetPriority());
+    }
     
     printf("  ");
     printInteger(task->GetArrivalOrder());
     
+    // Ticks on the CPU and in the ready queue, voluntary/involuntary switches
+    printf("   ");
+    printInteger(task->statistics.cpuTicks);
+    printf("  ");
+    printInteger(task->statistics.waitTicks);
+    printf("  ");
+    printInteger(task->statistics.voluntarySwitches);
+    printf("/");
+    printInteger(task->statistics.involuntarySwitches);
+    
+    // Deadline misses out of the completed jobs of a real-time task
+    if (task->realTime) {
+        printf("  RT ");
+        printInteger(task->statistics.deadlineMisses);
+        printf("/");
+        printInteger(task->statistics.completedJobs);
+    }
+    
     printf("\n");
 }
 
 void TaskManager::PrintProcessTable() 
 {
     printf("********************************** \n");
-    printf("PID PPID   State   Priority   Arrival Order \n");
+    printf("PID PPID   State   Priority   Arrival Order   CPU  Wait  Switches \n");
     
-    for (int i = 0; i < numTasks; ++i) {
+    // Reaped slots are shown as terminated until they are reused
+    for (int i = 0; i < numSlots; ++i) {
         PrintProcessInfo(&tasks[i]);
     }
 
     printf("Ready queue PIDs: ");
-    for (int i = 0; i < queueLen; ++i) {
-        printInteger(readyQueue[i]->GetPid());
-        printf(" ");
+    for (common::uint32_t cpu = 0; cpu < numProcessors; ++cpu) {
+        ReadyQueue* readyQueue = &processors[cpu].readyQueue;
+        if (numProcessors > 1) {
+            printf("[CPU");
+            printInteger(cpu);
+            printf("] ");
+        }
+        for (Task* task = readyQueue->First(); task != 0; task = readyQueue->Next(task)) {
+            printInteger(task->GetPid());
+            printf(" ");
+        }
     }
     printf("\n");
     
@@ -552,6 +2559,26 @@ void TaskManager::PrintProcessTable()
     printInteger(interruptNumAfterCollatz);
     printf("\n");
     
+    // Summed over all CPUs
+    uint32_t idleTicks = 0;
+    uint32_t cpuTicks = 0;
+    for (common::uint32_t cpu = 0; cpu < numProcessors; ++cpu) {
+        idleTicks += processors[cpu].idleTicks;
+        cpuTicks += processors[cpu].ticks;
+    }
+    printf("Idle ticks: ");
+    printInteger(idleTicks);
+    printf(" of ");
+    printInteger(cpuTicks);
+    if (cpuTicks != 0) {
+        // Avoid overflowing busy * 100 after a long uptime
+        uint32_t busy = cpuTicks - idleTicks;
+        printf(" (CPU busy ");
+        printInteger(cpuTicks < 0x1000000 ? busy * 100 / cpuTicks : busy / (cpuTicks / 100));
+        printf("%)");
+    }
+    printf("\n");
+    
     printf("********************************** \n");
     
     /* REMOVE THIS DELAY IF YOU WANT TO SEE THE WHOLE RESULT IMMEDIATELY */
@@ -0,0 +1,363 @@
+
+#include <paging.h>
+
+using namespace myos;
+using namespace myos::common;
+
+
+void printf(char* str);
+void printfHex32(uint32_t);
+
+
+const uint32_t PAGE_PRESENT = 0x001;
+const uint32_t PAGE_WRITABLE = 0x002;
+const uint32_t PAGE_WRITE_THROUGH = 0x008;
+const uint32_t PAGE_CACHE_DISABLED = 0x010;
+const uint32_t PAGE_LARGE = 0x080; // 4 MiB page in a page directory entry
+const uint32_t PAGE_COPY_ON_WRITE = 0x200; // Available bit: shared read-only, copy on the first write
+const uint32_t PAGE_STACK = 0x400; // Available bit: belongs to a task stack, mapped on demand if not present
+const uint32_t PAGE_FRAME_MASK = 0xFFFFF000;
+
+
+static void CopyFrame(uint32_t destination, uint32_t source)
+{
+    uint32_t* dst = (uint32_t*)destination;
+    uint32_t* src = (uint32_t*)source;
+    for (int i = 0; i < PAGE_SIZE / 4; ++i) {
+        dst[i] = src[i];
+    }
+}
+
+static void ClearFrame(uint32_t frame)
+{
+    uint32_t* dst = (uint32_t*)frame;
+    for (int i = 0; i < PAGE_SIZE / 4; ++i) {
+        dst[i] = 0;
+    }
+}
+
+
+
+
+PageFrameAllocator::PageFrameAllocator(BuddyAllocator* buddyAllocator)
+{
+    this->buddyAllocator = buddyAllocator;
+    numFrames = buddyAllocator->MemoryEnd() / PAGE_SIZE;
+    referenceCounts = new uint16_t[numFrames];
+    if (referenceCounts == 0)
+        numFrames = 0;
+    for (uint32_t i = 0; i < numFrames; ++i) {
+        referenceCounts[i] = 0;
+    }
+}
+
+PageFrameAllocator::~PageFrameAllocator()
+{
+    delete[] referenceCounts;
+}
+
+uint32_t PageFrameAllocator::AllocateFrame()
+{
+    uint32_t frame = buddyAllocator->Allocate(0);
+    if (frame == 0)
+        return 0;
+    if (frame / PAGE_SIZE >= numFrames) {
+        buddyAllocator->Free(frame, 0);
+        return 0;
+    }
+
+    referenceCounts[frame / PAGE_SIZE] = 1;
+    return frame;
+}
+
+void PageFrameAllocator::Share(uint32_t frame)
+{
+    ++referenceCounts[frame / PAGE_SIZE];
+}
+
+void PageFrameAllocator::Release(uint32_t frame)
+{
+    if (--referenceCounts[frame / PAGE_SIZE] == 0) {
+        buddyAllocator->Free(frame, 0);
+    }
+}
+
+uint16_t PageFrameAllocator::ReferenceCount(uint32_t frame)
+{
+    return referenceCounts[frame / PAGE_SIZE];
+}
+
+uint32_t PageFrameAllocator::FreeFrames()
+{
+    return buddyAllocator->FreeFrames();
+}
+
+
+
+
+
+uint32_t PagingManager::pageDirectory[1024] __attribute__((aligned(4096)));
+uint32_t PagingManager::stackPageTables[STACK_AREA_SIZE / (4*1024*1024)][1024] __attribute__((aligned(4096)));
+uint32_t PagingManager::sharedPageTable[1024] __attribute__((aligned(4096)));
+TaskStateSegment PagingManager::kernelTaskStateSegments[MAX_NUM_CPUS];
+TaskStateSegment PagingManager::pageFaultTaskStateSegments[MAX_NUM_CPUS];
+uint8_t PagingManager::pageFaultStacks[MAX_NUM_CPUS][8192];
+
+PagingManager* PagingManager::activePagingManager = 0;
+
+PagingManager::PagingManager(GlobalDescriptorTable* gdt, PageFrameAllocator* frameAllocator)
+{
+    this->gdt = gdt;
+    this->frameAllocator = frameAllocator;
+    pageFaultTaskSelector = 0;
+
+    // Identity map the whole address space with 4 MiB pages
+    for (uint32_t i = 0; i < 1024; ++i) {
+        pageDirectory[i] = (i << 22) | PAGE_LARGE | PAGE_WRITABLE | PAGE_PRESENT;
+    }
+    pageDirectory[1023] |= PAGE_CACHE_DISABLED | PAGE_WRITE_THROUGH; // The local and I/O APIC registers are in the last 4 MiB
+
+    // except the stack area which gets its own page tables, filled per task
+    const uint32_t numStackPageTables = STACK_AREA_SIZE / (4*1024*1024);
+    for (uint32_t t = 0; t < numStackPageTables; ++t) {
+        for (int i = 0; i < 1024; ++i) {
+            stackPageTables[t][i] = 0;
+        }
+        pageDirectory[(STACK_AREA_BASE >> 22) + t] = (uint32_t)stackPageTables[t] | PAGE_WRITABLE | PAGE_PRESENT;
+    }
+    for (int i = 0; i < 1024; ++i) {
+        sharedPageTable[i] = 0;
+    }
+    pageDirectory[(STACK_AREA_BASE + STACK_AREA_SIZE) >> 22] = (uint32_t)sharedPageTable | PAGE_WRITABLE | PAGE_PRESENT;
+
+    activePagingManager = this;
+}
+
+PagingManager::~PagingManager()
+{
+    if (activePagingManager == this)
+        activePagingManager = 0;
+}
+
+void PagingManager::Activate()
+{
+    ActivateProcessor(gdt, 0);
+}
+
+void PagingManager::ActivateProcessor(GlobalDescriptorTable* gdt, uint32_t cpu)
+{
+    // The CPU saves the interrupted state here when it switches to the page fault task
+    TaskStateSegment* kernelTaskStateSegment = &kernelTaskStateSegments[cpu];
+    kernelTaskStateSegment->ioMapBase = sizeof(TaskStateSegment);
+    kernelTaskStateSegment->cr3 = (uint32_t)pageDirectory;
+    uint16_t kernelTaskSelector = gdt->SetTaskStateSegment(0, kernelTaskStateSegment);
+
+    TaskStateSegment* pageFaultTaskStateSegment = &pageFaultTaskStateSegments[cpu];
+    pageFaultTaskStateSegment->ioMapBase = sizeof(TaskStateSegment);
+    pageFaultTaskStateSegment->cr3 = (uint32_t)pageDirectory;
+    pageFaultTaskStateSegment->eip = (uint32_t)&PageFaultTask;
+    pageFaultTaskStateSegment->eflags = 0x2; // Interrupts stay disabled while a fault is handled
+    pageFaultTaskStateSegment->esp = (uint32_t)(pageFaultStacks[cpu] + sizeof(pageFaultStacks[cpu]));
+    pageFaultTaskStateSegment->cs = gdt->CodeSegmentSelector();
+    pageFaultTaskStateSegment->ss = gdt->DataSegmentSelector();
+    pageFaultTaskStateSegment->ds = gdt->DataSegmentSelector();
+    pageFaultTaskStateSegment->es = gdt->DataSegmentSelector();
+    pageFaultTaskStateSegment->fs = gdt->DataSegmentSelector();
+    pageFaultTaskStateSegment->gs = gdt->DataSegmentSelector();
+    pageFaultTaskSelector = gdt->SetTaskStateSegment(1, pageFaultTaskStateSegment);
+
+    asm volatile("ltr %0" : : "r" (kernelTaskSelector));
+
+    uint32_t cr4;
+    asm volatile("mov %%cr4, %0" : "=r" (cr4));
+    cr4 |= 0x10; // PSE: 4 MiB pages
+    asm volatile("mov %0, %%cr4" : : "r" (cr4));
+
+    asm volatile("mov %0, %%cr3" : : "r" (pageDirectory));
+
+    uint32_t cr0;
+    asm volatile("mov %%cr0, %0" : "=r" (cr0));
+    cr0 |= 0x80010000; // PG: enable paging, WP: read-only pages are read-only for the kernel too
+    asm volatile("mov %0, %%cr0" : : "r" (cr0));
+}
+
+uint16_t PagingManager::PageFaultTaskSegmentSelector()
+{
+    return pageFaultTaskSelector;
+}
+
+uint32_t* PagingManager::StackPageTableEntry(uint32_t address)
+{
+    return &stackPageTables[0][0] + ((address - STACK_AREA_BASE) >> 12);
+}
+
+void PagingManager::SetStackPageTableEntry(uint32_t address, uint32_t entry)
+{
+    *StackPageTableEntry(address) = entry;
+    asm volatile("invlpg (%0)" : : "r" (address) : "memory");
+}
+
+uint32_t PagingManager::MapSharedPage(uint32_t address)
+{
+    uint32_t frame = frameAllocator->AllocateFrame();
+    if (frame == 0)
+        return 0;
+    for (uint32_t i = 0; i < PAGE_SIZE / 4; ++i) {
+        ((uint32_t*) frame)[i] = 0;
+    }
+    
+    sharedPageTable[(address >> 12) & 0x3FF] = frame | PAGE_PRESENT;
+    asm volatile("invlpg (%0)" : : "r" (address) : "memory");
+    return frame;
+}
+
+bool PagingManager::PrepareStack(uint32_t base, uint32_t size)
+{
+    TrimStack(base, size);
+
+    // The initial CPUState is written to the top page right away
+    uint32_t top = base + size - PAGE_SIZE;
+    if (*StackPageTableEntry(top) & PAGE_PRESENT)
+        return true;
+
+    uint32_t frame = frameAllocator->AllocateFrame();
+    if (frame == 0)
+        return false;
+    SetStackPageTableEntry(top, frame | PAGE_STACK | PAGE_WRITABLE | PAGE_PRESENT);
+    return true;
+}
+
+bool PagingManager::CloneStack(uint32_t base, uint32_t parentBase, uint32_t size, uint32_t privateFrom)
+{
+    TrimStack(base, size);
+
+    uint32_t privatePage = privateFrom & PAGE_FRAME_MASK;
+    for (uint32_t offset = 0; offset < size; offset += PAGE_SIZE) {
+        uint32_t parentAddress = parentBase + offset;
+        uint32_t parentEntry = *StackPageTableEntry(parentAddress);
+        uint32_t entry = PAGE_STACK;
+
+        // Only a private top page is left of the stack which was here before
+        uint32_t oldEntry = *StackPageTableEntry(base + offset);
+        uint32_t oldFrame = (oldEntry & PAGE_PRESENT) ? (oldEntry & PAGE_FRAME_MASK) : 0;
+
+        if (parentAddress == privatePage && (parentEntry & PAGE_PRESENT)) {
+            // Both tasks write to this page immediately (the parent runs on it, the child gets its CPUState here)
+            uint32_t frame = oldFrame != 0 ? oldFrame : frameAllocator->AllocateFrame();
+            oldFrame = 0;
+            if (frame == 0) {
+                ReleaseStack(base, size);
+                return false;
+            }
+            CopyFrame(frame, parentEntry & PAGE_FRAME_MASK);
+            entry = frame | PAGE_STACK | PAGE_WRITABLE | PAGE_PRESENT;
+        }
+        else if (parentAddress > privatePage && (parentEntry & PAGE_PRESENT)) {
+            uint32_t frame = parentEntry & PAGE_FRAME_MASK;
+            frameAllocator->Share(frame);
+            entry = frame | PAGE_STACK | PAGE_COPY_ON_WRITE | PAGE_PRESENT;
+            if (parentEntry & PAGE_WRITABLE) {
+                SetStackPageTableEntry(parentAddress, entry);
+            }
+        }
+
+        if (oldFrame != 0) {
+            frameAllocator->Release(oldFrame);
+        }
+        SetStackPageTableEntry(base + offset, entry);
+    }
+    return true;
+}
+
+void PagingManager::ReleaseStack(uint32_t base, uint32_t size)
+{
+    for (uint32_t address = base; address < base + size; address += PAGE_SIZE) {
+        uint32_t entry = *StackPageTableEntry(address);
+        if (entry & PAGE_PRESENT) {
+            frameAllocator->Release(entry & PAGE_FRAME_MASK);
+        }
+        if (entry != 0) {
+            SetStackPageTableEntry(address, 0);
+        }
+    }
+}
+
+void PagingManager::TrimStack(uint32_t base, uint32_t size)
+{
+    uint32_t top = base + size - PAGE_SIZE;
+    for (uint32_t address = base; address < base + size; address += PAGE_SIZE) {
+        uint32_t entry = *StackPageTableEntry(address);
+        if (address == top && (entry & PAGE_PRESENT) && (entry & PAGE_WRITABLE))
+            continue;
+
+        if (entry & PAGE_PRESENT) {
+            frameAllocator->Release(entry & PAGE_FRAME_MASK);
+        }
+        if (entry != PAGE_STACK) {
+            SetStackPageTableEntry(address, PAGE_STACK);
+        }
+    }
+}
+
+void PagingManager::HandlePageFault(uint32_t error)
+{
+    uint32_t address;
+    asm volatile("mov %%cr2, %0" : "=r" (address));
+
+    KernelLock::Acquire();
+    bool handled = activePagingManager != 0 && activePagingManager->DoHandlePageFault(address, error);
+    KernelLock::Release();
+    if (handled)
+        return;
+
+    // Returning would fault again at the same instruction
+    printf("\nPAGE FAULT at 0x");
+    printfHex32(address);
+    printf(" error 0x");
+    printfHex32(error);
+    printf("\n");
+    while (1) {
+        asm volatile("cli\n hlt");
+    }
+}
+
+bool PagingManager::DoHandlePageFault(uint32_t address, uint32_t error)
+{
+    if (address < STACK_AREA_BASE || address >= STACK_AREA_BASE + STACK_AREA_SIZE)
+        return false;
+
+    // Not part of any stack, e.g. the guard page under a stack
+    uint32_t entry = *StackPageTableEntry(address);
+    if (!(entry & PAGE_STACK))
+        return false;
+
+    address &= PAGE_FRAME_MASK;
+
+    // The stack grows into a page which has not been used yet
+    if (!(entry & PAGE_PRESENT)) {
+        uint32_t frame = frameAllocator->AllocateFrame();
+        if (frame == 0)
+            return false;
+        ClearFrame(frame);
+        SetStackPageTableEntry(address, frame | PAGE_STACK | PAGE_WRITABLE | PAGE_PRESENT);
+        return true;
+    }
+
+    // First write to a shared page. The last task sharing a frame can take it over without copying.
+    const uint32_t PAGE_FAULT_WRITE = 0x2;
+    if ((error & PAGE_FAULT_WRITE) && (entry & PAGE_COPY_ON_WRITE)) {
+        uint32_t frame = entry & PAGE_FRAME_MASK;
+        if (frameAllocator->ReferenceCount(frame) > 1) {
+            uint32_t copy = frameAllocator->AllocateFrame();
+            if (copy == 0)
+                return false;
+            CopyFrame(copy, frame);
+            frameAllocator->Release(frame);
+            frame = copy;
+        }
+        SetStackPageTableEntry(address, frame | PAGE_STACK | PAGE_WRITABLE | PAGE_PRESENT);
+        return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,199 @@
+#include <slab.h>
+
+using namespace myos;
+using namespace myos::common;
+
+
+ObjectCache* ObjectCache::firstCache = 0;
+
+ObjectCache::ObjectCache(const char* name, uint32_t size, uint32_t alignment, ObjectFunction constructor, ObjectFunction destructor)
+{
+    this->name = name;
+    this->alignment = alignment < sizeof(void*) ? sizeof(void*) : alignment;
+    this->constructor = constructor;
+    this->destructor = destructor;
+
+    linkOffset = (size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+    stride = (linkOffset + sizeof(void*) + this->alignment - 1) & ~(this->alignment - 1);
+
+    // The heap only aligns the slab to 8 bytes, so up to alignment - 8 bytes go before the first object
+    slabSize = MIN_SLAB_SIZE;
+    while ((slabSize - sizeof(Slab) - (this->alignment - 1)) / stride < MIN_OBJECTS_PER_SLAB) {
+        slabSize *= 2;
+    }
+
+    partialSlabs = 0;
+    fullSlabs = 0;
+    emptySlabs = 0;
+    statistics = ObjectCacheStatistics();
+    statistics.objectSize = stride;
+    statistics.objectsPerSlab = (slabSize - sizeof(Slab) - (this->alignment - 1)) / stride;
+
+    nextCache = firstCache;
+    firstCache = this;
+}
+
+ObjectCache::~ObjectCache()
+{
+    Reap();
+
+    for (ObjectCache** cache = &firstCache; *cache != 0; cache = &(*cache)->nextCache) {
+        if (*cache == this) {
+            *cache = nextCache;
+            break;
+        }
+    }
+}
+
+void*& ObjectCache::Link(void* object)
+{
+    return *(void**)((uint32_t)object + linkOffset);
+}
+
+void* ObjectCache::FirstObject(Slab* slab)
+{
+    return (void*)(((uint32_t)slab + sizeof(Slab) + alignment - 1) & ~(alignment - 1));
+}
+
+void ObjectCache::Move(Slab* slab, Slab** from, Slab** to)
+{
+    if (slab->prev != 0)
+        slab->prev->next = slab->next;
+    else
+        *from = slab->next;
+    if (slab->next != 0)
+        slab->next->prev = slab->prev;
+
+    slab->prev = 0;
+    slab->next = *to;
+    if (*to != 0)
+        (*to)->prev = slab;
+    *to = slab;
+}
+
+// Takes a slab from the heap and constructs all of its objects
+Slab* ObjectCache::Grow()
+{
+    if (MemoryManager::activeMemoryManager == 0)
+        return 0;
+    Slab* slab = (Slab*) MemoryManager::activeMemoryManager->malloc(slabSize);
+    if (slab == 0)
+        return 0;
+
+    slab->cache = this;
+    slab->freeList = 0;
+    slab->objectsInUse = 0;
+
+    // Linked from the end, so the objects are handed out in the order of their addresses
+    uint32_t first = (uint32_t) FirstObject(slab);
+    for (int i = statistics.objectsPerSlab - 1; i >= 0; --i) {
+        void* object = (void*)(first + i * stride);
+        if (constructor != 0)
+            constructor(object);
+        Link(object) = slab->freeList;
+        slab->freeList = object;
+    }
+
+    slab->prev = 0;
+    slab->next = emptySlabs;
+    if (emptySlabs != 0)
+        emptySlabs->prev = slab;
+    emptySlabs = slab;
+
+    ++statistics.slabs;
+    ++statistics.grows;
+    return slab;
+}
+
+// Destroys the objects of an empty slab and gives it back to the heap
+void ObjectCache::Release(Slab* slab)
+{
+    Slab* unused = 0;
+    Move(slab, &emptySlabs, &unused);
+    if (destructor != 0) {
+        for (void* object = slab->freeList; object != 0; object = Link(object)) {
+            destructor(object);
+        }
+    }
+    MemoryManager::activeMemoryManager->free(slab);
+
+    --statistics.slabs;
+    ++statistics.reaps;
+}
+
+void* ObjectCache::Allocate()
+{
+    Slab* slab = partialSlabs;
+    if (slab == 0) {
+        slab = emptySlabs != 0 ? emptySlabs : Grow();
+        if (slab == 0) {
+            ++statistics.failures;
+            return 0;
+        }
+        Move(slab, &emptySlabs, &partialSlabs);
+    }
+
+    void* object = slab->freeList;
+    slab->freeList = Link(object);
+    Link(object) = slab;
+    ++slab->objectsInUse;
+    if (slab->freeList == 0)
+        Move(slab, &partialSlabs, &fullSlabs);
+
+    ++statistics.objectsInUse;
+    ++statistics.allocations;
+    return object;
+}
+
+void ObjectCache::Free(void* object)
+{
+    if (object == 0)
+        return;
+    Slab* slab = (Slab*) Link(object);
+    if (slab == 0 || slab->cache != this)
+        return; // Not an object of this cache in use, e.g. freed twice
+
+    if (slab->freeList == 0)
+        Move(slab, &fullSlabs, &partialSlabs);
+    Link(object) = slab->freeList;
+    slab->freeList = object;
+    --slab->objectsInUse;
+
+    --statistics.objectsInUse;
+    ++statistics.frees;
+
+    // One empty slab stays for the next allocations, the others go back to the heap
+    if (slab->objectsInUse == 0) {
+        bool keep = emptySlabs == 0;
+        Move(slab, &partialSlabs, &emptySlabs);
+        if (!keep)
+            Release(slab);
+    }
+}
+
+void ObjectCache::Reap()
+{
+    while (emptySlabs != 0) {
+        Release(emptySlabs);
+    }
+}
+
+const char* ObjectCache::GetName()
+{
+    return name;
+}
+
+void ObjectCache::GetStatistics(ObjectCacheStatistics* statistics)
+{
+    *statistics = this->statistics;
+}
+
+ObjectCache* ObjectCache::First()
+{
+    return firstCache;
+}
+
+ObjectCache* ObjectCache::Next()
+{
+    return nextCache;
+}
@@ -0,0 +1,259 @@
+
+#include <smp.h>
+#include <gdt.h>
+#include <paging.h>
+#include <multitasking.h>
+#include <hardwarecommunication/apic.h>
+#include <hardwarecommunication/pit.h>
+#include <hardwarecommunication/interrupts.h>
+#include <fpu.h>
+#include <syscalls.h>
+#include <slab.h>
+
+using namespace myos;
+using namespace myos::common;
+using namespace myos::hardwarecommunication;
+
+
+void printf(char* str);
+void printInteger(int num);
+
+
+// Implemented in smptrampoline.s
+extern "C" uint8_t ap_trampoline_start[];
+extern "C" uint8_t ap_trampoline_end[];
+extern "C" uint8_t ap_trampoline_stack[];
+extern "C" uint8_t ap_trampoline_entry[];
+
+const uint32_t TRAMPOLINE_BASE = 0x8000; // Below 1 MiB and 4 KiB aligned, the startup IPI vector is TRAMPOLINE_BASE / 4 KiB
+const uint8_t SPURIOUS_INTERRUPT_VECTOR = 0xFF; // Ignored in the interrupt descriptor table
+const uint8_t APIC_TIMER_INTERRUPT = 0x10; // Relative to the hardware interrupt offset, right after the PIC interrupts
+
+
+// Every AP writes its own GDT (busy bits of its task state segments), so they do not share cache lines
+static ObjectCache gdtCache("GlobalDescriptorTable", sizeof(GlobalDescriptorTable));
+
+
+Spinlock KernelLock::lock;
+volatile int32_t KernelLock::owner = -1;
+volatile int32_t KernelLock::lastOwner = 0;
+uint32_t KernelLock::depth = 0;
+
+void KernelLock::Acquire()
+{
+    int32_t cpu = MultiprocessorManager::CurrentCpuIndex();
+    if (owner == cpu) {
+        ++depth;
+        return;
+    }
+    
+    lock.Acquire();
+    owner = cpu;
+    depth = 1;
+    
+    // Another CPU may have changed stack page table entries which are still in the TLB of this one
+    if (lastOwner != cpu) {
+        lastOwner = cpu;
+        PagingManager::FlushTlb();
+    }
+}
+
+void KernelLock::Release()
+{
+    if (--depth == 0) {
+        owner = -1;
+        lock.Release();
+    }
+}
+
+
+
+
+uint32_t MultiprocessorManager::numCpus = 1;
+uint8_t MultiprocessorManager::apicIds[MAX_NUM_CPUS];
+uint8_t MultiprocessorManager::cpuIndexOfApicId[256];
+volatile uint32_t MultiprocessorManager::bootingCpu = 0;
+volatile bool MultiprocessorManager::bootingCpuOnline = false;
+PagingManager* MultiprocessorManager::paging = 0;
+TaskManager* MultiprocessorManager::taskManager = 0;
+uint32_t MultiprocessorManager::timerInitialCount = 0;
+uint8_t MultiprocessorManager::apStacks[MAX_NUM_CPUS][AP_STACK_SIZE];
+
+MultiprocessorManager::MultiprocessorManager(PagingManager* paging, TaskManager* taskManager)
+{
+    MultiprocessorManager::paging = paging;
+    MultiprocessorManager::taskManager = taskManager;
+    numFoundCpus = 0;
+}
+
+MultiprocessorManager::~MultiprocessorManager()
+{
+}
+
+uint32_t MultiprocessorManager::NumCpus()
+{
+    return numCpus;
+}
+
+uint32_t MultiprocessorManager::CurrentCpuIndex()
+{
+    if (numCpus == 1)
+        return 0;
+    return cpuIndexOfApicId[LocalApic::Id()];
+}
+
+static bool ChecksumIsZero(uint8_t* bytes, uint32_t length)
+{
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < length; ++i) {
+        sum += bytes[i];
+    }
+    return sum == 0;
+}
+
+// Looks for the 16 byte aligned MP floating pointer structure ("_MP_") in [start, start + length)
+static uint8_t* FindFloatingPointer(uint32_t start, uint32_t length)
+{
+    for (uint32_t address = start; address + 16 <= start + length; address += 16) {
+        uint8_t* p = (uint8_t*) address;
+        if (p[0] == '_' && p[1] == 'M' && p[2] == 'P' && p[3] == '_' && ChecksumIsZero(p, 16))
+            return p;
+    }
+    return 0; // null
+}
+
+// Reads the processor entries of the MP configuration table. The BSP gets index 0, the APs follow in table order.
+bool MultiprocessorManager::FindProcessors()
+{
+    // The first KiB of the extended BIOS data area, the last KiB of base memory, then the BIOS ROM
+    uint32_t ebda = (uint32_t)(*(uint16_t*) 0x40E) << 4;
+    uint8_t* floatingPointer = ebda != 0 ? FindFloatingPointer(ebda, 1024) : 0;
+    if (floatingPointer == 0) floatingPointer = FindFloatingPointer(0x9FC00, 1024);
+    if (floatingPointer == 0) floatingPointer = FindFloatingPointer(0xF0000, 0x10000);
+    if (floatingPointer == 0)
+        return false;
+    
+    // A zero table address means one of the default configurations, which have two CPUs with APIC ids 0 and 1
+    uint8_t* table = (uint8_t*) *(uint32_t*)(floatingPointer + 4);
+    if (table == 0 || table[0] != 'P' || table[1] != 'C' || table[2] != 'M' || table[3] != 'P')
+        return false;
+    if (!ChecksumIsZero(table, *(uint16_t*)(table + 4)))
+        return false;
+    
+    LocalApic::SetBase(*(uint32_t*)(table + 36));
+    
+    uint16_t numEntries = *(uint16_t*)(table + 34);
+    uint8_t* entry = table + 44;
+    numFoundCpus = 1;
+    apicIds[0] = LocalApic::Id();
+    for (uint16_t i = 0; i < numEntries; ++i) {
+        // Processor entries are 20 bytes, every other entry type is 8 bytes
+        if (entry[0] != 0) {
+            entry += 8;
+            continue;
+        }
+        
+        uint8_t apicId = entry[1];
+        bool enabled = entry[3] & 0x1;
+        bool bootstrap = entry[3] & 0x2;
+        if (enabled && !bootstrap && apicId != apicIds[0] && numFoundCpus < MAX_NUM_CPUS) {
+            apicIds[numFoundCpus++] = apicId;
+        }
+        entry += 20;
+    }
+    return true;
+}
+
+uint32_t MultiprocessorManager::StartApplicationProcessors(uint32_t maxNumCpus, uint32_t timerFrequency)
+{
+    if (numCpus > 1 || !FindProcessors() || numFoundCpus == 1 || maxNumCpus <= 1)
+        return numCpus;
+    
+    for (int i = 0; i < 256; ++i) {
+        cpuIndexOfApicId[i] = 0;
+    }
+    
+    // The APs use their local APIC timer instead of the PIT, at the same rate
+    ProgrammableIntervalTimer timer;
+    LocalApic::Enable(SPURIOUS_INTERRUPT_VECTOR);
+    uint32_t countsIn10Milliseconds = LocalApic::MeasureTimer(10000);
+    timerInitialCount = countsIn10Milliseconds * 100 / (timerFrequency != 0 ? timerFrequency : 1);
+    
+    uint32_t trampolineSize = ap_trampoline_end - ap_trampoline_start;
+    uint8_t* trampoline = (uint8_t*) TRAMPOLINE_BASE;
+    for (uint32_t i = 0; i < trampolineSize; ++i) {
+        trampoline[i] = ap_trampoline_start[i];
+    }
+    *(uint32_t*)(trampoline + (ap_trampoline_entry - ap_trampoline_start)) = (uint32_t) &ApplicationProcessorMain;
+    
+    for (uint32_t i = 1; i < numFoundCpus && numCpus < maxNumCpus; ++i) {
+        // Number the CPUs without gaps, a CPU which does not start is skipped
+        cpuIndexOfApicId[apicIds[i]] = numCpus;
+        apicIds[numCpus] = apicIds[i];
+        if (StartProcessor(numCpus, &timer)) {
+            ++numCpus;
+        }
+    }
+    
+    printf("CPUs: ");
+    printInteger(numCpus);
+    printf("\n");
+    return numCpus;
+}
+
+// INIT, then up to two startup IPIs, as in the MultiProcessor Specification
+bool MultiprocessorManager::StartProcessor(uint32_t cpu, ProgrammableIntervalTimer* timer)
+{
+    uint8_t* trampoline = (uint8_t*) TRAMPOLINE_BASE;
+    *(uint32_t*)(trampoline + (ap_trampoline_stack - ap_trampoline_start)) = (uint32_t)(apStacks[cpu] + AP_STACK_SIZE);
+    bootingCpu = cpu;
+    bootingCpuOnline = false;
+    
+    LocalApic::SendInit(apicIds[cpu]);
+    timer->Wait(10000);
+    
+    for (int i = 0; i < 2 && !bootingCpuOnline; ++i) {
+        LocalApic::SendStartup(apicIds[cpu], TRAMPOLINE_BASE / PAGE_SIZE);
+        timer->Wait(200);
+    }
+    
+    // Give it up to 100 ms to reach ApplicationProcessorMain
+    for (int i = 0; i < 100 && !bootingCpuOnline; ++i) {
+        timer->Wait(1000);
+    }
+    return bootingCpuOnline;
+}
+
+// Runs on an AP right after the trampoline, with the stack from apStacks
+void MultiprocessorManager::ApplicationProcessorMain()
+{
+    uint32_t cpu = bootingCpu;
+    
+    // The BSP waits until this CPU is online, so nothing else uses the heap meanwhile.
+    // Without memory for the GDT, the CPU never comes online and the BSP skips it.
+    void* gdtMemory = gdtCache.Allocate();
+    if (gdtMemory == 0) {
+        while (1) {
+            asm volatile("cli\n hlt");
+        }
+    }
+    GlobalDescriptorTable* gdt = new (gdtMemory) GlobalDescriptorTable();
+    paging->ActivateProcessor(gdt, cpu);
+    InterruptManager::LoadInterruptDescriptorTable();
+    FloatingPointUnit::EnableProcessor();
+    SyscallHandler::EnableFastSyscalls(gdt, cpu);
+    LocalApic::Enable(SPURIOUS_INTERRUPT_VECTOR);
+    taskManager->StartProcessor(cpu);
+    
+    bootingCpuOnline = true;
+    
+    // Scheduling starts with the first timer interrupt after the interrupts are activated on the BSP
+    while (!InterruptManager::IsActive()) {
+        asm volatile("pause");
+    }
+    LocalApic::StartPeriodicTimer(InterruptManager::ActiveHardwareInterruptOffset() + APIC_TIMER_INTERRUPT, timerInitialCount);
+    
+    while (1) {
+        asm volatile("sti\n hlt");
+    }
+}
@@ -0,0 +1,60 @@
+
+# Start code of the application processors (smp.cpp MultiprocessorManager). The startup IPI starts an AP in real mode at
+# TRAMPOLINE_BASE, where this code is copied to, so every address in here is computed relative to that copy.
+.set TRAMPOLINE_BASE, 0x8000
+
+.section .text
+
+.align 16
+.global ap_trampoline_start
+ap_trampoline_start:
+.code16
+    cli
+    xorw %ax, %ax
+    movw %ax, %ds
+    
+    # Load the temporary descriptor table below and enter protected mode
+    lgdtl TRAMPOLINE_BASE + ap_trampoline_gdt_pointer - ap_trampoline_start
+    movl %cr0, %eax
+    orl $0x1, %eax
+    movl %eax, %cr0
+    ljmpl $0x10, $(TRAMPOLINE_BASE + ap_trampoline_protected_mode - ap_trampoline_start)
+
+.code32
+ap_trampoline_protected_mode:
+    movw $0x18, %ax
+    movw %ax, %ds
+    movw %ax, %es
+    movw %ax, %fs
+    movw %ax, %gs
+    movw %ax, %ss
+    
+    # The bootstrap processor sets the stack and the entry point before every startup IPI
+    movl TRAMPOLINE_BASE + ap_trampoline_stack - ap_trampoline_start, %esp
+    call *(TRAMPOLINE_BASE + ap_trampoline_entry - ap_trampoline_start)
+    
+ap_trampoline_halt:
+    cli
+    hlt
+    jmp ap_trampoline_halt
+
+# Flat code and data segments with the same selectors (0x10, 0x18) as gdt.cpp
+.align 8
+ap_trampoline_gdt:
+    .quad 0
+    .quad 0
+    .quad 0x00CF9A000000FFFF
+    .quad 0x00CF92000000FFFF
+ap_trampoline_gdt_pointer:
+    .word ap_trampoline_gdt_pointer - ap_trampoline_gdt - 1
+    .long TRAMPOLINE_BASE + ap_trampoline_gdt - ap_trampoline_start
+
+.global ap_trampoline_stack
+ap_trampoline_stack:
+    .long 0
+.global ap_trampoline_entry
+ap_trampoline_entry:
+    .long 0
+
+.global ap_trampoline_end
+ap_trampoline_end:
@@ -0,0 +1,65 @@
+#include <stackpool.h>
+
+using namespace myos;
+using namespace myos::common;
+
+
+StackPool::StackPool()
+{
+    next = STACK_AREA_BASE;
+    for (int i = 0; i < NUM_STACK_SIZE_CLASSES; ++i) {
+        freeHeads[i] = NO_STACK;
+    }
+    numFreeStacks = 0;
+}
+
+uint32_t StackPool::SizeClass(uint32_t size)
+{
+    uint32_t sizeClass = 0;
+    while (sizeClass < NUM_STACK_SIZE_CLASSES && (MIN_STACK_REGION_SIZE << sizeClass) - PAGE_SIZE < size) {
+        ++sizeClass;
+    }
+    return sizeClass;
+}
+
+uint32_t StackPool::StackSize(uint32_t size)
+{
+    uint32_t sizeClass = SizeClass(size);
+    if (sizeClass == NUM_STACK_SIZE_CLASSES)
+        return 0;
+    return (MIN_STACK_REGION_SIZE << sizeClass) - PAGE_SIZE;
+}
+
+uint8_t* StackPool::Allocate(uint32_t size)
+{
+    uint32_t sizeClass = SizeClass(size);
+    if (sizeClass == NUM_STACK_SIZE_CLASSES)
+        return 0; // null
+    
+    // The stack freed last is taken first, its top page is the most likely one to be still mapped
+    if (freeHeads[sizeClass] != NO_STACK) {
+        uint16_t page = freeHeads[sizeClass];
+        freeHeads[sizeClass] = nextFree[page];
+        --numFreeStacks;
+        return (uint8_t*) (STACK_AREA_BASE + page * PAGE_SIZE);
+    }
+    
+    uint32_t regionSize = MIN_STACK_REGION_SIZE << sizeClass;
+    if (STACK_AREA_BASE + STACK_AREA_SIZE - next < regionSize)
+        return 0; // null
+    
+    uint8_t* stack = (uint8_t*) (next + PAGE_SIZE);
+    next += regionSize;
+    return stack;
+}
+
+void StackPool::Free(uint8_t* stack, uint32_t size)
+{
+    uint32_t sizeClass = SizeClass(size);
+    uint16_t page = ((uint32_t) stack - STACK_AREA_BASE) / PAGE_SIZE;
+    nextFree[page] = freeHeads[sizeClass];
+    freeHeads[sizeClass] = page;
+    ++numFreeStacks;
+}
+
+uint32_t StackPool::FreeStacks() { return numFreeStacks; }
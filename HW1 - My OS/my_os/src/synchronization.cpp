@@ -0,0 +1,96 @@
+#include <synchronization.h>
+#include <multitasking.h>
+
+using namespace myos;
+using namespace myos::common;
+
+
+WaitQueue::WaitQueue()
+{
+    for (int i = 0; i < NUM_PRIORITIES; ++i) {
+        heads[i] = 0;
+        tails[i] = 0;
+    }
+    length = 0;
+}
+
+void WaitQueue::PushBack(Task* task)
+{
+    common::uint32_t level = task->priority;
+    task->waitLevel = level;
+    task->waitQueue = this;
+    task->nextWaiting = 0;
+    task->prevWaiting = tails[level];
+    
+    if (tails[level] != 0) tails[level]->nextWaiting = task;
+    else heads[level] = task;
+    tails[level] = task;
+    ++length;
+}
+
+Task* WaitQueue::PopFront()
+{
+    Task* task = First();
+    if (task != 0) Remove(task);
+    return task;
+}
+
+Task* WaitQueue::First()
+{
+    for (int level = 0; level < NUM_PRIORITIES; ++level) {
+        if (heads[level] != 0)
+            return heads[level];
+    }
+    return 0; // null
+}
+
+void WaitQueue::Remove(Task* task)
+{
+    if (task->waitQueue != this)
+        return;
+    
+    common::uint32_t level = task->waitLevel;
+    if (task->prevWaiting != 0) task->prevWaiting->nextWaiting = task->nextWaiting;
+    else heads[level] = task->nextWaiting;
+    if (task->nextWaiting != 0) task->nextWaiting->prevWaiting = task->prevWaiting;
+    else tails[level] = task->prevWaiting;
+    
+    task->nextWaiting = 0;
+    task->prevWaiting = 0;
+    task->waitQueue = 0;
+    --length;
+}
+
+bool WaitQueue::IsEmpty() { return length == 0; }
+int WaitQueue::Length() { return length; }
+
+common::uint32_t WaitQueue::HighestPriority()
+{
+    for (int level = 0; level < NUM_PRIORITIES; ++level) {
+        if (heads[level] != 0)
+            return level;
+    }
+    return NUM_PRIORITIES;
+}
+
+
+
+
+Mutex::Mutex()
+{
+    used = false;
+    owner = 0;
+    nextHeld = 0;
+    prevHeld = 0;
+}
+
+Semaphore::Semaphore()
+{
+    used = false;
+    count = 0;
+}
+
+ConditionVariable::ConditionVariable()
+{
+    used = false;
+}
@@ -5,73 +5,403 @@ using namespace myos;
 using namespace myos::common;
 using namespace myos::hardwarecommunication;
  
+const uint32_t MSR_SYSENTER_CS = 0x174;
+const uint32_t MSR_SYSENTER_ESP = 0x175;
+const uint32_t MSR_SYSENTER_EIP = 0x176;
+
+const uint32_t CPUID_SEP = 1 << 11;
+
+
+SyscallHandler* SyscallHandler::activeSyscallHandler = 0;
+uint8_t SyscallHandler::sysenterStacks[MAX_NUM_CPUS][SYSENTER_STACK_SIZE];
+
 SyscallHandler::SyscallHandler(InterruptManager* interruptManager, uint8_t InterruptNumber, TaskManager* taskManager)
 :    InterruptHandler(interruptManager, InterruptNumber  + interruptManager->HardwareInterruptOffset())
 {
     this->taskManager = taskManager;
+    for (uint32_t i = 0; i < NUM_SYSCALLS; ++i) {
+        syscalls[i] = 0;
+        callCounts[i] = 0;
+    }
+    RegisterSyscalls();
+    activeSyscallHandler = this;
 }
 
 SyscallHandler::~SyscallHandler()
 {
+    if (activeSyscallHandler == this)
+        activeSyscallHandler = 0;
+}
+
+static inline void WriteModelSpecificRegister(uint32_t msr, uint32_t value)
+{
+    asm volatile("wrmsr" : : "c" (msr), "a" (value), "d" (0));
+}
+
+bool SyscallHandler::EnableFastSyscalls(GlobalDescriptorTable* gdt, uint32_t cpu)
+{
+    uint32_t eax = 1, ebx, ecx, edx;
+    asm volatile("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+    
+    // The Pentium Pro reports sysenter without having it
+    uint32_t family = (eax >> 8) & 0xF;
+    uint32_t model = (eax >> 4) & 0xF;
+    if ((edx & CPUID_SEP) == 0 || (family == 6 && model < 3))
+        return false;
+    
+    // The data segment selector comes right after the code segment selector, as sysenter expects
+    WriteModelSpecificRegister(MSR_SYSENTER_CS, gdt->CodeSegmentSelector());
+    WriteModelSpecificRegister(MSR_SYSENTER_ESP, (uint32_t) (sysenterStacks[cpu] + SYSENTER_STACK_SIZE));
+    WriteModelSpecificRegister(MSR_SYSENTER_EIP, (uint32_t) &FastSyscallEntry);
+    return true;
+}
+
+// The stub holds the kernel lock already, so it goes straight to the system call without the interrupt manager
+uint32_t SyscallHandler::HandleFastSyscall(uint32_t esp)
+{
+    return activeSyscallHandler->SyscallHandler::HandleInterrupt(esp);
 }
 
 
 void printf(char*);
 void printfHex32(uint32_t);
 
-uint32_t SyscallHandler::HandleInterrupt(uint32_t esp)
+
+// The system calls get the registers of the calling task and return the stack to continue with: the same CPUState,
+// or the one of another task if the caller blocked or exited. The results go to eax.
+
+static uint32_t Print(TaskManager* taskManager, CPUState* cpu)
 {
-    CPUState* cpu = (CPUState*)esp;
-    
+    printf((char*)cpu->ebx);
+    return (uint32_t) cpu;
+}
+
+static uint32_t Fork(TaskManager* taskManager, CPUState* cpu)
+{
+    taskManager->Fork(cpu);
+    return (uint32_t) cpu;
+}
 
-    switch(cpu->eax)
-    {
-        case 1: 
-            // write syscall in linux (sysprintf)
-            printf((char*)cpu->ebx);
-            break;
-            
-        case 57: 
-            // fork syscall number in linux (sysfork)
-            taskManager->Fork(cpu);
-            break;
-            
-        case 58:
-            cpu->eax = taskManager->GetCurrentTask()->forkPid;
-            break;
-            
-        case 59: 
-            // execve syscall number in linux (sysexecve)
-            esp = taskManager->Execve((void (*)()) cpu->ebx);
-            break;
-            
-        case 7:
-            // waitpid syscall number in linux (syswaitpid)
-            esp = taskManager->Waitpid(cpu->ebx, cpu);
-            break;
-            
-        case 8:
-            // exit
-            esp = taskManager->Exit();
-            break;
-            
-        case 9:
-            esp = taskManager->BlockForCollatz(cpu);
-            break;
-            
-        case 10:
-            taskManager->SetLastTaskPriority(cpu->ebx);
-            break;
-            
-        case 11:
-            taskManager->CollatzAdded();
-            break;
-            
-        default:
-            break;
+static uint32_t ForkPid(TaskManager* taskManager, CPUState* cpu)
+{
+    cpu->eax = taskManager->GetCurrentTask()->forkPid;
+    return (uint32_t) cpu;
+}
+
+static uint32_t GetPid(TaskManager* taskManager, CPUState* cpu)
+{
+    cpu->eax = taskManager->GetCurrentTask()->GetPid();
+    return (uint32_t) cpu;
+}
+
+static uint32_t Execve(TaskManager* taskManager, CPUState* cpu)
+{
+    return taskManager->Execve((void (*)()) cpu->ebx);
+}
+
+static uint32_t Spawn(TaskManager* taskManager, CPUState* cpu)
+{
+    cpu->eax = taskManager->Spawn((void (*)()) cpu->ebx, cpu->ecx, cpu->edx);
+    return (uint32_t) cpu;
+}
+
+static uint32_t SpawnBatch(TaskManager* taskManager, CPUState* cpu)
+{
+    cpu->eax = taskManager->SpawnBatch((SpawnRequest*) cpu->ebx, cpu->ecx);
+    return (uint32_t) cpu;
+}
+
+static uint32_t Waitpid(TaskManager* taskManager, CPUState* cpu)
+{
+    return taskManager->Waitpid(cpu->ebx, cpu);
+}
+
+static uint32_t Exit(TaskManager* taskManager, CPUState* cpu)
+{
+    return taskManager->Exit();
+}
+
+static uint32_t BlockForCollatz(TaskManager* taskManager, CPUState* cpu)
+{
+    return taskManager->BlockForCollatz(cpu);
+}
+
+static uint32_t SetLastTaskPriority(TaskManager* taskManager, CPUState* cpu)
+{
+    taskManager->SetLastTaskPriority(cpu->ebx);
+    return (uint32_t) cpu;
+}
+
+static uint32_t CollatzAdded(TaskManager* taskManager, CPUState* cpu)
+{
+    taskManager->CollatzAdded();
+    return (uint32_t) cpu;
+}
+
+static uint32_t SetLastTaskTickets(TaskManager* taskManager, CPUState* cpu)
+{
+    taskManager->SetLastTaskTickets(cpu->ebx);
+    return (uint32_t) cpu;
+}
+
+static uint32_t GetStatistics(TaskManager* taskManager, CPUState* cpu)
+{
+    cpu->eax = taskManager->GetStatistics(cpu->ebx, (TaskStatistics*) cpu->ecx) ? 0 : -1;
+    return (uint32_t) cpu;
+}
+
+static uint32_t Sleep(TaskManager* taskManager, CPUState* cpu)
+{
+    return taskManager->Sleep(cpu->ebx, cpu);
+}
+
+static uint32_t SetRealTime(TaskManager* taskManager, CPUState* cpu)
+{
+    cpu->eax = taskManager->SetRealTime(cpu->ebx, cpu->ecx, cpu->edx);
+    return (uint32_t) cpu;
+}
+
+static uint32_t Yield(TaskManager* taskManager, CPUState* cpu)
+{
+    return taskManager->Yield(cpu);
+}
+
+static uint32_t CreateMutex(TaskManager* taskManager, CPUState* cpu)
+{
+    cpu->eax = taskManager->CreateMutex();
+    return (uint32_t) cpu;
+}
+
+static uint32_t LockMutex(TaskManager* taskManager, CPUState* cpu)
+{
+    return taskManager->LockMutex(cpu->ebx, cpu);
+}
+
+static uint32_t TryLockMutex(TaskManager* taskManager, CPUState* cpu)
+{
+    cpu->eax = taskManager->TryLockMutex(cpu->ebx);
+    return (uint32_t) cpu;
+}
+
+static uint32_t UnlockMutex(TaskManager* taskManager, CPUState* cpu)
+{
+    cpu->eax = taskManager->UnlockMutex(cpu->ebx);
+    return (uint32_t) cpu;
+}
+
+static uint32_t DestroyMutex(TaskManager* taskManager, CPUState* cpu)
+{
+    cpu->eax = taskManager->DestroyMutex(cpu->ebx);
+    return (uint32_t) cpu;
+}
+
+static uint32_t CreateSemaphore(TaskManager* taskManager, CPUState* cpu)
+{
+    cpu->eax = taskManager->CreateSemaphore(cpu->ebx);
+    return (uint32_t) cpu;
+}
+
+static uint32_t WaitSemaphore(TaskManager* taskManager, CPUState* cpu)
+{
+    return taskManager->WaitSemaphore(cpu->ebx, cpu);
+}
+
+static uint32_t TryWaitSemaphore(TaskManager* taskManager, CPUState* cpu)
+{
+    cpu->eax = taskManager->TryWaitSemaphore(cpu->ebx);
+    return (uint32_t) cpu;
+}
+
+static uint32_t PostSemaphore(TaskManager* taskManager, CPUState* cpu)
+{
+    cpu->eax = taskManager->PostSemaphore(cpu->ebx);
+    return (uint32_t) cpu;
+}
+
+static uint32_t DestroySemaphore(TaskManager* taskManager, CPUState* cpu)
+{
+    cpu->eax = taskManager->DestroySemaphore(cpu->ebx);
+    return (uint32_t) cpu;
+}
+
+static uint32_t CreateConditionVariable(TaskManager* taskManager, CPUState* cpu)
+{
+    cpu->eax = taskManager->CreateConditionVariable();
+    return (uint32_t) cpu;
+}
+
+static uint32_t WaitConditionVariable(TaskManager* taskManager, CPUState* cpu)
+{
+    return taskManager->WaitConditionVariable(cpu->ebx, cpu->ecx, cpu);
+}
+
+static uint32_t SignalConditionVariable(TaskManager* taskManager, CPUState* cpu)
+{
+    cpu->eax = taskManager->SignalConditionVariable(cpu->ebx);
+    return (uint32_t) cpu;
+}
+
+static uint32_t BroadcastConditionVariable(TaskManager* taskManager, CPUState* cpu)
+{
+    cpu->eax = taskManager->BroadcastConditionVariable(cpu->ebx);
+    return (uint32_t) cpu;
+}
+
+static uint32_t DestroyConditionVariable(TaskManager* taskManager, CPUState* cpu)
+{
+    cpu->eax = taskManager->DestroyConditionVariable(cpu->ebx);
+    return (uint32_t) cpu;
+}
+
+static uint32_t CreatePipe(TaskManager* taskManager, CPUState* cpu)
+{
+    cpu->eax = taskManager->CreatePipe((int32_t*) cpu->ebx);
+    return (uint32_t) cpu;
+}
+
+static uint32_t Read(TaskManager* taskManager, CPUState* cpu)
+{
+    return taskManager->Read(cpu->ebx, (uint8_t*) cpu->ecx, cpu->edx, cpu);
+}
+
+static uint32_t Write(TaskManager* taskManager, CPUState* cpu)
+{
+    return taskManager->Write(cpu->ebx, (uint8_t*) cpu->ecx, cpu->edx, cpu);
+}
+
+static uint32_t Close(TaskManager* taskManager, CPUState* cpu)
+{
+    cpu->eax = taskManager->Close(cpu->ebx);
+    return (uint32_t) cpu;
+}
+
+static uint32_t CreateMessageQueue(TaskManager* taskManager, CPUState* cpu)
+{
+    cpu->eax = taskManager->CreateMessageQueue();
+    return (uint32_t) cpu;
+}
+
+static uint32_t DestroyMessageQueue(TaskManager* taskManager, CPUState* cpu)
+{
+    cpu->eax = taskManager->DestroyMessageQueue(cpu->ebx);
+    return (uint32_t) cpu;
+}
+
+static uint32_t SendMessage(TaskManager* taskManager, CPUState* cpu)
+{
+    return taskManager->SendMessage(cpu->ebx, (uint8_t*) cpu->ecx, cpu->edx, cpu);
+}
+
+static uint32_t ReceiveMessage(TaskManager* taskManager, CPUState* cpu)
+{
+    return taskManager->ReceiveMessage(cpu->ebx, (uint8_t*) cpu->ecx, cpu->edx, cpu);
+}
+
+static uint32_t GetSyscallCount(TaskManager* taskManager, CPUState* cpu)
+{
+    cpu->eax = SyscallHandler::ActiveCallCount(cpu->ebx);
+    return (uint32_t) cpu;
+}
+
+static uint32_t GetHeapStatistics(TaskManager* taskManager, CPUState* cpu)
+{
+    if (MemoryManager::activeMemoryManager == 0) {
+        cpu->eax = -1;
+        return (uint32_t) cpu;
     }
+    MemoryManager::activeMemoryManager->GetStatistics((HeapStatistics*) cpu->ebx);
+    cpu->eax = 0;
+    return (uint32_t) cpu;
+}
+
 
+// The numbers are the ones of the same system calls in linux where there is one
+void SyscallHandler::RegisterSyscalls()
+{
+    Register(1, Print); // write in linux, the string in ebx
+    Register(57, Fork); // fork
+    Register(58, ForkPid); // Child pid after fork, 0 in the child
+    Register(20, GetPid); // getpid
+    Register(59, Execve); // execve, the entry point in ebx
+    Register(120, Spawn); // clone in linux, the entry point in ebx, the priority in ecx and the stack size in edx
+    Register(7, Waitpid); // waitpid, pid or -1 in ebx
+    Register(8, Exit);
+    
+    // For the lifecycles in kernel.cpp
+    Register(9, BlockForCollatz);
+    Register(10, SetLastTaskPriority); // Priority in ebx
+    Register(11, CollatzAdded);
+    Register(12, SetLastTaskTickets); // Tickets of the last added task for stride scheduling in ebx
+    
+    Register(77, GetStatistics); // getrusage, pid or TASK_STATISTICS_SELF/LAST_CHILD in ebx, TaskStatistics in ecx
+    Register(162, Sleep); // nanosleep, but takes milliseconds in ebx
+    Register(351, SetRealTime); // sched_setattr, period, budget and deadline in milliseconds in ebx, ecx and edx
+    Register(158, Yield); // sched_yield, ends the current job of a real-time task
+    
+    // Mutexes, semaphores and condition variables, the id is in ebx
+    Register(200, CreateMutex);
+    Register(201, LockMutex);
+    Register(202, TryLockMutex);
+    Register(203, UnlockMutex);
+    Register(204, DestroyMutex);
+    Register(205, CreateSemaphore); // Initial count in ebx
+    Register(206, WaitSemaphore);
+    Register(207, TryWaitSemaphore);
+    Register(208, PostSemaphore);
+    Register(209, DestroySemaphore);
+    Register(210, CreateConditionVariable);
+    Register(211, WaitConditionVariable); // Mutex id in ecx
+    Register(212, SignalConditionVariable);
+    Register(213, BroadcastConditionVariable);
+    Register(214, DestroyConditionVariable);
+    
+    // Pipes, the descriptor is in ebx, the buffer in ecx and its length in edx
+    Register(42, CreatePipe); // pipe, int[2] for the read and write descriptors in ebx
+    Register(3, Read); // read
+    Register(4, Write); // write
+    Register(6, Close); // close
     
-    return esp;
+    // Message queues, the syscall numbers of mq_open, mq_unlink, mq_timedsend and mq_timedreceive in linux
+    Register(277, CreateMessageQueue);
+    Register(278, DestroyMessageQueue);
+    Register(279, SendMessage); // Message in ecx, length in edx
+    Register(280, ReceiveMessage); // Buffer in ecx, its size in edx
+    
+    Register(400, GetSyscallCount); // Calls of the system call number in ebx so far
+    Register(401, SpawnBatch); // SpawnRequest array in ebx, its length in ecx
+    Register(402, GetHeapStatistics); // HeapStatistics in ebx
+}
+
+bool SyscallHandler::Register(uint32_t number, Syscall syscall)
+{
+    if (number >= NUM_SYSCALLS || syscalls[number] != 0)
+        return false;
+    syscalls[number] = syscall;
+    return true;
+}
+
+uint32_t SyscallHandler::CallCount(uint32_t number)
+{
+    if (number >= NUM_SYSCALLS)
+        return 0;
+    return callCounts[number];
+}
+
+uint32_t SyscallHandler::ActiveCallCount(uint32_t number)
+{
+    if (activeSyscallHandler == 0)
+        return 0;
+    return activeSyscallHandler->CallCount(number);
 }
 
+// Unknown numbers return to the caller without changing anything
+uint32_t SyscallHandler::HandleInterrupt(uint32_t esp)
+{
+    CPUState* cpu = (CPUState*)esp;
+    uint32_t number = cpu->eax;
+    if (number >= NUM_SYSCALLS || syscalls[number] == 0)
+        return esp;
+    
+    ++callCounts[number];
+    return syscalls[number](taskManager, cpu);
+}